@@ -17,29 +17,8 @@ inline float min(float a, float b) {
     return b;
 }
 
-Argument::Argument(const std::string& data) {
-    m_data = std::make_shared<std::string>(data);
-}
-Argument::Argument(float data) {
-    m_data = std::make_shared<float>(data);
-}
-Argument::Argument(const std::vector<float>& data) {
-    m_data = std::make_shared<std::vector<float>>(data);
-}
-Argument::Argument(const Stroke& data) {
-    m_data = std::make_shared<Stroke>(data);
-}
-Argument::Argument(int data) {
-    m_data = std::make_shared<int>(data);
-}
-Argument::Argument(color data) {
-    m_data = std::make_shared<color>(data);
-}
-Argument::Argument(u16 data) {
-    m_data = std::make_shared<u16>(data);
-}
-
 std::unordered_map<std::string, sptr<Font_abstract>> Font_abstract::fonts_sptr = std::unordered_map<std::string, sptr<Font_abstract>>();
+std::mutex Font_abstract::fonts_mutex;
 
 /************ FONT ************/
 Font_abstract::Font_abstract(const std::string& family, int style, float size) {
@@ -59,15 +38,17 @@ std::string Font_abstract::getFamily() const {
     return m_family;
 }
 bool Font_abstract::operator==(const Font& f) const {
-    return false; //static_cast<Font_abstract>(f).m_path == m_path; //f.m_font_id == m_font_id;
+    auto other = dynamic_cast<const Font_abstract*>(&f);
+    return other != nullptr && other->m_path == m_path && other->m_family == m_family && other->m_style == m_style;
 }
 sptr<Font_abstract> Font_abstract::getOrCreate(const std::string& file) {
-    if (fonts_sptr.find(file) != fonts_sptr.end()) {
-        return fonts_sptr[file];
-    }
-    else {
-        return sptrOf<Font_abstract>(file, 10.f);
-    }
+    std::lock_guard<std::mutex> lock(fonts_mutex);
+    auto it = fonts_sptr.find(file);
+    if (it != fonts_sptr.end())
+        return it->second;
+    auto font = sptrOf<Font_abstract>(file, 10.f);
+    fonts_sptr[file] = font;
+    return font;
 }
 
 /************ TextLayout ***********/
@@ -113,11 +94,33 @@ ImVec2 Graphics2D_abstract::getScaledMax() {
     return ImVec2(m_max_x, m_max_y);
 }
 
-void Graphics2D_abstract::pushMinMax(float x, float y) {
-    m_min_x = min(x * m_sx + m_dx, m_min_x);
-    m_max_x = max(x * m_sx + m_dx, m_max_x);
-    m_min_y = min(y * m_sy + m_dy, m_min_y);
-    m_max_y = max(y * m_sy + m_dy, m_max_y);
+bool Graphics2D_abstract::getInkBounds(ImVec2& min_pos, ImVec2& max_pos) const {
+    if (m_bounds_rotated || m_min_x > m_max_x || m_min_y > m_max_y)
+        return false;
+    min_pos = ImVec2(m_min_x, m_min_y);
+    max_pos = ImVec2(m_max_x, m_max_y);
+    return true;
+}
+
+void Graphics2D_abstract::pushMinMax(float x, float y, float margin) {
+    // The scale can be negative (mirrored boxes)
+    float px = x * m_sx + m_dx;
+    float py = y * m_sy + m_dy;
+    float mx = margin * abs(m_sx);
+    float my = margin * abs(m_sy);
+    m_min_x = min(px - mx, m_min_x);
+    m_max_x = max(px + mx, m_max_x);
+    m_min_y = min(py - my, m_min_y);
+    m_max_y = max(py + my, m_max_y);
+}
+
+void Graphics2D_abstract::pushTextMinMax(float x, float y, float advance) {
+    // The outlines are not known here: conservative em box around the baseline
+    // (large operators and italic overhangs can go beyond the advance)
+    float size = m_font->getSize();
+    m_bounds_exact = false;
+    pushMinMax(x - 0.25f * size, y - 1.5f * size);
+    pushMinMax(x + advance + 0.5f * size, y + 0.75f * size);
 }
 
 void Graphics2D_abstract::updateFontInfo(const std::string& text) {
@@ -136,246 +139,199 @@ void Graphics2D_abstract::updateFontInfo(u32 c) {
 }
 
 
-std::vector<Call> Graphics2D_abstract::getCallList() {
-    return m_calls;
-}
-
-void Graphics2D_abstract::distributeCallList(Painter* painter) {
-    for (auto& call : m_calls) {
-        if (call.fct_name == "setColor") {
-            painter->setColor(call.arguments[0].getData<color>());
-        }
-        else if (call.fct_name == "setStroke") {
-            painter->setStroke(call.arguments[0].getData<Stroke>());
-        }
-        else if (call.fct_name == "setStrokeWidth") {
-            painter->setStrokeWidth(call.arguments[0].getData<float>());
-        }
-        else if (call.fct_name == "setDash") {
-            painter->setDash(call.arguments[0].getData<std::vector<float>>());
-        }
-        else if (call.fct_name == "setFont") {
-            painter->setFont(
-                call.arguments[0].getData<std::string>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<int>(),
-                call.arguments[3].getData<std::string>()
-            );
-        }
-        else if (call.fct_name == "setFontSize") {
-            painter->setFontSize(call.arguments[0].getData<float>());
-        }
-        else if (call.fct_name == "translate") {
-            painter->translate(call.arguments[0].getData<float>(), call.arguments[1].getData<float>());
-        }
-        else if (call.fct_name == "scale") {
-            painter->scale(call.arguments[0].getData<float>(), call.arguments[1].getData<float>());
-        }
-        else if (call.fct_name == "rotate") {
-            painter->rotate(call.arguments[0].getData<float>());
-        }
-        else if (call.fct_name == "rotateAroundPt") {
-            painter->rotate(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>()
-            );
-        }
-        else if (call.fct_name == "reset") {
+/************ DisplayList ************/
+i32 DisplayList::addString(const std::string& str) {
+    auto it = m_string_ids.find(str);
+    if (it != m_string_ids.end())
+        return it->second;
+    i32 idx = (i32)m_strings.size();
+    m_strings.push_back(str);
+    m_string_ids[str] = idx;
+    return idx;
+}
+i32 DisplayList::addDash(const std::vector<float>& dash) {
+    m_dashes.push_back(dash);
+    return (i32)m_dashes.size() - 1;
+}
+size_t DisplayList::byteSize() const {
+    size_t size = m_commands.capacity() * sizeof(Command);
+    for (auto& str : m_strings)
+        size += str.capacity() * 2; // table + index
+    for (auto& dash : m_dashes)
+        size += dash.capacity() * sizeof(float);
+    return size;
+}
+void DisplayList::clear() {
+    m_commands.clear();
+    m_strings.clear();
+    m_string_ids.clear();
+    m_dashes.clear();
+}
+
+void DisplayList::replay(Painter* painter) const {
+    for (const Command& c : m_commands) {
+        const float* f = c.f;
+        switch (c.op) {
+        case OpCode::SET_COLOR:
+            painter->setColor((color)c.i[0]);
+            break;
+        case OpCode::SET_STROKE:
+            painter->setStroke(Stroke(f[0], f[1], (Cap)c.i[0], (Join)c.i[1]));
+            break;
+        case OpCode::SET_STROKE_WIDTH:
+            painter->setStrokeWidth(f[0]);
+            break;
+        case OpCode::SET_DASH:
+            painter->setDash(m_dashes[c.i[0]]);
+            break;
+        case OpCode::SET_FONT:
+            // i[0]: path, i[1]: family, f[0]: size, f[1]: style
+            painter->setFont(m_strings[c.i[0]], f[0], (int)f[1], m_strings[c.i[1]]);
+            break;
+        case OpCode::SET_FONT_SIZE:
+            painter->setFontSize(f[0]);
+            break;
+        case OpCode::TRANSLATE:
+            painter->translate(f[0], f[1]);
+            break;
+        case OpCode::SCALE:
+            painter->scale(f[0], f[1]);
+            break;
+        case OpCode::ROTATE:
+            painter->rotate(f[0]);
+            break;
+        case OpCode::ROTATE_AROUND_PT:
+            painter->rotate(f[0], f[1], f[2]);
+            break;
+        case OpCode::RESET:
             painter->reset();
-        }
-        else if (call.fct_name == "drawGlyph") {
-            painter->drawGlyph(
-                call.arguments[0].getData<u32>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>()
-            );
-        }
-        else if (call.fct_name == "beginPath") {
-            painter->beginPath(call.arguments[0].getData<i32>());
-        }
-        else if (call.fct_name == "moveTo") {
-            painter->moveTo(call.arguments[0].getData<float>(), call.arguments[1].getData<float>());
-        }
-        else if (call.fct_name == "lineTo") {
-            painter->lineTo(call.arguments[0].getData<float>(), call.arguments[1].getData<float>());
-        }
-        else if (call.fct_name == "cubicTo") {
-            painter->cubicTo(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>(),
-                call.arguments[4].getData<float>(),
-                call.arguments[5].getData<float>()
-            );
-        }
-        else if (call.fct_name == "quadTo") {
-            painter->quadTo(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>()
-            );
-        }
-        else if (call.fct_name == "closePath") {
+            break;
+        case OpCode::DRAW_GLYPH:
+            painter->drawGlyph((u16)c.i[0], f[0], f[1]);
+            break;
+        case OpCode::BEGIN_PATH:
+            painter->beginPath(c.i[0]);
+            break;
+        case OpCode::MOVE_TO:
+            painter->moveTo(f[0], f[1]);
+            break;
+        case OpCode::LINE_TO:
+            painter->lineTo(f[0], f[1]);
+            break;
+        case OpCode::CUBIC_TO:
+            painter->cubicTo(f[0], f[1], f[2], f[3], f[4], f[5]);
+            break;
+        case OpCode::QUAD_TO:
+            painter->quadTo(f[0], f[1], f[2], f[3]);
+            break;
+        case OpCode::CLOSE_PATH:
             painter->closePath();
-        }
-        else if (call.fct_name == "fillPath") {
-            painter->fillPath(call.arguments[0].getData<i32>());
-        }
-        else if (call.fct_name == "drawLine") {
-            painter->drawLine(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>()
-            );
-        }
-        else if (call.fct_name == "drawRect") {
-            painter->drawRect(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>()
-            );
-        }
-        else if (call.fct_name == "fillRect") {
-            painter->fillRect(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>()
-            );
-        }
-        else if (call.fct_name == "drawRoundRect") {
-            painter->drawRoundRect(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>(),
-                call.arguments[4].getData<float>(),
-                call.arguments[5].getData<float>()
-            );
-        }
-        else if (call.fct_name == "fillRoundRect") {
-            painter->fillRoundRect(
-                call.arguments[0].getData<float>(),
-                call.arguments[1].getData<float>(),
-                call.arguments[2].getData<float>(),
-                call.arguments[3].getData<float>(),
-                call.arguments[4].getData<float>(),
-                call.arguments[5].getData<float>()
-            );
+            break;
+        case OpCode::FILL_PATH:
+            painter->fillPath(c.i[0]);
+            break;
+        case OpCode::DRAW_TEXT:
+            // Text is not part of the Painter interface (not distributed)
+            break;
+        case OpCode::DRAW_LINE:
+            painter->drawLine(f[0], f[1], f[2], f[3]);
+            break;
+        case OpCode::DRAW_RECT:
+            painter->drawRect(f[0], f[1], f[2], f[3]);
+            break;
+        case OpCode::FILL_RECT:
+            painter->fillRect(f[0], f[1], f[2], f[3]);
+            break;
+        case OpCode::DRAW_ROUND_RECT:
+            painter->drawRoundRect(f[0], f[1], f[2], f[3], f[4], f[5]);
+            break;
+        case OpCode::FILL_ROUND_RECT:
+            painter->fillRoundRect(f[0], f[1], f[2], f[3], f[4], f[5]);
+            break;
         }
     }
 }
+
+void Graphics2D_abstract::distributeCallList(Painter* painter) {
+    m_calls.replay(painter);
+}
 void Graphics2D_abstract::resetCallList() {
     m_calls.clear();
 }
 void Graphics2D_abstract::setColor(color color) {
     m_color = color;
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(color));
-    m_calls.push_back(Call{ "setColor", arguments });
+    m_calls.push(OpCode::SET_COLOR, (i32)color, 0);
 }
 color Graphics2D_abstract::getColor() const {
     return m_color;
 }
 void Graphics2D_abstract::setStroke(const Stroke& s) {
     m_stroke = s;
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(s));
-    m_calls.push_back(Call{ "setStroke", arguments });
+    m_calls.push(OpCode::SET_STROKE, (i32)s.cap, (i32)s.join, { s.lineWidth, s.miterLimit });
 }
 const Stroke& Graphics2D_abstract::getStroke() const {
     return m_stroke;
 }
 void Graphics2D_abstract::setStrokeWidth(float w) {
     m_stroke.lineWidth = w;
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(w));
-    m_calls.push_back(Call{ "setStrokeWidth", arguments });
+    m_calls.push(OpCode::SET_STROKE_WIDTH, { w });
 }
 
 void Graphics2D_abstract::setDash(const std::vector<float>& dash) {
     m_dash = dash;
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(dash));
-    m_calls.push_back(Call{ "setDash", arguments });
+    m_calls.push(OpCode::SET_DASH, m_calls.addDash(dash), 0);
 }
 std::vector<float> Graphics2D_abstract::getDash() {
     return m_dash;
 }
 
 sptr<Font> Graphics2D_abstract::getFont() const {
-    return sptr<Font>(m_font);
+    return m_font;
 }
 void Graphics2D_abstract::setFont(const sptr<Font>& font) {
-    m_font = (Font_abstract*)font.get();
+    m_font = std::static_pointer_cast<Font_abstract>(font);
 
     if (m_font_infos.find(m_font->getPath()) == m_font_infos.end()) {
         m_font_infos[m_font->getPath()] = FontInfo();
     }
 
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(m_font->getPath()));
-    arguments.push_back(Argument(m_font->getSize()));
-    arguments.push_back(Argument(m_font->getStyle()));
-    arguments.push_back(Argument(m_font->getFamily()));
-    m_calls.push_back(Call{ "setFont", arguments });
+    m_calls.push(
+        OpCode::SET_FONT,
+        m_calls.addString(m_font->getPath()), m_calls.addString(m_font->getFamily()),
+        { m_font->getSize(), (float)m_font->getStyle() }
+    );
 }
 float Graphics2D_abstract::getFontSize() const {
     return m_font->getSize();
 }
 void Graphics2D_abstract::setFontSize(float size) {
     m_font->setSize(size);
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(size));
-    m_calls.push_back(Call{ "setFontSize", arguments });
+    m_calls.push(OpCode::SET_FONT_SIZE, { size });
 }
 void Graphics2D_abstract::translate(float dx, float dy) {
-    std::vector<Argument> arguments;
-    m_dx = dx * m_sx;
-    m_dy = dy * m_sy;
-
-    arguments.push_back(Argument(dx));
-    arguments.push_back(Argument(dy));
-    m_calls.push_back(Call{ "translate", arguments });
+    m_dx += dx * m_sx;
+    m_dy += dy * m_sy;
+    m_calls.push(OpCode::TRANSLATE, { dx, dy });
 }
 void Graphics2D_abstract::scale(float sx, float sy) {
     m_sx *= sx;
     m_sy *= sy;
-
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(sx));
-    arguments.push_back(Argument(sy));
-    m_calls.push_back(Call{ "scale", arguments });
+    m_calls.push(OpCode::SCALE, { sx, sy });
 }
 void Graphics2D_abstract::rotate(float angle) {
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(angle));
-    m_calls.push_back(Call{ "rotate", arguments });
+    m_bounds_rotated = true;
+    m_calls.push(OpCode::ROTATE, { angle });
 }
 void Graphics2D_abstract::rotate(float angle, float px, float py) {
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(angle));
-    arguments.push_back(Argument(px));
-    arguments.push_back(Argument(py));
-    m_calls.push_back(Call{ "rotateAroundPt", arguments });
+    m_bounds_rotated = true;
+    m_calls.push(OpCode::ROTATE_AROUND_PT, { angle, px, py });
 }
 void Graphics2D_abstract::reset() {
-    std::vector<Argument> arguments;
     m_sx = 1.f;
     m_sy = 1.f;
     m_dx = 0.f;
     m_dy = 0.f;
-    m_calls.push_back(Call{ "reset", arguments });
+    m_calls.push(OpCode::RESET);
 }
 float Graphics2D_abstract::sx() const {
     return m_sx;
@@ -387,68 +343,39 @@ void Graphics2D_abstract::drawGlyph(u16 c, float x, float y) {
     // Convert to u8 string
     updateFontInfo(c);
 
-    float size = m_font->getSize();
-    pushMinMax(x, y);
-    pushMinMax(x + 0.5f * size, y + size);
+    pushTextMinMax(x, y, m_font->getSize());
 
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(c));
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    m_calls.push_back(Call{ "drawGlyph", arguments });
+    m_calls.push(OpCode::DRAW_GLYPH, (i32)c, 0, { x, y });
 }
 bool Graphics2D_abstract::beginPath(i32 id) {
-    std::vector<Argument> arguments;
     m_path_id = id;
-    arguments.push_back(Argument(id));
-    m_calls.push_back(Call{ "beginPath", arguments });
+    m_calls.push(OpCode::BEGIN_PATH, id, 0);
     return false;
 }
 void Graphics2D_abstract::moveTo(float x, float y) {
     pushMinMax(x, y);
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    m_calls.push_back(Call{ "moveTo", arguments });
+    m_calls.push(OpCode::MOVE_TO, { x, y });
 }
 void Graphics2D_abstract::lineTo(float x, float y) {
     pushMinMax(x, y);
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    m_calls.push_back(Call{ "lineTo", arguments });
+    m_calls.push(OpCode::LINE_TO, { x, y });
 }
 void Graphics2D_abstract::cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
     pushMinMax(x1, y1);
     pushMinMax(x2, y2);
     pushMinMax(x3, y3);
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(x1));
-    arguments.push_back(Argument(y1));
-    arguments.push_back(Argument(x2));
-    arguments.push_back(Argument(y2));
-    arguments.push_back(Argument(x3));
-    arguments.push_back(Argument(y3));
-    m_calls.push_back(Call{ "cubicTo", arguments });
+    m_calls.push(OpCode::CUBIC_TO, { x1, y1, x2, y2, x3, y3 });
 }
 void Graphics2D_abstract::quadTo(float x1, float y1, float x2, float y2) {
     pushMinMax(x1, y1);
     pushMinMax(x2, y2);
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(x1));
-    arguments.push_back(Argument(y1));
-    arguments.push_back(Argument(x2));
-    arguments.push_back(Argument(y2));
-    m_calls.push_back(Call{ "quadTo", arguments });
+    m_calls.push(OpCode::QUAD_TO, { x1, y1, x2, y2 });
 }
 void Graphics2D_abstract::closePath() {
-    std::vector<Argument> arguments;
-    m_calls.push_back(Call{ "closePath", arguments });
+    m_calls.push(OpCode::CLOSE_PATH);
 }
 void Graphics2D_abstract::fillPath(i32 id) {
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(m_path_id));
-    m_calls.push_back(Call{ "fillPath", arguments });
+    m_calls.push(OpCode::FILL_PATH, m_path_id, 0);
 }
 void Graphics2D_abstract::drawText(const std::string& t, float x, float y) {
     updateFontInfo(t);
@@ -460,67 +387,36 @@ void Graphics2D_abstract::drawText(const std::string& t, float x, float y) {
             count += ((p & 0xc0) != 0x80);
     }
 
-    float size = m_font->getSize();
-    pushMinMax(x, y);
-    pushMinMax(x + 0.5f * size * count, y + size);
+    pushTextMinMax(x, y, m_font->getSize() * count);
 
-    std::vector<Argument> arguments;
-    arguments.push_back(Argument(t));
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    m_calls.push_back(Call{ "drawText", arguments });
+    m_calls.push(OpCode::DRAW_TEXT, m_calls.addString(t), 0, { x, y });
 }
 void Graphics2D_abstract::drawLine(float x1, float y1, float x2, float y2) {
-    std::vector<Argument> arguments;
-    pushMinMax(x1, y1);
-    pushMinMax(x2, y2);
-    arguments.push_back(Argument(x1));
-    arguments.push_back(Argument(y1));
-    arguments.push_back(Argument(x2));
-    arguments.push_back(Argument(y2));
-    m_calls.push_back(Call{ "drawLine", arguments });
+    // Square caps can extend a line by half its width in every direction
+    float half_width = 0.5f * m_stroke.lineWidth;
+    pushMinMax(x1, y1, half_width);
+    pushMinMax(x2, y2, half_width);
+    m_calls.push(OpCode::DRAW_LINE, { x1, y1, x2, y2 });
 }
 void Graphics2D_abstract::drawRect(float x, float y, float w, float h) {
-    std::vector<Argument> arguments;
-    pushMinMax(x, y);
-    pushMinMax(x + w, y + h);
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    arguments.push_back(Argument(w));
-    arguments.push_back(Argument(h));
-    m_calls.push_back(Call{ "drawRect", arguments });
+    float half_width = 0.5f * m_stroke.lineWidth;
+    pushMinMax(x, y, half_width);
+    pushMinMax(x + w, y + h, half_width);
+    m_calls.push(OpCode::DRAW_RECT, { x, y, w, h });
 }
 void Graphics2D_abstract::fillRect(float x, float y, float w, float h) {
-    std::vector<Argument> arguments;
     pushMinMax(x, y);
     pushMinMax(x + w, y + h);
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    arguments.push_back(Argument(w));
-    arguments.push_back(Argument(h));
-    m_calls.push_back(Call{ "fillRect", arguments });
+    m_calls.push(OpCode::FILL_RECT, { x, y, w, h });
 }
 void Graphics2D_abstract::drawRoundRect(float x, float y, float w, float h, float rx, float ry) {
-    std::vector<Argument> arguments;
-    pushMinMax(x, y);
-    pushMinMax(x + w, y + h);
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    arguments.push_back(Argument(w));
-    arguments.push_back(Argument(h));
-    arguments.push_back(Argument(rx));
-    arguments.push_back(Argument(ry));
-    m_calls.push_back(Call{ "drawRoundRect", arguments });
+    float half_width = 0.5f * m_stroke.lineWidth;
+    pushMinMax(x, y, half_width);
+    pushMinMax(x + w, y + h, half_width);
+    m_calls.push(OpCode::DRAW_ROUND_RECT, { x, y, w, h, rx, ry });
 }
 void Graphics2D_abstract::fillRoundRect(float x, float y, float w, float h, float rx, float ry) {
-    std::vector<Argument> arguments;
     pushMinMax(x, y);
     pushMinMax(x + w, y + h);
-    arguments.push_back(Argument(x));
-    arguments.push_back(Argument(y));
-    arguments.push_back(Argument(w));
-    arguments.push_back(Argument(h));
-    arguments.push_back(Argument(rx));
-    arguments.push_back(Argument(ry));
-    m_calls.push_back(Call{ "fillRoundRect", arguments });
+    m_calls.push(OpCode::FILL_ROUND_RECT, { x, y, w, h, rx, ry });
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <set>
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
 
 #include <vector>
 
@@ -13,41 +17,10 @@
 #include "graphic/graphic.h"
 
 namespace microtex {
-    /**
-     * @brief Stores a function argument safely until retrieval
-     *
-     */
-    class MICROTEX_EXPORT Argument {
-    private:
-        std::shared_ptr<void> m_data;
-        bool is_empty = true;
-    public:
-        enum Type { FLOAT, FLOATV, STROKE, INT, STRING, COLOR, U16 };
-        Argument() {}
-        Argument(const std::string& data);
-        Argument(float data);
-        Argument(const std::vector<float>& data);
-        Argument(const Stroke& s);
-        Argument(int data);
-        Argument(color data);
-        Argument(u16 data);
-
-        bool isempty() { return is_empty; }
-
-        template<typename T>
-        auto getData() {
-            return *std::static_pointer_cast<T>(m_data);
-        }
-    };
-
-    struct Call {
-        std::string fct_name;
-        std::vector<Argument> arguments;
-    };
-
     class MICROTEX_EXPORT Font_abstract : public Font {
     private:
         static std::unordered_map<std::string, sptr<Font_abstract>> fonts_sptr;
+        static std::mutex fonts_mutex;
         std::string m_path;
         std::string m_family;
         int m_style;
@@ -67,8 +40,11 @@ namespace microtex {
 
         std::string getPath() const { return m_path; }
 
-        virtual bool operator==(const Font& f) const override; // Not implemented
+        virtual bool operator==(const Font& f) const override;
 
+        /**
+         * @brief Returns the (interned) font of the file, created on first use
+         */
         static sptr<Font_abstract> getOrCreate(const std::string& file);
 
         virtual ~Font_abstract() {};
@@ -293,6 +269,101 @@ namespace microtex {
         // endregion
     };
 
+    /**
+     * @brief Operation code of a recorded drawing call
+     */
+    enum class OpCode : u8 {
+        SET_COLOR,
+        SET_STROKE,
+        SET_STROKE_WIDTH,
+        SET_DASH,
+        SET_FONT,
+        SET_FONT_SIZE,
+        TRANSLATE,
+        SCALE,
+        ROTATE,
+        ROTATE_AROUND_PT,
+        RESET,
+        DRAW_GLYPH,
+        BEGIN_PATH,
+        MOVE_TO,
+        LINE_TO,
+        CUBIC_TO,
+        QUAD_TO,
+        CLOSE_PATH,
+        FILL_PATH,
+        DRAW_TEXT,
+        DRAW_LINE,
+        DRAW_RECT,
+        FILL_RECT,
+        DRAW_ROUND_RECT,
+        FILL_ROUND_RECT
+    };
+
+    /**
+     * @brief A recorded drawing call, plain old data
+     *
+     * Float arguments are stored in f (in call order), integer arguments in i:
+     * color, glyph, path id, stroke cap / join, font style or indices
+     * in the string / dash tables of the DisplayList
+     */
+    struct Command {
+        OpCode op;
+        i32 i[2];
+        float f[6];
+    };
+    static_assert(std::is_trivially_copyable<Command>::value, "Command must stay POD");
+
+    /**
+     * @brief Flat list of recorded drawing calls, replayed with a switch on the opcode
+     *
+     * Recording a call does not allocate (besides the amortized growth of the command
+     * buffer), strings and dash patterns are stored once in side tables.
+     */
+    class MICROTEX_EXPORT DisplayList {
+    private:
+        std::vector<Command> m_commands;
+        std::vector<std::string> m_strings;
+        std::unordered_map<std::string, i32> m_string_ids;
+        std::vector<std::vector<float>> m_dashes;
+    public:
+        inline void push(OpCode op, std::initializer_list<float> f = {}) {
+            push(op, 0, 0, f);
+        }
+        inline void push(OpCode op, i32 i0, i32 i1, std::initializer_list<float> f = {}) {
+            Command& command = m_commands.emplace_back();
+            command.op = op;
+            command.i[0] = i0;
+            command.i[1] = i1;
+            std::fill(std::copy(f.begin(), f.end(), command.f), command.f + 6, 0.f);
+        }
+
+        /**
+         * @brief Stores a string once, returns its index
+         */
+        i32 addString(const std::string& str);
+        i32 addDash(const std::vector<float>& dash);
+
+        const std::vector<Command>& commands() const { return m_commands; }
+        const std::string& string(i32 idx) const { return m_strings[idx]; }
+        const std::vector<float>& dash(i32 idx) const { return m_dashes[idx]; }
+
+        size_t size() const { return m_commands.size(); }
+        bool empty() const { return m_commands.empty(); }
+
+        /**
+         * @brief Approximate memory used by the list (in bytes)
+         */
+        size_t byteSize() const;
+
+        void clear();
+
+        /**
+         * @brief Replays all the recorded calls on the painter
+         */
+        void replay(Painter* painter) const;
+    };
+
     struct FontInfo {
         float max_real_size = 10.f;
         std::vector<u16> glyphs;
@@ -310,12 +381,10 @@ namespace microtex {
      */
     class MICROTEX_EXPORT Graphics2D_abstract : public Graphics2D {
     private:
-        static Font_abstract m_default_font;
-
         color m_color;
         Stroke m_stroke;
         std::vector<float> m_dash;
-        Font_abstract* m_font;
+        sptr<Font_abstract> m_font = nullptr;
 
         float m_sx = 1.f;
         float m_sy = 1.f;
@@ -326,16 +395,23 @@ namespace microtex {
         float m_max_x = -1e6;
         float m_min_y = 1e6;
         float m_max_y = -1e6;
+        bool m_bounds_exact = true; // false once text is drawn (estimated boxes)
+        bool m_bounds_rotated = false; // rotations are not tracked
 
         ImVec2 m_dimensions;
 
         FontInfos m_font_infos;
 
-        std::vector<Call> m_calls;
+        DisplayList m_calls;
 
         i32 m_path_id;
 
-        inline void pushMinMax(float x, float y);
+        /**
+         * @brief Extends the ink bounds with a point (in the current transformation),
+         * grown by margin in every direction
+         */
+        inline void pushMinMax(float x, float y, float margin = 0.f);
+        void pushTextMinMax(float x, float y, float advance);
 
         void updateFontInfo(const std::string& text);
         void updateFontInfo(u32 c);
@@ -347,12 +423,25 @@ namespace microtex {
         ImVec2 getScaledMin();
         ImVec2 getScaledMax();
 
+        /**
+         * @brief Bounds of everything drawn so far (in MicroTeX units, from the origin of the draw)
+         * Paths are bounded by their control points, text by an estimated box
+         *
+         * @return false if nothing was drawn or if the bounds are unknown (rotations)
+         */
+        bool getInkBounds(ImVec2& min_pos, ImVec2& max_pos) const;
+
+        /**
+         * @return false if the ink bounds contain estimated (text) boxes
+         */
+        bool areInkBoundsExact() const { return m_bounds_exact; }
+
         /**
          * @brief Get the (functions) call list
          * Must be called after render->draw(graphics_abstract, ...) has been called
-         * @return std::vector<Call> list of all draw calls
+         * @return const DisplayList& list of all draw calls
          */
-        std::vector<Call> getCallList();
+        const DisplayList& getCallList() const { return m_calls; }
 
         /**
          * @brief Returns information on all the fonts used, with the max size and the glyphs used
@@ -0,0 +1,334 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#include "core/png_writer.h"
+
+namespace Batch {
+    using Clock = std::chrono::steady_clock;
+
+    static double elapsed_ms(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    static const char* usage =
+        "Usage: quicktex-batch <formulas.txt> [options]\n"
+        "  -o, --output <dir>      output directory for the images (default: batch_output)\n"
+        "  -j, --threads <n>       number of worker threads (default: all cores)\n"
+        "  -s, --size <pt>         font size (default: 50)\n"
+        "  -f, --font <family>     font family (Latin Modern, XITS, Fira Math, Gyre DejaVu)\n"
+        "  -c, --color <#AARRGGBB> text color (default: #FF000000)\n"
+        "  -p, --padding <px>      inner padding around the formula (default: 0)\n"
+        "  -x, --scales <list>     comma separated output scales, e.g. 1,2,3 (default: 1)\n"
+        "                          scales other than 1 are written as <name>@<scale>x.png\n"
+        "  -F, --format <fmt>      png, svg or pdf (default: png); vectors use the first scale only\n"
+        "  -z, --compression <n>   PNG compression level, 0 (fastest) to 9 (smallest) (default: 6)\n"
+        "  -m, --metrics <file>    metrics file (default: <output>/metrics.csv)\n"
+        "  -t, --timings <file>    write the p50 / p95 / p99 latency of each render stage (CSV)\n"
+        "  -T, --trace <file>      write the render stages as a Chrome trace (chrome://tracing)\n"
+        "  -i, --inline            render formulas in inline mode\n"
+        "  -g, --glyphs            draw glyphs with the font engine instead of outlines\n";
+
+    bool parseArguments(int argc, char** argv, Config& config, std::string& err) {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        try {
+            for (size_t i = 0;i < args.size();i++) {
+                const std::string& arg = args[i];
+                auto next = [&]() -> const std::string& {
+                    if (i + 1 >= args.size())
+                        throw std::invalid_argument("missing value for " + arg);
+                    return args[++i];
+                    };
+                if (arg == "-h" || arg == "--help") {
+                    err = usage;
+                    return false;
+                }
+                else if (arg == "-o" || arg == "--output") {
+                    config.output_dir = next();
+                }
+                else if (arg == "-j" || arg == "--threads") {
+                    config.threads = std::stoi(next());
+                }
+                else if (arg == "-s" || arg == "--size") {
+                    config.font_size = std::stof(next());
+                }
+                else if (arg == "-f" || arg == "--font") {
+                    config.font_family = next();
+                }
+                else if (arg == "-c" || arg == "--color") {
+                    std::string color = next();
+                    if (!color.empty() && color[0] == '#')
+                        color = color.substr(1);
+                    if (color.size() == 6)
+                        color = "FF" + color;
+                    if (color.size() != 8)
+                        throw std::invalid_argument("invalid color " + color);
+                    config.text_color = (microtex::color)std::stoul(color, nullptr, 16);
+                }
+                else if (arg == "-p" || arg == "--padding") {
+                    float padding = std::stof(next());
+                    config.inner_padding = ImVec2(padding, padding);
+                }
+                else if (arg == "-x" || arg == "--scales") {
+                    std::stringstream list(next());
+                    std::string scale;
+                    config.scales.clear();
+                    while (std::getline(list, scale, ',')) {
+                        float value = std::stof(scale);
+                        if (value <= 0.f)
+                            throw std::invalid_argument("invalid scale " + scale);
+                        config.scales.push_back(value);
+                    }
+                    if (config.scales.empty())
+                        throw std::invalid_argument("no scale given");
+                }
+                else if (arg == "-F" || arg == "--format") {
+                    std::string format = next();
+                    std::transform(format.begin(), format.end(), format.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+                    if (format == "png")
+                        config.format = FORMAT_PNG;
+                    else if (format == "svg")
+                        config.format = FORMAT_SVG;
+                    else if (format == "pdf")
+                        config.format = FORMAT_PDF;
+                    else
+                        throw std::invalid_argument("invalid format " + format);
+                }
+                else if (arg == "-z" || arg == "--compression") {
+                    config.png_compression = std::stoi(next());
+                    if (config.png_compression < 0 || config.png_compression > 9)
+                        throw std::invalid_argument("invalid compression level " + std::to_string(config.png_compression));
+                }
+                else if (arg == "-m" || arg == "--metrics") {
+                    config.metrics_path = next();
+                }
+                else if (arg == "-t" || arg == "--timings") {
+                    config.timings_path = next();
+                }
+                else if (arg == "-T" || arg == "--trace") {
+                    config.trace_path = next();
+                }
+                else if (arg == "-i" || arg == "--inline") {
+                    config.is_inline = true;
+                }
+                else if (arg == "-g" || arg == "--glyphs") {
+                    config.render_glyphs = true;
+                }
+                else if (config.input_path.empty() && arg[0] != '-') {
+                    config.input_path = arg;
+                }
+                else {
+                    throw std::invalid_argument("unknown argument " + arg);
+                }
+            }
+        }
+        catch (std::exception& e) {
+            err = std::string(e.what()) + "\n" + usage;
+            return false;
+        }
+        if (config.input_path.empty()) {
+            err = usage;
+            return false;
+        }
+        if (config.metrics_path.empty())
+            config.metrics_path = (std::filesystem::path(config.output_dir) / "metrics.csv").string();
+        if (config.threads <= 0)
+            config.threads = std::max(1u, std::thread::hardware_concurrency());
+        return true;
+    }
+
+    std::vector<std::string> readFormulas(const std::string& path) {
+        std::vector<std::string> formulas;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                formulas.push_back(line);
+        }
+        return formulas;
+    }
+
+    static std::string output_name(size_t index, float scale, const char* extension = "png") {
+        std::ostringstream name;
+        name << std::setw(5) << std::setfill('0') << index;
+        if (scale != 1.f)
+            name << "@" << std::defaultfloat << scale << "x";
+        name << "." << extension;
+        return name.str();
+    }
+
+    static void write_vector_formula(const Config& config, const std::string& latex, FormulaMetrics& metrics) {
+        auto format = config.format == FORMAT_PDF ? microtex::Cairo_Vector_Painter::PDF : microtex::Cairo_Vector_Painter::SVG;
+        float scale = config.scales.front();
+
+        // Nothing is rasterized: the parse is written directly
+        auto start = Clock::now();
+        Latex::ParsedLatex parsed(latex, config.font_size, 7.f, config.text_color);
+        if (!parsed.getLatexErrorMsg().empty()) {
+            metrics.render_ms = elapsed_ms(start);
+            metrics.error = parsed.getLatexErrorMsg();
+            return;
+        }
+        std::string document = parsed.toVector(format, scale, config.inner_padding, config.text_color);
+        metrics.render_ms = elapsed_ms(start);
+        metrics.width = (int)std::ceil(scale * parsed.getWidth());
+        metrics.height = (int)std::ceil(scale * parsed.getHeight());
+        if (document.empty()) {
+            metrics.error = "empty document";
+            return;
+        }
+
+        start = Clock::now();
+        auto path = std::filesystem::path(config.output_dir) / output_name(metrics.index, scale, microtex::Cairo_Vector_Painter::getExtension(format));
+        std::ofstream file(path, std::ios::binary);
+        if (!file.write(document.data(), document.size())) {
+            metrics.error = "could not write " + path.string();
+            return;
+        }
+        metrics.output_bytes = document.size();
+        metrics.write_ms = elapsed_ms(start);
+        metrics.success = true;
+    }
+
+    static void render_formula(const Config& config, const std::string& src, FormulaMetrics& metrics) {
+        std::string latex = src;
+        if (!config.is_inline)
+            latex = "\\[" + src + "\\]";
+        if (config.format != FORMAT_PNG)
+            return write_vector_formula(config, latex, metrics);
+
+        // LatexImage only produces CPU pixels, no GL context is needed
+        // The formula is parsed once, the other scales only rasterize it again
+        // Single color formulas are rasterized as coverage only, colored when converted
+        auto start = Clock::now();
+        float first_scale = config.scales.front();
+        std::vector<std::unique_ptr<Latex::LatexImage>> outputs;
+        outputs.push_back(std::make_unique<Latex::LatexImage>(latex, config.font_size, 7.f, config.text_color, ImVec2(first_scale, first_scale), config.inner_padding, nullptr, PixelBuffer::A8));
+        auto& image = *outputs.front();
+        if (!image.getLatexErrorMsg().empty()) {
+            metrics.render_ms = elapsed_ms(start);
+            metrics.error = image.getLatexErrorMsg();
+            return;
+        }
+        for (size_t i = 1;i < config.scales.size();i++) {
+            float scale = config.scales[i];
+            outputs.push_back(std::make_unique<Latex::LatexImage>(image.getParsed(), ImVec2(scale, scale), config.inner_padding, config.text_color, PixelBuffer::A8));
+        }
+        metrics.render_ms = elapsed_ms(start);
+
+        ImVec2 dimensions = outputs.front()->getDimensions();
+        metrics.width = (int)dimensions.x;
+        metrics.height = (int)dimensions.y;
+
+        // Formulas are already encoded in parallel, each one on a single thread
+        PngWriter::Options png_options;
+        png_options.level = config.png_compression;
+        png_options.threads = 1;
+
+        // Tiled (very large) formulas are rasterized while being written
+        start = Clock::now();
+        for (size_t i = 0;i < outputs.size();i++) {
+            ImVec2 size = outputs[i]->getDimensions();
+            if (size.x <= 0.f || size.y <= 0.f) {
+                metrics.error = "empty image";
+                return;
+            }
+            auto path = std::filesystem::path(config.output_dir) / output_name(metrics.index, config.scales[i]);
+            if (!outputs[i]->savePNG(path.string(), png_options)) {
+                metrics.error = "could not write " + path.string();
+                return;
+            }
+            metrics.output_bytes += std::filesystem::file_size(path);
+        }
+        metrics.write_ms = elapsed_ms(start);
+        metrics.success = true;
+    }
+
+    Summary run(const Config& config, const std::vector<std::string>& formulas, std::vector<FormulaMetrics>& metrics) {
+        Summary summary;
+        summary.count = formulas.size();
+        summary.threads = std::max(1, config.threads);
+
+        std::filesystem::create_directories(config.output_dir);
+        std::string font_err = Latex::setDefaultFontFamily(config.font_family);
+        if (!font_err.empty())
+            std::cerr << "Could not load font family " << config.font_family << ": " << font_err << std::endl;
+        Latex::setRenderGlyphs(config.render_glyphs);
+
+        metrics.assign(formulas.size(), FormulaMetrics());
+        std::atomic<size_t> next_formula = 0;
+
+        auto start = Clock::now();
+        auto worker = [&]() {
+            for (size_t i = next_formula++;i < formulas.size();i = next_formula++) {
+                metrics[i].index = i;
+                render_formula(config, formulas[i], metrics[i]);
+            }
+            };
+        std::vector<std::thread> threads;
+        for (int i = 0;i < summary.threads;i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        summary.wall_seconds = elapsed_ms(start) / 1000.;
+
+        for (const auto& metric : metrics) {
+            if (!metric.success)
+                summary.failures++;
+        }
+        if (summary.wall_seconds > 0.)
+            summary.formulas_per_second = summary.count / summary.wall_seconds;
+        return summary;
+    }
+
+    static std::string escape_csv(const std::string& str) {
+        std::string out = "\"";
+        for (auto c : str) {
+            if (c == '"')
+                out += '"';
+            if (c == '\n' || c == '\r')
+                c = ' ';
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    bool writeMetrics(const std::string& path, const std::vector<FormulaMetrics>& metrics, const Summary& summary) {
+        std::ofstream file(path);
+        if (!file.is_open())
+            return false;
+        file << "index,success,width,height,render_ms,write_ms,output_bytes,error\n";
+        file << std::fixed << std::setprecision(3);
+        for (const auto& metric : metrics) {
+            file << metric.index << ","
+                << metric.success << ","
+                << metric.width << ","
+                << metric.height << ","
+                << metric.render_ms << ","
+                << metric.write_ms << ","
+                << metric.output_bytes << ","
+                << escape_csv(metric.error) << "\n";
+        }
+        file << "# formulas: " << summary.count << "\n";
+        file << "# failures: " << summary.failures << "\n";
+        file << "# threads: " << summary.threads << "\n";
+        file << "# wall_seconds: " << summary.wall_seconds << "\n";
+        file << "# formulas_per_second: " << summary.formulas_per_second << "\n";
+        return true;
+    }
+}
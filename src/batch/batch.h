@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "latex/latex.h"
+
+namespace Batch {
+    enum OutputFormat { FORMAT_PNG, FORMAT_SVG, FORMAT_PDF };
+
+    /**
+     * @brief Parameters of a headless batch render
+     */
+    struct Config {
+        std::string input_path;
+        std::string output_dir = "batch_output";
+        std::string metrics_path = "";
+        std::string timings_path = ""; // per stage latencies (CSV), not written if empty
+        std::string trace_path = ""; // Chrome trace of the stages, not written if empty
+        int threads = 0; // 0 -> number of hardware threads
+        float font_size = 50.f;
+        std::string font_family = "XITS";
+        bool is_inline = false;
+        bool render_glyphs = false; // draw glyphs with the font engine instead of outlines
+        microtex::color text_color = microtex::BLACK;
+        ImVec2 inner_padding = ImVec2(0.f, 0.f);
+        // Each formula is parsed once and rasterized at every scale (e.g. 1x, 2x, 3x)
+        std::vector<float> scales = { 1.f };
+        // SVG and PDF are written once, at the first scale
+        OutputFormat format = FORMAT_PNG;
+        int png_compression = 6; // zlib level (0 - 9)
+    };
+
+    /**
+     * @brief Measurements for a single formula of the batch
+     */
+    struct FormulaMetrics {
+        size_t index = 0;
+        bool success = false;
+        std::string error;
+        int width = 0; // of the first scale (layout box for vector formats)
+        int height = 0;
+        double render_ms = 0.; // parse + rasterization (of all the scales)
+        double write_ms = 0.;
+        size_t output_bytes = 0; // sum over all the scales
+    };
+
+    struct Summary {
+        size_t count = 0;
+        size_t failures = 0;
+        int threads = 0;
+        double wall_seconds = 0.;
+        double formulas_per_second = 0.;
+    };
+
+    /**
+     * @brief Parses the command line of quicktex-batch
+     *
+     * @param err filled with an error message (or the usage) if parsing failed
+     * @return true if the config is valid
+     */
+    bool parseArguments(int argc, char** argv, Config& config, std::string& err);
+
+    /**
+     * @brief Reads a formula list, one formula per line (empty lines are skipped)
+     */
+    std::vector<std::string> readFormulas(const std::string& path);
+
+    /**
+     * @brief Renders all the formulas to PNG (or SVG / PDF) files in config.output_dir,
+     * distributing the work on config.threads worker threads
+     *
+     * Latex::init must have been called before.
+     *
+     * @param formulas list of latex sources
+     * @param metrics filled with one entry per formula (in the same order)
+     * @return Summary
+     */
+    Summary run(const Config& config, const std::vector<std::string>& formulas, std::vector<FormulaMetrics>& metrics);
+
+    /**
+     * @brief Writes the per formula metrics as CSV, followed by the summary as comments
+     *
+     * @return true if the file could be written
+     */
+    bool writeMetrics(const std::string& path, const std::vector<FormulaMetrics>& metrics, const Summary& summary);
+}
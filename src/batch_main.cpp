@@ -0,0 +1,65 @@
+#include <iostream>
+#include <filesystem>
+#include <string>
+
+#include "latex/latex.h"
+#include "batch/batch.h"
+#include "core/stage_profiler.h"
+#include "system/sys_util.h"
+
+int main(int argc, char** argv) {
+    Batch::Config config;
+    std::string err;
+    if (!Batch::parseArguments(argc, argv, config, err)) {
+        std::cerr << err;
+        return 1;
+    }
+
+    // Paths given by the user are relative to the working directory,
+    // but the fonts are relative to the executable
+    config.input_path = std::filesystem::absolute(config.input_path).string();
+    config.output_dir = std::filesystem::absolute(config.output_dir).string();
+    config.metrics_path = std::filesystem::absolute(config.metrics_path).string();
+    if (!config.timings_path.empty())
+        config.timings_path = std::filesystem::absolute(config.timings_path).string();
+    if (!config.trace_path.empty())
+        config.trace_path = std::filesystem::absolute(config.trace_path).string();
+    std::filesystem::current_path(getExecutablePath());
+
+    auto formulas = Batch::readFormulas(config.input_path);
+    if (formulas.empty()) {
+        std::cerr << "No formula found in " << config.input_path << std::endl;
+        return 1;
+    }
+
+    err = Latex::init();
+    if (!err.empty()) {
+        std::cerr << "Could not initialize latex: " << err << std::endl;
+        return 1;
+    }
+
+    std::vector<Batch::FormulaMetrics> metrics;
+    auto summary = Batch::run(config, formulas, metrics);
+    if (!Batch::writeMetrics(config.metrics_path, metrics, summary))
+        std::cerr << "Could not write metrics to " << config.metrics_path << std::endl;
+
+    std::cout << summary.count << " formulas (" << summary.failures << " failed) rendered in "
+        << summary.wall_seconds << " s on " << summary.threads << " threads: "
+        << summary.formulas_per_second << " formulas/s" << std::endl;
+
+    auto& profiler = StageProfiler::getInstance();
+    for (int i = 0;i < StageProfiler::STAGE_COUNT;i++) {
+        auto stats = profiler.getStats((StageProfiler::Stage)i);
+        if (stats.count == 0)
+            continue;
+        std::cout << "  " << StageProfiler::getStageName((StageProfiler::Stage)i) << ": " << stats.count << " x, p50 "
+            << stats.p50_ms << " ms, p95 " << stats.p95_ms << " ms, p99 " << stats.p99_ms << " ms" << std::endl;
+    }
+    if (!config.timings_path.empty() && !profiler.writeCSV(config.timings_path))
+        std::cerr << "Could not write timings to " << config.timings_path << std::endl;
+    if (!config.trace_path.empty() && !profiler.writeChromeTrace(config.trace_path))
+        std::cerr << "Could not write trace to " << config.trace_path << std::endl;
+
+    Latex::release();
+    return summary.failures == 0 ? 0 : 2;
+}
@@ -0,0 +1,64 @@
+#include "bench.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Bench {
+    std::map<std::string, Benchmark>& getBenchmarks() {
+        static std::map<std::string, Benchmark> benchmarks = {
+            { "display_list", displayListBenchmark },
+            { "glyph_cache", glyphCacheBenchmark },
+            { "surface_pool", surfacePoolBenchmark },
+            { "pixel_convert", pixelConvertBenchmark },
+            { "png_writer", pngWriterBenchmark },
+            { "coverage", coverageBenchmark },
+            { "parallel_raster", parallelRasterBenchmark },
+            { "incremental", incrementalBenchmark },
+            { "draft", draftBenchmark },
+            { "end_to_end", endToEndBenchmark },
+            { "cold_start", coldStartBenchmark },
+        };
+        return benchmarks;
+    }
+
+    microtex::Render* parse(const std::string& latex, float font_size) {
+        using namespace microtex;
+        try {
+            std::string math_font = Latex::getMathFontFamily();
+            std::lock_guard<std::mutex> lock(Latex::getMicroTeXMutex());
+            Latex::loadMathFont(math_font);
+            return MicroTeX::parse(
+                "\\[" + latex + "\\]",
+                0, font_size, 7.f, BLACK,
+                true,
+                OverrideTeXStyle(false, TexStyle::display),
+                math_font
+            );
+        }
+        catch (std::exception&) {
+            return nullptr;
+        }
+    }
+
+    size_t getPeakRSS() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+            return 0;
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss; // bytes
+#else
+        return (size_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+#endif
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "latex/latex.h"
+
+namespace Bench {
+    using Clock = std::chrono::steady_clock;
+
+    inline double elapsedMs(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    struct Options {
+        std::string corpus_path = "data/formula.txt";
+        int iterations = 5;
+        float font_size = 50.f;
+        std::string output_path = ""; // results of the end to end benchmark (JSON), not written if empty
+        std::string baseline_path = ""; // previous results to compare against, if not empty
+        double tolerance = 0.1; // relative increase reported as a regression
+    };
+
+    using Benchmark = std::function<int(const std::vector<std::string>& corpus, const Options& options)>;
+
+    /**
+     * @brief Returns all the registered benchmarks (name -> function)
+     */
+    std::map<std::string, Benchmark>& getBenchmarks();
+
+    /**
+     * @brief Parses a formula (in display mode) with MicroTeX
+     *
+     * @return nullptr if the formula could not be parsed, must be deleted otherwise
+     */
+    microtex::Render* parse(const std::string& latex, float font_size);
+
+    /**
+     * @brief Peak resident set size of the process so far, in bytes (0 if unknown)
+     */
+    size_t getPeakRSS();
+
+    /**
+     * @brief Painter that ignores every call, to measure the pure dispatch cost
+     */
+    class NullPainter : public microtex::Painter {
+    public:
+        void setColor(microtex::color) override {}
+        void setStroke(const microtex::Stroke&) override {}
+        void setStrokeWidth(float) override {}
+        void setDash(const std::vector<float>&) override {}
+        void setFont(const std::string&, float, int, const std::string&) override {}
+        void setFontSize(float) override {}
+        void translate(float, float) override {}
+        void scale(float, float) override {}
+        void rotate(float) override {}
+        void rotate(float, float, float) override {}
+        void reset() override {}
+        void drawGlyph(microtex::u16, float, float) override {}
+        void beginPath(microtex::i32) override {}
+        void moveTo(float, float) override {}
+        void lineTo(float, float) override {}
+        void cubicTo(float, float, float, float, float, float) override {}
+        void quadTo(float, float, float, float) override {}
+        void closePath() override {}
+        void fillPath(microtex::i32) override {}
+        void drawLine(float, float, float, float) override {}
+        void drawRect(float, float, float, float) override {}
+        void fillRect(float, float, float, float) override {}
+        void drawRoundRect(float, float, float, float, float, float) override {}
+        void fillRoundRect(float, float, float, float, float, float) override {}
+        void start(ImVec2, ImVec2, ImVec2) override {}
+        void finish() override {}
+    };
+
+    int displayListBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int glyphCacheBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int surfacePoolBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int pixelConvertBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int pngWriterBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int coverageBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int parallelRasterBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int incrementalBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int draftBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int endToEndBenchmark(const std::vector<std::string>& corpus, const Options& options);
+    int coldStartBenchmark(const std::vector<std::string>& corpus, const Options& options);
+}
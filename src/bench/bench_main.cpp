@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "batch/batch.h"
+#include "system/sys_util.h"
+
+int main(int argc, char** argv) {
+    Bench::Options options;
+    std::vector<std::string> selected;
+    for (int i = 1;i < argc;i++) {
+        std::string arg = argv[i];
+        if ((arg == "--corpus" || arg == "-c") && i + 1 < argc) {
+            options.corpus_path = std::filesystem::absolute(argv[++i]).string();
+        }
+        else if ((arg == "--iterations" || arg == "-n") && i + 1 < argc) {
+            options.iterations = std::max(1, std::stoi(argv[++i]));
+        }
+        else if ((arg == "--size" || arg == "-s") && i + 1 < argc) {
+            options.font_size = std::stof(argv[++i]);
+        }
+        else if ((arg == "--json" || arg == "-o") && i + 1 < argc) {
+            options.output_path = std::filesystem::absolute(argv[++i]).string();
+        }
+        else if ((arg == "--baseline" || arg == "-b") && i + 1 < argc) {
+            options.baseline_path = std::filesystem::absolute(argv[++i]).string();
+        }
+        else if ((arg == "--tolerance" || arg == "-t") && i + 1 < argc) {
+            options.tolerance = std::max(0., std::stod(argv[++i]));
+        }
+        else if (arg == "--help" || arg == "-h") {
+            std::cout << "Usage: quicktex_bench [benchmark...] [--corpus file] [--iterations n] [--size pt]\n"
+                "                      [--json results.json] [--baseline previous.json] [--tolerance 0.1]\n"
+                "end_to_end writes its results with --json and fails if it is slower or larger than\n"
+                "the baseline by more than the tolerance\nBenchmarks:";
+            for (auto& pair : Bench::getBenchmarks())
+                std::cout << " " << pair.first;
+            std::cout << std::endl;
+            return 0;
+        }
+        else {
+            selected.push_back(arg);
+        }
+    }
+
+    std::filesystem::current_path(getExecutablePath());
+    std::string err = Latex::init();
+    if (!err.empty()) {
+        std::cerr << "Could not initialize latex: " << err << std::endl;
+        return 1;
+    }
+
+    auto corpus = Batch::readFormulas(options.corpus_path);
+    if (corpus.empty()) {
+        std::cerr << "Empty corpus: " << options.corpus_path << std::endl;
+        return 1;
+    }
+
+    auto& benchmarks = Bench::getBenchmarks();
+    if (selected.empty()) {
+        for (auto& pair : benchmarks)
+            selected.push_back(pair.first);
+    }
+    int result = 0;
+    for (auto& name : selected) {
+        auto it = benchmarks.find(name);
+        if (it == benchmarks.end()) {
+            std::cerr << "Unknown benchmark " << name << std::endl;
+            result = 1;
+            continue;
+        }
+        result |= it->second(corpus, options);
+    }
+    Latex::release();
+    return result;
+}
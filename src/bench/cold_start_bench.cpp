@@ -0,0 +1,83 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace Bench {
+    /**
+     * Renders a formula to A8, the first render of the app after Latex::init
+     *
+     * @return false if it failed
+     */
+    static bool first_render(const std::string& latex, float font_size) {
+        Latex::ParsedLatex parsed("\\[" + latex + "\\]", font_size);
+        if (!parsed.getLatexErrorMsg().empty())
+            return false;
+        return !parsed.rasterize(ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8).empty();
+    }
+
+    /**
+     * Loads every font family now, as init did before the fonts were loaded lazily
+     */
+    static bool load_all_families() {
+        for (auto& family : Latex::getFontFamilies()) {
+            if (!Latex::setDefaultFontFamily(family).empty())
+                return false;
+            try {
+                std::lock_guard<std::mutex> lock(Latex::getMicroTeXMutex());
+                Latex::loadMathFont(Latex::getMathFontFamily());
+            }
+            catch (std::exception&) {
+                return false;
+            }
+        }
+        // Default of Latex::init()
+        return Latex::setDefaultFontFamily("XITS").empty();
+    }
+
+    /**
+     * Time from Latex::init to the first formula rendered, with the fonts loaded on first
+     * use against all of them loaded by init. The font files stay in the page cache between
+     * iterations: this measures the loading by MicroTeX, not the disk.
+     */
+    int coldStartBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        const std::string& latex = corpus.front();
+        int ret = 0;
+        for (bool eager : { true, false }) {
+            std::vector<double> init_ms, render_ms;
+            for (int it = 0;it < options.iterations;it++) {
+                Latex::release();
+                auto start = Clock::now();
+                std::string err = Latex::init();
+                if (err.empty() && eager && !load_all_families())
+                    err = "could not load the font families";
+                init_ms.push_back(elapsedMs(start));
+                if (!err.empty()) {
+                    printf("cold_start: %s\n", err.c_str());
+                    ret = 1;
+                    break;
+                }
+                start = Clock::now();
+                if (!first_render(latex, options.font_size)) {
+                    printf("cold_start: the first formula of the corpus could not be rendered\n");
+                    ret = 1;
+                    break;
+                }
+                render_ms.push_back(elapsedMs(start));
+            }
+            if (render_ms.empty())
+                continue;
+            std::sort(init_ms.begin(), init_ms.end());
+            std::sort(render_ms.begin(), render_ms.end());
+            double init_median = init_ms[init_ms.size() / 2];
+            double render_median = render_ms[render_ms.size() / 2];
+            printf("cold_start: %-5s init %9.3f ms  first render %9.3f ms  total %9.3f ms (median of %zu)\n",
+                eager ? "eager" : "lazy", init_median, render_median, init_median + render_median, render_ms.size());
+        }
+        // Leaves the fonts as the other benchmarks expect them
+        Latex::release();
+        if (!Latex::init().empty())
+            ret = 1;
+        return ret;
+    }
+}
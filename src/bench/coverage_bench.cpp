@@ -0,0 +1,61 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+
+#include "core/pixel_convert.h"
+
+namespace Bench {
+    /**
+     * Rasterizes the corpus as premultiplied ARGB and as A8 coverage, then converts
+     * both to RGBA (as done when exporting)
+     */
+    int coverageBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        std::vector<std::shared_ptr<const Latex::ParsedLatex>> parses;
+        for (auto& latex : corpus) {
+            auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + latex + "\\]", options.font_size);
+            if (parsed->getLatexErrorMsg().empty())
+                parses.push_back(parsed);
+        }
+
+        printf("coverage: %zu formulas\n", parses.size());
+        double argb_ms = 0.;
+        for (auto format : { PixelBuffer::ARGB32_PREMULTIPLIED, PixelBuffer::A8 }) {
+            std::vector<PixelBuffer> outputs;
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                outputs.clear();
+                for (auto& parsed : parses) {
+                    outputs.push_back(parsed->rasterize(ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK, format));
+                }
+            }
+            double raster_ms = elapsedMs(start) / options.iterations;
+
+            size_t bytes = 0;
+            size_t fallbacks = 0;
+            for (auto& pixels : outputs) {
+                bytes += (size_t)pixels.stride * pixels.height;
+                if (pixels.format != format)
+                    fallbacks++;
+            }
+
+            start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                for (auto& pixels : outputs) {
+                    PixelConvert::toRGBA(pixels);
+                }
+            }
+            double convert_ms = elapsedMs(start) / options.iterations;
+
+            if (format == PixelBuffer::ARGB32_PREMULTIPLIED)
+                argb_ms = raster_ms;
+            printf("  %-6s rasterize %10.3f ms  (x%.2f)  to RGBA %8.3f ms  %8.1f KB",
+                format == PixelBuffer::A8 ? "A8" : "ARGB", raster_ms, raster_ms > 0. ? argb_ms / raster_ms : 0.,
+                convert_ms, bytes / 1024.);
+            if (format == PixelBuffer::A8)
+                printf("  (%zu multicolored, kept as ARGB)", fallbacks);
+            printf("\n");
+        }
+        return 0;
+    }
+}
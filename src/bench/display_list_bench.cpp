@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#include <cmath>
+#include <cstdio>
+
+namespace Bench {
+    /**
+     * Measures the cost of recording the draw calls of the corpus into a
+     * Graphics2D_abstract, and of replaying them (dispatch only, and into Cairo)
+     */
+    int displayListBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        std::vector<microtex::Render*> renders;
+        for (auto& latex : corpus) {
+            auto render = parse(latex, options.font_size);
+            if (render != nullptr)
+                renders.push_back(render);
+        }
+
+        size_t commands = 0;
+        size_t bytes = 0;
+        double record_ms = 0.;
+        double replay_ms = 0.;
+        double raster_ms = 0.;
+        NullPainter null_painter;
+        microtex::Cairo_Painter cairo_painter;
+        for (int it = 0;it < options.iterations;it++) {
+            for (auto render : renders) {
+                microtex::Graphics2D_abstract graphics;
+                auto start = Clock::now();
+                render->draw(graphics, 0.f, 0.f);
+                record_ms += elapsedMs(start);
+
+                start = Clock::now();
+                graphics.distributeCallList(&null_painter);
+                replay_ms += elapsedMs(start);
+
+                start = Clock::now();
+                cairo_painter.start(ImVec2(ceil(render->getWidth()), ceil(render->getHeight())), ImVec2(1.f, 1.f), ImVec2(0.f, 0.f));
+                graphics.distributeCallList(&cairo_painter);
+                cairo_painter.finish();
+                raster_ms += elapsedMs(start);
+
+                if (it == 0) {
+                    commands += graphics.getCallList().size();
+                    bytes += graphics.getCallList().byteSize();
+                }
+            }
+        }
+        for (auto render : renders) {
+            delete render;
+        }
+
+        double total_commands = (double)commands * options.iterations;
+        printf("display_list: %zu formulas, %zu commands, %.1f KB recorded\n", renders.size(), commands, bytes / 1024.);
+        printf("  record          %10.3f ms  (%.1f ns/command)\n", record_ms / options.iterations, 1e6 * record_ms / total_commands);
+        printf("  replay (null)   %10.3f ms  (%.1f ns/command)\n", replay_ms / options.iterations, 1e6 * replay_ms / total_commands);
+        printf("  replay (cairo)  %10.3f ms  (%.1f ns/command)\n", raster_ms / options.iterations, 1e6 * raster_ms / total_commands);
+        return 0;
+    }
+}
@@ -0,0 +1,49 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+
+namespace Bench {
+    /**
+     * Time until something is shown for the largest formulas of the corpus:
+     * final raster against a draft (reduced scale, no antialiasing)
+     */
+    int draftBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        std::vector<std::string> largest = corpus;
+        std::sort(largest.begin(), largest.end(), [](const std::string& a, const std::string& b) { return a.size() > b.size(); });
+        largest.resize(std::min<size_t>(largest.size(), 5));
+
+        const float draft_scale = Latex::LatexImage::draft_scale;
+        for (float scale : { 1.f, 3.f }) {
+            double final_ms = 0., draft_ms = 0.;
+            size_t final_pixels = 0, draft_pixels = 0;
+            for (const auto& latex : largest) {
+                auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + latex + "\\]", options.font_size);
+                if (!parsed->getLatexErrorMsg().empty())
+                    continue;
+                // Warms up the glyph caches of both qualities
+                parsed->rasterize(ImVec2(scale, scale), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8);
+                parsed->rasterize(ImVec2(draft_scale * scale, draft_scale * scale), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8, Latex::Quality::DRAFT);
+
+                auto start = Clock::now();
+                for (int it = 0;it < options.iterations;it++) {
+                    auto pixels = parsed->rasterize(ImVec2(scale, scale), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8);
+                    final_pixels += (size_t)pixels.width * pixels.height;
+                }
+                final_ms += elapsedMs(start);
+                start = Clock::now();
+                for (int it = 0;it < options.iterations;it++) {
+                    auto pixels = parsed->rasterize(ImVec2(draft_scale * scale, draft_scale * scale), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8, Latex::Quality::DRAFT);
+                    draft_pixels += (size_t)pixels.width * pixels.height;
+                }
+                draft_ms += elapsedMs(start);
+            }
+            const double runs = (double)options.iterations * largest.size();
+            printf("draft: x%.0f  final %9.3f ms (%8.0f px)  draft %9.3f ms (%8.0f px)  (x%.2f)\n",
+                scale, final_ms / runs, final_pixels / runs, draft_ms / runs, draft_pixels / runs,
+                draft_ms > 0. ? final_ms / draft_ms : 0.);
+        }
+        return 0;
+    }
+}
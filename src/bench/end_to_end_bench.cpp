@@ -0,0 +1,253 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+#include "core/pixel_convert.h"
+#include "core/png_writer.h"
+#include "core/stage_profiler.h"
+
+namespace Bench {
+    // Stages timed by the StageProfiler during a headless render (no upload)
+    static const StageProfiler::Stage timed_stages[] = { StageProfiler::PARSE, StageProfiler::LAYOUT, StageProfiler::REPLAY, StageProfiler::ENCODE };
+    static constexpr size_t timed_stage_count = sizeof(timed_stages) / sizeof(timed_stages[0]);
+
+    struct FormulaResult {
+        bool success = false;
+        double total_ms = 0.; // average over the iterations
+        double stage_ms[timed_stage_count] = {};
+        size_t output_bytes = 0;
+    };
+
+    struct ConfigResult {
+        std::string name; // <family>@<size>
+        std::string family;
+        float font_size = 0.f;
+        size_t failures = 0;
+        double total_ms = 0.; // sum over the corpus
+        double stage_ms[timed_stage_count] = {};
+        double p50_ms = 0.;
+        double p95_ms = 0.;
+        size_t output_bytes = 0;
+        size_t peak_rss = 0; // of the process after this config
+        std::vector<FormulaResult> formulas;
+    };
+
+    /**
+     * Parse, layout, rasterization (A8) and PNG encoding in memory of a single formula,
+     * the path of quicktex-batch without the file system
+     */
+    static FormulaResult render_formula(const std::string& latex, float font_size, int iterations) {
+        FormulaResult result;
+        auto& profiler = StageProfiler::getInstance();
+        PngWriter::Options png_options;
+        std::vector<unsigned char> png;
+        for (int it = 0;it < iterations;it++) {
+            double stages_before[timed_stage_count];
+            for (size_t i = 0;i < timed_stage_count;i++)
+                stages_before[i] = profiler.getTotalMs(timed_stages[i]);
+
+            auto start = Clock::now();
+            Latex::ParsedLatex parsed("\\[" + latex + "\\]", font_size);
+            if (!parsed.getLatexErrorMsg().empty())
+                return result;
+            PixelBuffer pixels = parsed.rasterize(ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK, PixelBuffer::A8);
+            if (pixels.empty())
+                return result;
+            auto rgba = PixelConvert::toRGBA(pixels);
+            if (!PngWriter::encode(rgba.data(), pixels.width, pixels.height, 4 * pixels.width, png, png_options))
+                return result;
+            result.total_ms += elapsedMs(start);
+
+            for (size_t i = 0;i < timed_stage_count;i++)
+                result.stage_ms[i] += profiler.getTotalMs(timed_stages[i]) - stages_before[i];
+        }
+        result.total_ms /= iterations;
+        for (size_t i = 0;i < timed_stage_count;i++)
+            result.stage_ms[i] /= iterations;
+        result.output_bytes = png.size();
+        result.success = true;
+        return result;
+    }
+
+    static void write_number(std::ostream& out, const char* key, double value) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "\"%s\": %.4f", key, value);
+        out << buffer;
+    }
+
+    static void write_stages(std::ostream& out, const double* stage_ms) {
+        for (size_t i = 0;i < timed_stage_count;i++) {
+            out << ", ";
+            write_number(out, (std::string(StageProfiler::getStageName(timed_stages[i])) + "_ms").c_str(), stage_ms[i]);
+        }
+    }
+
+    /**
+     * The summary of each config is written on a single line (read back by read_baseline),
+     * followed by its per formula results
+     */
+    static bool write_results(const std::string& path, const std::vector<ConfigResult>& configs, const Options& options) {
+        std::ofstream file(path);
+        if (!file.is_open())
+            return false;
+        file << "{\n\"benchmark\": \"end_to_end\",\n\"corpus\": \"" << std::filesystem::path(options.corpus_path).filename().string()
+            << "\",\n\"iterations\": " << options.iterations << ",\n\"peak_rss_bytes\": " << getPeakRSS() << ",\n\"configs\": [\n";
+        for (size_t c = 0;c < configs.size();c++) {
+            const ConfigResult& config = configs[c];
+            file << "{\"name\": \"" << config.name << "\", \"family\": \"" << config.family << "\", \"font_size\": " << config.font_size
+                << ", \"formulas\": " << config.formulas.size() << ", \"failures\": " << config.failures << ", ";
+            write_number(file, "total_ms", config.total_ms);
+            write_stages(file, config.stage_ms);
+            file << ", ";
+            write_number(file, "p50_ms", config.p50_ms);
+            file << ", ";
+            write_number(file, "p95_ms", config.p95_ms);
+            file << ", \"output_bytes\": " << config.output_bytes << ", \"peak_rss_bytes\": " << config.peak_rss << ",\n\"per_formula\": [\n";
+            for (size_t i = 0;i < config.formulas.size();i++) {
+                const FormulaResult& formula = config.formulas[i];
+                file << "{\"index\": " << i << ", \"success\": " << (formula.success ? "true" : "false") << ", ";
+                write_number(file, "total_ms", formula.total_ms);
+                write_stages(file, formula.stage_ms);
+                file << ", \"output_bytes\": " << formula.output_bytes << "}" << (i + 1 < config.formulas.size() ? ",\n" : "\n");
+            }
+            file << "]}" << (c + 1 < configs.size() ? ",\n" : "\n");
+        }
+        file << "]\n}\n";
+        return file.good();
+    }
+
+    static bool read_number(const std::string& line, const std::string& key, double& value) {
+        size_t pos = line.find("\"" + key + "\": ");
+        if (pos == std::string::npos)
+            return false;
+        value = std::strtod(line.c_str() + pos + key.size() + 4, nullptr);
+        return true;
+    }
+
+    /**
+     * Reads the config summaries of a file written by write_results (not a general JSON parser)
+     *
+     * @return name -> line of the summary
+     */
+    static std::map<std::string, std::string> read_baseline(const std::string& path) {
+        std::map<std::string, std::string> summaries;
+        std::ifstream file(path);
+        std::string line;
+        const std::string prefix = "{\"name\": \"";
+        while (std::getline(file, line)) {
+            if (line.compare(0, prefix.size(), prefix) != 0)
+                continue;
+            size_t end = line.find('"', prefix.size());
+            if (end != std::string::npos)
+                summaries[line.substr(prefix.size(), end - prefix.size())] = line;
+        }
+        return summaries;
+    }
+
+    /**
+     * @return the number of regressions (time or size above the baseline by more than the tolerance)
+     */
+    static int compare_baseline(const std::vector<ConfigResult>& configs, const Options& options) {
+        auto baseline = read_baseline(options.baseline_path);
+        if (baseline.empty()) {
+            printf("end_to_end: no baseline found in %s\n", options.baseline_path.c_str());
+            return 1;
+        }
+        int regressions = 0;
+        auto compare = [&](const std::string& name, const std::string& line, const char* key, double value) {
+            double previous = 0.;
+            if (!read_number(line, key, previous) || previous <= 0.)
+                return;
+            double change = value / previous - 1.;
+            bool regression = change > options.tolerance;
+            regressions += regression ? 1 : 0;
+            printf("  %-18s %-14s %12.3f -> %12.3f  %+6.1f%%%s\n", name.c_str(), key, previous, value, 100. * change, regression ? "  REGRESSION" : "");
+            };
+        printf("end_to_end: against %s (tolerance %.0f%%)\n", options.baseline_path.c_str(), 100. * options.tolerance);
+        for (auto& config : configs) {
+            auto it = baseline.find(config.name);
+            if (it == baseline.end()) {
+                printf("  %-18s not in the baseline\n", config.name.c_str());
+                continue;
+            }
+            compare(config.name, it->second, "total_ms", config.total_ms);
+            for (size_t i = 0;i < timed_stage_count;i++)
+                compare(config.name, it->second, (std::string(StageProfiler::getStageName(timed_stages[i])) + "_ms").c_str(), config.stage_ms[i]);
+            compare(config.name, it->second, "p95_ms", config.p95_ms);
+            compare(config.name, it->second, "output_bytes", (double)config.output_bytes);
+        }
+        return regressions;
+    }
+
+    /**
+     * Renders the whole corpus to PNG (in memory) for every font family at several
+     * sizes, with the time of each stage of the pipeline per formula
+     */
+    int endToEndBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        std::vector<float> sizes = { options.font_size / 2.f, options.font_size, options.font_size * 2.f };
+        std::vector<ConfigResult> configs;
+        printf("end_to_end: %zu formulas, %d iterations\n", corpus.size(), options.iterations);
+        printf("  %-18s %10s %10s %10s %10s %10s %8s %8s %12s %9s\n", "config", "total ms", "parse", "layout", "replay", "encode", "p50", "p95", "bytes", "RSS MB");
+        for (auto& family : Latex::getFontFamilies()) {
+            Latex::setDefaultFontFamily(family);
+            for (float size : sizes) {
+                ConfigResult config;
+                config.family = family;
+                config.font_size = size;
+                char name[64];
+                snprintf(name, sizeof(name), "%s@%g", family.c_str(), size);
+                config.name = name;
+
+                std::vector<double> times;
+                for (auto& latex : corpus) {
+                    FormulaResult formula = render_formula(latex, size, options.iterations);
+                    if (formula.success) {
+                        config.total_ms += formula.total_ms;
+                        for (size_t i = 0;i < timed_stage_count;i++)
+                            config.stage_ms[i] += formula.stage_ms[i];
+                        config.output_bytes += formula.output_bytes;
+                        times.push_back(formula.total_ms);
+                    }
+                    else {
+                        config.failures++;
+                    }
+                    config.formulas.push_back(formula);
+                }
+                if (!times.empty()) {
+                    // Nearest rank, as the StageProfiler
+                    std::sort(times.begin(), times.end());
+                    auto percentile = [&times](double p) {
+                        size_t rank = (size_t)std::ceil(p * times.size());
+                        return times[std::clamp<size_t>(rank, 1, times.size()) - 1];
+                        };
+                    config.p50_ms = percentile(0.50);
+                    config.p95_ms = percentile(0.95);
+                }
+                config.peak_rss = getPeakRSS();
+                printf("  %-18s %10.1f %10.1f %10.1f %10.1f %10.1f %8.3f %8.3f %12zu %9.1f\n", config.name.c_str(), config.total_ms,
+                    config.stage_ms[0], config.stage_ms[1], config.stage_ms[2], config.stage_ms[3],
+                    config.p50_ms, config.p95_ms, config.output_bytes, config.peak_rss / (1024. * 1024.));
+                configs.push_back(std::move(config));
+            }
+        }
+        // Default of Latex::init()
+        Latex::setDefaultFontFamily("XITS");
+
+        int ret = 0;
+        if (!options.output_path.empty()) {
+            if (write_results(options.output_path, configs, options))
+                printf("end_to_end: results written to %s\n", options.output_path.c_str());
+            else {
+                printf("end_to_end: could not write %s\n", options.output_path.c_str());
+                ret = 1;
+            }
+        }
+        if (!options.baseline_path.empty() && compare_baseline(configs, options) > 0)
+            ret = 1;
+        return ret;
+    }
+}
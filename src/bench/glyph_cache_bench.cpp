@@ -0,0 +1,73 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+
+#include "latex/glyph_cache.h"
+
+namespace Bench {
+    /**
+     * Builds a glyph heavy formula: a n x n matrix repeating the same few symbols
+     */
+    static std::string glyph_heavy_formula(int n) {
+        std::string latex = "\\begin{pmatrix}";
+        for (int i = 0;i < n;i++) {
+            for (int j = 0;j < n;j++) {
+                latex += "x_{ij}+\\alpha";
+                latex += j + 1 < n ? "&" : "\\\\";
+            }
+        }
+        return latex + "\\end{pmatrix}";
+    }
+
+    static double rasterize_all(const std::vector<std::shared_ptr<const Latex::ParsedLatex>>& parses, int iterations) {
+        auto start = Clock::now();
+        for (int it = 0;it < iterations;it++) {
+            for (auto& parsed : parses) {
+                parsed->rasterize(ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK);
+            }
+        }
+        return elapsedMs(start) / iterations;
+    }
+
+    /**
+     * Compares the rasterization of the corpus and of a glyph heavy matrix with
+     * and without the glyph coverage cache
+     */
+    int glyphCacheBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        struct Case {
+            std::string name;
+            std::vector<std::shared_ptr<const Latex::ParsedLatex>> parses;
+        };
+        std::vector<Case> cases(2);
+        cases[0].name = "corpus";
+        for (auto& latex : corpus) {
+            auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + latex + "\\]", options.font_size);
+            if (parsed->getLatexErrorMsg().empty())
+                cases[0].parses.push_back(parsed);
+        }
+        cases[1].name = "matrix 20x20";
+        cases[1].parses.push_back(std::make_shared<const Latex::ParsedLatex>("\\[" + glyph_heavy_formula(20) + "\\]", options.font_size));
+
+        printf("glyph_cache:\n");
+        for (auto& c : cases) {
+            microtex::GlyphCache::setEnabled(false);
+            double uncached_ms = rasterize_all(c.parses, options.iterations);
+
+            microtex::GlyphCache::setEnabled(true);
+            microtex::GlyphCache::resetStats();
+            // First pass fills the cache
+            double cold_ms = rasterize_all(c.parses, 1);
+            double warm_ms = rasterize_all(c.parses, options.iterations);
+            auto stats = microtex::GlyphCache::getStats();
+            double hit_rate = stats.hits + stats.misses > 0 ? 100. * stats.hits / (stats.hits + stats.misses) : 0.;
+
+            printf("  %-14s %zu formulas\n", c.name.c_str(), c.parses.size());
+            printf("    no cache      %10.3f ms\n", uncached_ms);
+            printf("    cold cache    %10.3f ms\n", cold_ms);
+            printf("    warm cache    %10.3f ms  (x%.2f)\n", warm_ms, warm_ms > 0. ? uncached_ms / warm_ms : 0.);
+            printf("    hit rate      %10.1f %%  (%zu masks, %.1f KB)\n", hit_rate, stats.entries, stats.bytes / 1024.);
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+
+#include <cstdio>
+
+#include "latex/environment_render.h"
+
+namespace Bench {
+    /**
+     * Builds an align environment of rows "x_i &= formula", from the formulas of the corpus
+     * that can be put in a cell
+     */
+    static std::vector<std::string> align_rows(const std::vector<std::string>& corpus, size_t rows) {
+        std::vector<std::string> out;
+        for (const auto& formula : corpus) {
+            if (out.size() == rows)
+                break;
+            if (formula.find('&') != std::string::npos || formula.find("\\\\") != std::string::npos || formula.find('%') != std::string::npos)
+                continue;
+            out.push_back("x_{" + std::to_string(out.size()) + "} &= " + formula);
+        }
+        return out;
+    }
+
+    static std::string join_rows(const std::vector<std::string>& rows) {
+        std::string latex = "\\begin{align*}";
+        for (size_t i = 0;i < rows.size();i++) {
+            latex += rows[i];
+            if (i + 1 < rows.size())
+                latex += "\\\\";
+        }
+        return latex + "\\end{align*}";
+    }
+
+    /**
+     * Latency of a one row edit in a large align environment: whole render
+     * against the preview composed from the cached rows
+     */
+    int incrementalBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        const ImVec2 scale(1.f, 1.f);
+        const ImVec2 padding(0.f, 0.f);
+        int failures = 0;
+        for (size_t row_count : { 10, 40 }) {
+            auto rows = align_rows(corpus, row_count);
+            if (rows.size() < row_count) {
+                printf("incremental: not enough formulas for %zu rows\n", row_count);
+                return 1;
+            }
+
+            // Each iteration edits another row, as typing in it would
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                auto edited = rows;
+                edited[it % rows.size()] += " + " + std::to_string(it);
+                Latex::LatexImage image("\\[" + join_rows(edited) + "\\]", options.font_size, 7.f, microtex::BLACK, scale, padding, nullptr, PixelBuffer::A8);
+            }
+            double whole_ms = elapsedMs(start) / options.iterations;
+
+            Latex::EnvironmentRenderer renderer;
+            Latex::Environment environment;
+            PixelBuffer pixels;
+            if (!Latex::splitEnvironment(join_rows(rows), environment)
+                || !renderer.render(environment, Latex::getMathFontFamily(), options.font_size, 7.f, microtex::BLACK, scale, padding, PixelBuffer::A8, pixels)) {
+                printf("incremental: %zu rows could not be rendered by rows\n", row_count);
+                failures++;
+                continue;
+            }
+            size_t parsed_before = renderer.getParsedRowCount();
+            start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                auto edited = rows;
+                edited[it % rows.size()] += " + " + std::to_string(it);
+                Latex::splitEnvironment(join_rows(edited), environment);
+                renderer.render(environment, Latex::getMathFontFamily(), options.font_size, 7.f, microtex::BLACK, scale, padding, PixelBuffer::A8, pixels);
+            }
+            double incremental_ms = elapsedMs(start) / options.iterations;
+            size_t parsed = renderer.getParsedRowCount() - parsed_before;
+            // Only the edited row must have been parsed again
+            if (parsed != (size_t)options.iterations)
+                failures++;
+            printf("incremental: align %2zu rows %5dx%-5d  whole %9.3f ms  edited row %9.3f ms  (x%.2f), %zu rows parsed for %d edits\n",
+                row_count, pixels.width, pixels.height, whole_ms, incremental_ms,
+                incremental_ms > 0. ? whole_ms / incremental_ms : 0., parsed, options.iterations);
+        }
+        return failures > 0 ? 1 : 0;
+    }
+}
@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "core/thread_pool.h"
+
+namespace Bench {
+    /**
+     * Builds a large matrix of the first n x n formulas of the corpus (repeated if needed)
+     */
+    static std::string corpus_matrix(const std::vector<std::string>& corpus, int n) {
+        std::string latex = "\\begin{pmatrix}";
+        for (int i = 0;i < n;i++) {
+            for (int j = 0;j < n;j++) {
+                latex += corpus[(i * n + j) % corpus.size()];
+                latex += j + 1 < n ? "&" : "\\\\";
+            }
+        }
+        return latex + "\\end{pmatrix}";
+    }
+
+    static bool same_pixels(const PixelBuffer& a, const PixelBuffer& b) {
+        if (a.width != b.width || a.height != b.height || a.format != b.format)
+            return false;
+        for (int y = 0;y < a.height;y++) {
+            if (memcmp(a.pixels() + (size_t)y * a.stride, b.pixels() + (size_t)y * b.stride, (size_t)a.bytesPerPixel() * a.width) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * Latency of the rasterization of a single large formula, single-threaded
+     * and split into bands on all the cores (the outputs must be identical)
+     */
+    int parallelRasterBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        struct Case {
+            std::string name;
+            std::shared_ptr<const Latex::ParsedLatex> parsed;
+        };
+        std::vector<Case> cases;
+        for (int n : { 4, 8 }) {
+            auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + corpus_matrix(corpus, n) + "\\]", options.font_size);
+            if (parsed->getLatexErrorMsg().empty())
+                cases.push_back({ "matrix " + std::to_string(n) + "x" + std::to_string(n), parsed });
+        }
+        // Longest formula of the corpus
+        auto longest = std::max_element(corpus.begin(), corpus.end(), [](const std::string& a, const std::string& b) { return a.size() < b.size(); });
+        auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + *longest + "\\]", options.font_size);
+        if (parsed->getLatexErrorMsg().empty())
+            cases.push_back({ "longest", parsed });
+
+        const int previous_threads = Latex::getRasterThreads();
+        int failures = 0;
+        printf("parallel_raster: %d threads\n", ThreadPool::getInstance().getThreadCount());
+        for (auto& c : cases) {
+            for (float scale : { 1.f, 2.f }) {
+                double ms[2] = { 0., 0. };
+                PixelBuffer outputs[2];
+                int threads[2] = { 1, 0 };
+                for (int t = 0;t < 2;t++) {
+                    Latex::setRasterThreads(threads[t]);
+                    // First run warms up the glyph caches of the threads
+                    outputs[t] = c.parsed->rasterize(ImVec2(scale, scale), ImVec2(0.f, 0.f), microtex::BLACK);
+                    auto start = Clock::now();
+                    for (int it = 0;it < options.iterations;it++) {
+                        c.parsed->rasterize(ImVec2(scale, scale), ImVec2(0.f, 0.f), microtex::BLACK);
+                    }
+                    ms[t] = elapsedMs(start) / options.iterations;
+                }
+                bool identical = same_pixels(outputs[0], outputs[1]);
+                if (!identical)
+                    failures++;
+                printf("  %-14s x%.0f %5dx%-5d  1 thread %9.3f ms  bands %9.3f ms  (x%.2f)%s\n",
+                    c.name.c_str(), scale, outputs[0].width, outputs[0].height, ms[0], ms[1],
+                    ms[1] > 0. ? ms[0] / ms[1] : 0., identical ? "" : "  MISMATCH");
+            }
+        }
+        Latex::setRasterThreads(previous_threads);
+        return failures > 0 ? 1 : 0;
+    }
+}
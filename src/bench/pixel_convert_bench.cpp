@@ -0,0 +1,79 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include "core/pixel_convert.h"
+
+namespace Bench {
+    /**
+     * Throughput of each premultiplied ARGB -> straight RGBA kernel on a synthetic
+     * 4096 x 4096 image, checked against the scalar kernel
+     * Then the same for the transparent border search (findOpaqueBounds)
+     */
+    int pixelConvertBenchmark(const std::vector<std::string>&, const Options& options) {
+        const int width = 4096;
+        const int height = 4096;
+        const int stride = 4 * width;
+        std::vector<unsigned char> src((size_t)stride * height);
+        std::mt19937 rng(42);
+        for (size_t i = 0;i < src.size();i += 4) {
+            unsigned char a = rng() & 0xff;
+            // Premultiplied: the color channels can not exceed the alpha
+            src[i + 0] = a == 0 ? 0 : rng() % (a + 1);
+            src[i + 1] = a == 0 ? 0 : rng() % (a + 1);
+            src[i + 2] = a == 0 ? 0 : rng() % (a + 1);
+            src[i + 3] = a;
+        }
+
+        std::vector<unsigned char> reference(src.size());
+        std::vector<unsigned char> dst(src.size());
+        PixelConvert::premultipliedARGBToRGBA(PixelConvert::SCALAR, src.data(), stride, reference.data(), stride, width, height);
+
+        int ret = 0;
+        printf("pixel_convert: %dx%d, best kernel: %s\n", width, height, PixelConvert::getKernelName(PixelConvert::getBestKernel()));
+        for (auto kernel : { PixelConvert::SCALAR, PixelConvert::SSE2, PixelConvert::AVX2 }) {
+            if (!PixelConvert::isSupported(kernel)) {
+                printf("  %-8s unsupported\n", PixelConvert::getKernelName(kernel));
+                continue;
+            }
+            // Warm up (and touch the destination pages)
+            PixelConvert::premultipliedARGBToRGBA(kernel, src.data(), stride, dst.data(), stride, width, height);
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                PixelConvert::premultipliedARGBToRGBA(kernel, src.data(), stride, dst.data(), stride, width, height);
+            }
+            double ms = elapsedMs(start) / options.iterations;
+            size_t mismatches = 0;
+            for (size_t i = 0;i < dst.size();i++) {
+                mismatches += dst[i] != reference[i];
+            }
+            if (mismatches > 0)
+                ret = 1;
+            printf("  %-8s %8.3f ms  %7.2f GB/s  %8.1f Mpixels/s  %zu mismatches\n",
+                PixelConvert::getKernelName(kernel), ms, src.size() / (ms * 1e6), (double)width * height / (ms * 1e3), mismatches);
+        }
+
+        // Worst case for the trim: a single visible pixel in the middle, every row is scanned
+        std::fill(src.begin(), src.end(), 0);
+        src[(size_t)(height / 2) * stride + 4 * (width / 2) + 3] = 0xff;
+        printf("find_opaque_bounds: %dx%d, one visible pixel\n", width, height);
+        for (auto kernel : { PixelConvert::SCALAR, PixelConvert::SSE2, PixelConvert::AVX2 }) {
+            if (!PixelConvert::isSupported(kernel))
+                continue;
+            int x = 0, y = 0, w = 0, h = 0;
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                PixelConvert::findOpaqueBounds(kernel, src.data(), width, height, stride, x, y, w, h);
+            }
+            double ms = elapsedMs(start) / options.iterations;
+            bool valid = x == width / 2 && y == height / 2 && w == 1 && h == 1;
+            if (!valid)
+                ret = 1;
+            printf("  %-8s %8.3f ms  %7.2f GB/s  %s\n",
+                PixelConvert::getKernelName(kernel), ms, src.size() / (ms * 1e6), valid ? "ok" : "wrong bounds");
+        }
+        return ret;
+    }
+}
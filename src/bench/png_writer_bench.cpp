@@ -0,0 +1,83 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+
+#include "stb_image_write.h"
+#include "core/pixel_convert.h"
+#include "core/png_writer.h"
+
+namespace Bench {
+    /**
+     * Encodes the rasterized corpus with stb_image_write and with the PngWriter
+     * (at several levels and color modes), comparing the time and the total size
+     */
+    int pngWriterBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        struct Formula {
+            std::vector<unsigned char> rgba;
+            int width = 0;
+            int height = 0;
+        };
+        std::vector<Formula> formulas;
+        for (auto& latex : corpus) {
+            Latex::ParsedLatex parsed("\\[" + latex + "\\]", options.font_size);
+            if (!parsed.getLatexErrorMsg().empty())
+                continue;
+            PixelBuffer pixels = parsed.rasterize(ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK);
+            if (pixels.empty())
+                continue;
+            Formula formula;
+            formula.rgba = PixelConvert::toRGBA(pixels.pixels(), pixels.width, pixels.height, pixels.stride);
+            formula.width = pixels.width;
+            formula.height = pixels.height;
+            formulas.push_back(std::move(formula));
+        }
+
+        printf("png_writer: %zu formulas\n", formulas.size());
+        {
+            size_t bytes = 0;
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                bytes = 0;
+                for (auto& formula : formulas) {
+                    stbi_write_png_to_func([](void* context, void*, int size) {
+                        *(size_t*)context += size;
+                        }, &bytes, formula.width, formula.height, 4, formula.rgba.data(), 4 * formula.width);
+                }
+            }
+            double ms = elapsedMs(start) / options.iterations;
+            printf("  %-22s %10.3f ms  %10zu bytes\n", "stb", ms, bytes);
+        }
+
+        int ret = 0;
+        struct Setup {
+            PngWriter::ColorMode mode;
+            int level;
+        };
+        for (auto setup : { Setup{ PngWriter::RGBA, 6 }, Setup{ PngWriter::GREY_ALPHA, 6 }, Setup{ PngWriter::AUTO, 1 }, Setup{ PngWriter::AUTO, 6 }, Setup{ PngWriter::AUTO, 9 } }) {
+            PngWriter::Options png_options;
+            png_options.mode = setup.mode;
+            png_options.level = setup.level;
+            size_t bytes = 0;
+            size_t palettes = 0;
+            std::vector<unsigned char> out;
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                bytes = 0;
+                palettes = 0;
+                for (auto& formula : formulas) {
+                    PngWriter::Result result;
+                    if (!PngWriter::encode(formula.rgba.data(), formula.width, formula.height, 4 * formula.width, out, png_options, &result))
+                        ret = 1;
+                    bytes += out.size();
+                    palettes += result.mode == PngWriter::PALETTE;
+                }
+            }
+            double ms = elapsedMs(start) / options.iterations;
+            char name[64];
+            snprintf(name, sizeof(name), "%s level %d", PngWriter::getColorModeName(setup.mode), setup.level);
+            printf("  %-22s %10.3f ms  %10zu bytes  (%zu palettes)\n", name, ms, bytes, palettes);
+        }
+        return ret;
+    }
+}
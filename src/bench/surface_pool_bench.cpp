@@ -0,0 +1,53 @@
+#include "bench.h"
+
+#include <cstdio>
+#include <memory>
+
+#include "latex/surface_pool.h"
+
+namespace Bench {
+    /**
+     * Rasterizes the corpus at slightly changing sizes (as when dragging the size
+     * in the editor), with and without the surface pool
+     */
+    int surfacePoolBenchmark(const std::vector<std::string>& corpus, const Options& options) {
+        std::vector<std::shared_ptr<const Latex::ParsedLatex>> parses;
+        for (auto& latex : corpus) {
+            auto parsed = std::make_shared<const Latex::ParsedLatex>("\\[" + latex + "\\]", options.font_size);
+            if (parsed->getLatexErrorMsg().empty())
+                parses.push_back(parsed);
+        }
+
+        auto run = [&]() {
+            auto start = Clock::now();
+            for (int it = 0;it < options.iterations;it++) {
+                for (int step = 0;step < 8;step++) {
+                    float scale = 1.f + 0.02f * step;
+                    for (auto& parsed : parses) {
+                        parsed->rasterize(ImVec2(scale, scale), ImVec2(0.f, 0.f), microtex::BLACK);
+                    }
+                }
+            }
+            return elapsedMs(start) / options.iterations;
+            };
+
+        auto default_budget = microtex::SurfacePool::getStats().byte_budget;
+        microtex::SurfacePool::setByteBudget(0);
+        auto before = microtex::SurfacePool::getStats();
+        double unpooled_ms = run();
+
+        microtex::SurfacePool::setByteBudget(default_budget);
+        auto middle = microtex::SurfacePool::getStats();
+        double pooled_ms = run();
+        auto after = microtex::SurfacePool::getStats();
+
+        size_t acquisitions = after.acquisitions - middle.acquisitions;
+        size_t reuses = after.reuses - middle.reuses;
+        printf("surface_pool: %zu formulas x 8 sizes\n", parses.size());
+        printf("  no pool         %10.3f ms  (%zu allocations)\n", unpooled_ms, middle.allocations - before.allocations);
+        printf("  pool            %10.3f ms  (%zu allocations, %.1f%% avoided, %.1f MB pooled)\n",
+            pooled_ms, after.allocations - middle.allocations,
+            acquisitions > 0 ? 100. * reuses / acquisitions : 0., after.bytes / (1024. * 1024.));
+        return 0;
+    }
+}
@@ -1,19 +1,73 @@
 #include "image.h"
 
+#include <cstdio>
+#include <cstring>
+
+#include "pixel_convert.h"
+#include "stage_profiler.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
 
 int Image::count = 0;
+bool Image::s_texture_swizzle = false;
+
+/**
+ * Returns true if the extension is listed by the current context
+ */
+static bool has_gl_extension(const char* name, int major) {
+#ifdef GL_NUM_EXTENSIONS
+    // GL 3 core profiles only list the extensions one by one
+    if (major >= 3) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0;i < count;i++) {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension != nullptr && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+#endif
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    return extensions != nullptr && strstr(extensions, name) != nullptr;
+}
+
+void Image::detectCapabilities() {
+    s_texture_swizzle = false;
+#if defined(GL_TEXTURE_SWIZZLE_A) && defined(GL_R8)
+    const char* version = (const char*)glGetString(GL_VERSION);
+    if (version == nullptr)
+        return;
+    // "OpenGL ES 3.0 ..." or "3.3.0 <vendor> ..."
+    const char* es_prefix = "OpenGL ES ";
+    const bool es = strncmp(version, es_prefix, strlen(es_prefix)) == 0;
+    int major = 0, minor = 0;
+    if (sscanf(es ? version + strlen(es_prefix) : version, "%d.%d", &major, &minor) != 2)
+        return;
+    if (es)
+        s_texture_swizzle = major >= 3;
+    else if (major > 3 || (major == 3 && minor >= 3))
+        s_texture_swizzle = true;
+    else
+        s_texture_swizzle = major == 3 && (has_gl_extension("GL_ARB_texture_swizzle", major) || has_gl_extension("GL_EXT_texture_swizzle", major));
+#endif
+}
 
 void Image::reset() {
     if (m_success) {
         m_success = false;
-        m_width = 0;
-        m_height = 0;
         glDeleteTextures(1, &texture_);
     }
-    m_data = std::make_shared<ARGB_Image>();
+    m_width = 0;
+    m_height = 0;
+    m_stride = 0;
+    m_offset = 0;
+    m_format = RGBA;
+    m_tint = 0xff000000;
+    // Only drops the reference, the buffer may be shared (e.g. with a render cache)
+    m_data = nullptr;
 }
 Image::~Image() {
     reset();
@@ -21,6 +75,9 @@ Image::~Image() {
 void Image::load_texture(Filtering filtering) {
     if (m_data == nullptr || m_data->empty())
         return;
+    upload_texture(m_data->data() + m_offset, filtering);
+}
+void Image::upload_texture(const unsigned char* data, Filtering filtering) {
     // Create a OpenGL texture identifier
     GLuint image_texture;
     glGenTextures(1, &image_texture);
@@ -38,9 +95,37 @@ void Image::load_texture(Filtering filtering) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter);
 
     // Upload pixels into texture
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &(*m_data)[0]);
+    if (m_format == A8 && s_texture_swizzle) {
+#if defined(GL_TEXTURE_SWIZZLE_A) && defined(GL_R8)
+        // Single channel texture read as white with the coverage as alpha, tinted when drawn
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_ONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_ONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ONE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_stride > 0 ? m_stride : 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_width, m_height, 0, GL_RED, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+#endif
+    }
+    else if (m_format == A8) {
+        // White RGBA with the coverage as alpha, tinted when drawn (freed once uploaded)
+        std::vector<unsigned char> converted((size_t)4 * m_width * m_height);
+        PixelConvert::coverageToRGBA(data, m_stride > 0 ? m_stride : m_width, converted.data(), 4 * m_width, m_width, m_height, 0xffffffff);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, converted.data());
+    }
+    else if (m_format == ARGB) {
+        // ImGui blends with straight alpha: unpremultiply and swizzle into a buffer freed once uploaded
+        std::vector<unsigned char> converted((size_t)4 * m_width * m_height);
+        PixelConvert::premultipliedARGBToRGBA(data, m_stride > 0 ? m_stride : 4 * m_width, converted.data(), 4 * m_width, m_width, m_height);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, converted.data());
+    }
+    else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_stride > 0 ? m_stride / 4 : 0);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
     texture_ = image_texture;
 }
 
@@ -62,8 +147,9 @@ void Image::load_texture_from_file(const char* filename, Filtering filtering) {
     m_success = true;
 }
 
-void Image::load_texture_from_memory(unsigned char* data, int width, int height, Filtering filtering) {
+void Image::load_texture_from_memory(unsigned char* data, int width, int height, Filtering filtering, Format format) {
     reset();
+    m_format = format;
 
     m_data = std::make_shared<ARGB_Image>();
     m_data->resize(width * height * 4);
@@ -77,19 +163,74 @@ void Image::load_texture_from_memory(unsigned char* data, int width, int height,
 
 }
 
+ImU32 Image::getDrawColor() const {
+    if (m_format != A8)
+        return IM_COL32_WHITE;
+    // ARGB tint to ImGui's ABGR
+    return IM_COL32((m_tint >> 16) & 0xff, (m_tint >> 8) & 0xff, m_tint & 0xff, m_tint >> 24);
+}
+
+std::vector<unsigned char> Image::getRGBA() const {
+    if (m_data == nullptr || m_data->empty() || m_width <= 0 || m_height <= 0)
+        return {};
+    if (m_format == A8) {
+        std::vector<unsigned char> out((size_t)4 * m_width * m_height);
+        PixelConvert::coverageToRGBA(m_data->data() + m_offset, stride(), out.data(), 4 * m_width, m_width, m_height, m_tint);
+        return out;
+    }
+    if (m_format == ARGB)
+        return PixelConvert::toRGBA(m_data->data() + m_offset, m_width, m_height, stride());
+    std::vector<unsigned char> out((size_t)4 * m_width * m_height);
+    for (int y = 0;y < m_height;y++) {
+        memcpy(out.data() + (size_t)4 * y * m_width, m_data->data() + m_offset + (size_t)y * stride(), (size_t)4 * m_width);
+    }
+    return out;
+}
+
 bool Image::setImage(const char* filename, Filtering filtering) {
     load_texture_from_file(filename, filtering);
     return m_success;
 }
 
 bool Image::setImage(unsigned char* data, int width, int height, Filtering filtering, Format format) {
-    load_texture_from_memory(data, width, height, filtering);
+    load_texture_from_memory(data, width, height, filtering, format);
     return m_success;
 }
 bool Image::setImage(ARGB_Imageptr data, int width, int height, Filtering filtering, Format format) {
+    reset();
+    m_format = format;
     m_data = data;
     m_width = width;
     m_height = height;
     load_texture(filtering);
+    m_success = m_data != nullptr && !m_data->empty();
+    return m_success;
+}
+bool Image::setImage(const PixelBuffer& buffer, Filtering filtering) {
+    StageProfiler::Scope profile(StageProfiler::UPLOAD);
+    reset();
+    if (buffer.empty())
+        return false;
+    m_format = buffer.format == PixelBuffer::A8 ? A8 : ARGB;
+    m_tint = buffer.tint;
+    m_data = buffer.data;
+    m_width = buffer.width;
+    m_height = buffer.height;
+    m_stride = buffer.stride;
+    m_offset = buffer.offset;
+    load_texture(filtering);
+    m_success = true;
+    return m_success;
+}
+bool Image::setImageView(const unsigned char* data, int width, int height, int stride, Filtering filtering, Format format) {
+    reset();
+    if (data == nullptr || width <= 0 || height <= 0)
+        return false;
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_stride = stride;
+    upload_texture(data, filtering);
+    m_success = true;
     return m_success;
 }
\ No newline at end of file
@@ -3,34 +3,49 @@
 #include <vector>
 #include <tempo.h>
 
-using ARGB_Image = std::vector<unsigned char>;
-using ARGB_Imageptr = std::shared_ptr<ARGB_Image>;
+#include "pixel_buffer.h"
+
 /**
  * Image class for holding images in memory to be drawn to Dear ImGui
  */
 class Image {
 public:
     enum Filtering { FILTER_NEAREST, FILTER_BILINEAR };
-    enum Format { RGBA, ARGB };
+    // RGBA: straight alpha R, G, B, A bytes; ARGB: Cairo's premultiplied, native endian ARGB32;
+    // A8: coverage bytes, drawn in the tint color
+    enum Format { RGBA, ARGB, A8 };
 private:
     GLuint texture_ = -1;
     int m_width = 0;
     int m_height = 0;
+    int m_stride = 0;
+    size_t m_offset = 0; // bytes before the first pixel in m_data
     int m_samples = 4;
+    Format m_format = RGBA;
+    uint32_t m_tint = 0xff000000; // A8 only, 0xAARRGGBB (see PixelBuffer::tint)
 
     bool m_success = false;
 
     ARGB_Imageptr m_data = nullptr;
 
     void load_texture(Filtering filtering);
+    void upload_texture(const unsigned char* data, Filtering filtering);
     void load_texture_from_file(const char* filename, Filtering filtering);
-    void load_texture_from_memory(unsigned char* data, int width, int height, Filtering filtering);
+    void load_texture_from_memory(unsigned char* data, int width, int height, Filtering filtering, Format format);
 
     static int count;
+    static bool s_texture_swizzle; // single channel A8 textures, see detectCapabilities
 public:
     Image() { count++; };
     ~Image();
 
+    /**
+     * Checks what the current GL context supports (texture swizzle and GL_R8, i.e. GL 3.3,
+     * GL 3.0 with ARB_texture_swizzle or GLES 3.0), once it has been created, on its thread
+     * Until then, and on older contexts, A8 images are uploaded expanded to RGBA
+     */
+    static void detectCapabilities();
+
     /**
      * Set image from disk
      * @param filename path of the image (jpg, png)
@@ -38,8 +53,34 @@ public:
      */
     bool setImage(const char* filename, Filtering filtering = FILTER_NEAREST);
 
+    /**
+     * @return pixels kept in memory (nullptr if none), with stride() bytes per row
+     * starting offset() bytes into the buffer
+     */
     ARGB_Imageptr getData() const { return m_data; }
 
+    /**
+     * @return pixel format of getData()
+     */
+    Format format() const { return m_format; }
+
+    /**
+     * @brief Sets the color of A8 (coverage) images, applied when drawn: no new upload is needed
+     * @param color 0xAARRGGBB as microtex::color, not an ImU32 (see PixelBuffer::tint)
+     */
+    void setTint(uint32_t color) { m_tint = color; }
+
+    /**
+     * @return color to draw the texture with (white except for A8 images), as an ImU32
+     */
+    ImU32 getDrawColor() const;
+
+    /**
+     * @return pixels kept in memory as straight alpha RGBA bytes, tightly packed
+     * (converted if needed, empty if no pixels are kept)
+     */
+    std::vector<unsigned char> getRGBA() const;
+
 
     /**
      * Set image from memory (makes a local copy of data)
@@ -55,6 +96,22 @@ public:
      */
     bool setImage(ARGB_Imageptr data_ptr, int width, int height, Filtering filtering = FILTER_NEAREST, Format format = ARGB);
 
+    /**
+     * Uploads a CPU rendered pixel buffer (makes no copy, the buffer is shared)
+     * Must be called from the thread owning the GL context
+     * @param buffer rendered pixels
+     * @return if successful or not
+     */
+    bool setImage(const PixelBuffer& buffer, Filtering filtering = FILTER_NEAREST);
+
+    /**
+     * Uploads pixels to the GPU without keeping them in memory (makes no copy)
+     * getData() will return an empty array
+     * @param data pixels in format (ARGB or A8, drawn in the tint), with stride bytes per row
+     * @return if successful or not
+     */
+    bool setImageView(const unsigned char* data, int width, int height, int stride, Filtering filtering = FILTER_NEAREST, Format format = ARGB);
+
     /**
      * Erases any content in the image
      * After this function, isImageSet will return false
@@ -74,6 +131,14 @@ public:
      * @return height of image as stored in memory
      */
     int height() const { return m_height; }
+    /**
+     * @return number of bytes per row of getData()
+     */
+    int stride() const { return m_stride > 0 ? m_stride : 4 * m_width; }
+    /**
+     * @return number of bytes before the first pixel of getData()
+     */
+    size_t offset() const { return m_offset; }
     /**
      * @return GL texture of image
      * This function is not safe. Always check if image is set with isImageSet()
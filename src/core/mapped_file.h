@@ -0,0 +1,40 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file
+ *
+ * The pages are shared with the OS page cache (and other processes mapping the same file),
+ * nothing is copied on the heap.
+ */
+class MappedFile {
+private:
+    const unsigned char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+public:
+    MappedFile() {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Maps the file (unmapping any previously mapped file)
+     *
+     * Empty files can not be mapped: isOpen() is false and size() is 0
+     *
+     * @return true if the file has been mapped
+     */
+    bool open(const std::string& path);
+
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
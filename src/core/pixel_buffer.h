@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+using ARGB_Image = std::vector<unsigned char>;
+using ARGB_Imageptr = std::shared_ptr<ARGB_Image>;
+
+/**
+ * @brief Plain CPU pixel buffer, as produced by the renderer
+ *
+ * Does not depend on OpenGL: it can be created and read from any thread.
+ * Uploading it to the GPU is done separately with Image::setImage.
+ */
+struct PixelBuffer {
+    enum Format {
+        ARGB32_PREMULTIPLIED, // Cairo's CAIRO_FORMAT_ARGB32, native endian
+        A8 // Cairo's CAIRO_FORMAT_A8: coverage only, colored with tint when displayed / exported
+    };
+
+    int width = 0;
+    int height = 0;
+    int stride = 0; // bytes per row, can be larger than bytesPerPixel() * width
+    size_t offset = 0; // bytes before the first pixel (e.g. a cropped view of a larger surface)
+    Format format = ARGB32_PREMULTIPLIED;
+    ARGB_Imageptr data = nullptr;
+    // A8 only: color of the coverage, 0xAARRGGBB as microtex::color (red in bits 16-23),
+    // not ImGui's ImU32 (ABGR): GUI colors go through Latex::toMicroTeXColor
+    uint32_t tint = 0xff000000;
+
+    // Distance (in pixels) from the baseline to the top / bottom of the formula
+    float ascent = 0.f;
+    float descent = 0.f;
+
+    const unsigned char* pixels() const { return data == nullptr ? nullptr : data->data() + offset; }
+    unsigned char* pixels() { return data == nullptr ? nullptr : data->data() + offset; }
+
+    int bytesPerPixel() const { return format == A8 ? 1 : 4; }
+
+    bool empty() const { return data == nullptr || data->empty() || width <= 0 || height <= 0; }
+    // Memory held by the buffer, which can be larger than stride * height (e.g. pooled surfaces)
+    size_t byteSize() const { return data == nullptr ? 0 : data->size(); }
+};
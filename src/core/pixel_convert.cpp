@@ -0,0 +1,384 @@
+#include "pixel_convert.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace PixelConvert {
+    /**
+     * Reference implementation, also used for the pixels left over by the SIMD kernels
+     * Same arithmetic as the SIMD kernels: c * (255 / a) + 0.5, truncated and clamped to 255,
+     * precomputed for every (alpha, channel) pair
+     */
+    static void convert_row_scalar(const unsigned char* src, unsigned char* dst, int width) {
+        static const auto table = []() {
+            std::vector<unsigned char> values(256 * 256, 0);
+            for (int a = 1;a < 256;a++) {
+                const float scale = 255.f / (float)a;
+                for (int c = 0;c < 256;c++)
+                    values[a * 256 + c] = (unsigned char)std::min(255.f, (float)c * scale + 0.5f);
+            }
+            return values;
+            }();
+        for (int x = 0;x < width;x++) {
+            // Read as a native endian 32 bits integer, as written by Cairo
+            uint32_t pixel;
+            memcpy(&pixel, src + 4 * x, 4);
+            const uint32_t a = pixel >> 24;
+            const unsigned char* row = table.data() + a * 256;
+            dst[4 * x + 0] = row[(pixel >> 16) & 0xff];
+            dst[4 * x + 1] = row[(pixel >> 8) & 0xff];
+            dst[4 * x + 2] = row[pixel & 0xff];
+            dst[4 * x + 3] = (unsigned char)a;
+        }
+    }
+
+    /**
+     * Index of the first / last non transparent pixel of a row (count / -1 if none)
+     */
+    static int first_visible_scalar(const unsigned char* row, int count) {
+        for (int x = 0;x < count;x++) {
+            uint32_t pixel;
+            memcpy(&pixel, row + 4 * x, 4);
+            if (pixel != 0)
+                return x;
+        }
+        return count;
+    }
+    static int last_visible_scalar(const unsigned char* row, int count) {
+        for (int x = count - 1;x >= 0;x--) {
+            uint32_t pixel;
+            memcpy(&pixel, row + 4 * x, 4);
+            if (pixel != 0)
+                return x;
+        }
+        return -1;
+    }
+
+#ifdef PIXEL_CONVERT_X86
+    /**
+     * Unpremultiplies and swizzles one pixel per 32 bits lane group: (B, G, R, A) ints -> (R, G, B, A) ints
+     */
+    static inline __m128i convert_pixel_sse2(__m128i pixel) {
+        const __m128 v255 = _mm_set1_ps(255.f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 alpha_lane = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        const __m128 one = _mm_set1_ps(1.f);
+
+        __m128 f = _mm_cvtepi32_ps(pixel);
+        __m128 a = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 scale = _mm_div_ps(v255, a);
+        // 0 if alpha is 0 (instead of inf), 1 for the alpha itself
+        scale = _mm_and_ps(scale, _mm_cmpgt_ps(a, _mm_setzero_ps()));
+        scale = _mm_or_ps(_mm_andnot_ps(alpha_lane, scale), _mm_and_ps(alpha_lane, one));
+        __m128 c = _mm_min_ps(_mm_add_ps(_mm_mul_ps(f, scale), half), v255);
+        c = _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 1, 2));
+        return _mm_cvttps_epi32(c);
+    }
+
+    static void convert_row_sse2(const unsigned char* src, unsigned char* dst, int width) {
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (;x + 4 <= width;x += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(src + 4 * x));
+            __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+            __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+            __m128i p0 = convert_pixel_sse2(_mm_unpacklo_epi16(lo, zero));
+            __m128i p1 = convert_pixel_sse2(_mm_unpackhi_epi16(lo, zero));
+            __m128i p2 = convert_pixel_sse2(_mm_unpacklo_epi16(hi, zero));
+            __m128i p3 = convert_pixel_sse2(_mm_unpackhi_epi16(hi, zero));
+            __m128i out = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+            _mm_storeu_si128((__m128i*)(dst + 4 * x), out);
+        }
+        convert_row_scalar(src + 4 * x, dst + 4 * x, width - x);
+    }
+
+    TARGET_AVX2 static inline __m256i convert_pixel_avx2(__m256i pixel) {
+        const __m256 v255 = _mm256_set1_ps(255.f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 alpha_lane = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+        const __m256 one = _mm256_set1_ps(1.f);
+
+        __m256 f = _mm256_cvtepi32_ps(pixel);
+        __m256 a = _mm256_permute_ps(f, _MM_SHUFFLE(3, 3, 3, 3));
+        __m256 scale = _mm256_div_ps(v255, a);
+        scale = _mm256_and_ps(scale, _mm256_cmp_ps(a, _mm256_setzero_ps(), _CMP_GT_OQ));
+        scale = _mm256_blendv_ps(scale, one, alpha_lane);
+        __m256 c = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(f, scale), half), v255);
+        c = _mm256_permute_ps(c, _MM_SHUFFLE(3, 0, 1, 2));
+        return _mm256_cvttps_epi32(c);
+    }
+
+    TARGET_AVX2 static void convert_row_avx2(const unsigned char* src, unsigned char* dst, int width) {
+        const __m256i zero = _mm256_setzero_si256();
+        int x = 0;
+        // Unpacks and packs both work within 128 bits lanes, so the pixel order is preserved
+        for (;x + 8 <= width;x += 8) {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(src + 4 * x));
+            __m256i lo = _mm256_unpacklo_epi8(pixels, zero);
+            __m256i hi = _mm256_unpackhi_epi8(pixels, zero);
+            __m256i p0 = convert_pixel_avx2(_mm256_unpacklo_epi16(lo, zero));
+            __m256i p1 = convert_pixel_avx2(_mm256_unpackhi_epi16(lo, zero));
+            __m256i p2 = convert_pixel_avx2(_mm256_unpacklo_epi16(hi, zero));
+            __m256i p3 = convert_pixel_avx2(_mm256_unpackhi_epi16(hi, zero));
+            __m256i out = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+            _mm256_storeu_si256((__m256i*)(dst + 4 * x), out);
+        }
+        convert_row_sse2(src + 4 * x, dst + 4 * x, width - x);
+    }
+
+    static int first_visible_sse2(const unsigned char* row, int count) {
+        const __m128i zero = _mm_setzero_si128();
+        int x = 0;
+        for (;x + 4 <= count;x += 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(row + 4 * x));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(pixels, zero)));
+            if (mask != 0xf)
+                return x + first_visible_scalar(row + 4 * x, 4);
+        }
+        return x + first_visible_scalar(row + 4 * x, count - x);
+    }
+    static int last_visible_sse2(const unsigned char* row, int count) {
+        const __m128i zero = _mm_setzero_si128();
+        int x = count;
+        for (;x - 4 >= 0;x -= 4) {
+            __m128i pixels = _mm_loadu_si128((const __m128i*)(row + 4 * (x - 4)));
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(pixels, zero)));
+            if (mask != 0xf)
+                return x - 4 + last_visible_scalar(row + 4 * (x - 4), 4);
+        }
+        return last_visible_scalar(row, x);
+    }
+
+    TARGET_AVX2 static int first_visible_avx2(const unsigned char* row, int count) {
+        const __m256i zero = _mm256_setzero_si256();
+        int x = 0;
+        for (;x + 8 <= count;x += 8) {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + 4 * x));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(pixels, zero)));
+            if (mask != 0xff)
+                return x + first_visible_scalar(row + 4 * x, 8);
+        }
+        return x + first_visible_sse2(row + 4 * x, count - x);
+    }
+    TARGET_AVX2 static int last_visible_avx2(const unsigned char* row, int count) {
+        const __m256i zero = _mm256_setzero_si256();
+        int x = count;
+        for (;x - 8 >= 0;x -= 8) {
+            __m256i pixels = _mm256_loadu_si256((const __m256i*)(row + 4 * (x - 8)));
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(pixels, zero)));
+            if (mask != 0xff)
+                return x - 8 + last_visible_scalar(row + 4 * (x - 8), 8);
+        }
+        return last_visible_sse2(row, x);
+    }
+
+    static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        // The OS must save the ymm registers
+        return avx2 && osxsave && (_xgetbv(0) & 6) == 6;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    bool isSupported(Kernel kernel) {
+        switch (kernel) {
+        case SCALAR:
+            return true;
+#ifdef PIXEL_CONVERT_X86
+        case SSE2:
+            return true;
+        case AVX2: {
+            static const bool has_avx2 = cpu_has_avx2();
+            return has_avx2;
+        }
+#endif
+        default:
+            return false;
+        }
+    }
+
+    Kernel getBestKernel() {
+        static const Kernel best = isSupported(AVX2) ? AVX2 : (isSupported(SSE2) ? SSE2 : SCALAR);
+        return best;
+    }
+
+    const char* getKernelName(Kernel kernel) {
+        switch (kernel) {
+        case SCALAR:
+            return "scalar";
+        case SSE2:
+            return "sse2";
+        case AVX2:
+            return "avx2";
+        }
+        return "";
+    }
+
+    void premultipliedARGBToRGBA(Kernel kernel, const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height) {
+        void (*convert_row)(const unsigned char*, unsigned char*, int) = convert_row_scalar;
+#ifdef PIXEL_CONVERT_X86
+        if (kernel == AVX2)
+            convert_row = convert_row_avx2;
+        else if (kernel == SSE2)
+            convert_row = convert_row_sse2;
+#endif
+        for (int y = 0;y < height;y++) {
+            convert_row(src + (size_t)y * src_stride, dst + (size_t)y * dst_stride, width);
+        }
+    }
+
+    void premultipliedARGBToRGBA(const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height) {
+        premultipliedARGBToRGBA(getBestKernel(), src, src_stride, dst, dst_stride, width, height);
+    }
+
+    /**
+     * Index of the first / last non zero coverage byte of an A8 row (count / -1 if none),
+     * skipping 8 transparent pixels at a time
+     */
+    static int first_covered(const unsigned char* row, int count) {
+        int x = 0;
+        for (;x + 8 <= count;x += 8) {
+            uint64_t pixels;
+            memcpy(&pixels, row + x, 8);
+            if (pixels != 0)
+                break;
+        }
+        for (;x < count;x++) {
+            if (row[x] != 0)
+                return x;
+        }
+        return count;
+    }
+    static int last_covered(const unsigned char* row, int count) {
+        int x = count;
+        for (;x >= 8;x -= 8) {
+            uint64_t pixels;
+            memcpy(&pixels, row + x - 8, 8);
+            if (pixels != 0)
+                break;
+        }
+        for (x--;x >= 0;x--) {
+            if (row[x] != 0)
+                return x;
+        }
+        return -1;
+    }
+
+    /**
+     * Bounds of the visible pixels, given the row scans of the pixel format
+     */
+    static bool find_bounds(int (*first_visible)(const unsigned char*, int), int (*last_visible)(const unsigned char*, int), int bytes_per_pixel,
+        const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h) {
+        auto row = [&](int j) { return data + (size_t)j * stride; };
+
+        int top = 0;
+        while (top < height && first_visible(row(top), width) == width)
+            top++;
+        if (top == height)
+            return false;
+        int bottom = height - 1;
+        while (bottom > top && first_visible(row(bottom), width) == width)
+            bottom--;
+
+        // Each row only needs to be scanned outside of the current bounds
+        int left = width;
+        int right = -1;
+        for (int j = top;j <= bottom;j++) {
+            left = std::min(left, first_visible(row(j), left));
+            if (right < width - 1) {
+                int last = last_visible(row(j) + bytes_per_pixel * (right + 1), width - right - 1);
+                if (last >= 0)
+                    right += 1 + last;
+            }
+        }
+        x = left;
+        y = top;
+        w = right - left + 1;
+        h = bottom - top + 1;
+        return true;
+    }
+
+    bool findOpaqueBounds(Kernel kernel, const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h) {
+        int (*first_visible)(const unsigned char*, int) = first_visible_scalar;
+        int (*last_visible)(const unsigned char*, int) = last_visible_scalar;
+#ifdef PIXEL_CONVERT_X86
+        if (kernel == AVX2) {
+            first_visible = first_visible_avx2;
+            last_visible = last_visible_avx2;
+        }
+        else if (kernel == SSE2) {
+            first_visible = first_visible_sse2;
+            last_visible = last_visible_sse2;
+        }
+#endif
+        return find_bounds(first_visible, last_visible, 4, data, width, height, stride, x, y, w, h);
+    }
+
+    bool findCoverageBounds(const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h) {
+        return find_bounds(first_covered, last_covered, 1, data, width, height, stride, x, y, w, h);
+    }
+
+    bool findOpaqueBounds(const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h) {
+        return findOpaqueBounds(getBestKernel(), data, width, height, stride, x, y, w, h);
+    }
+
+    std::vector<unsigned char> toRGBA(const unsigned char* src, int width, int height, int stride) {
+        std::vector<unsigned char> out((size_t)4 * width * height);
+        premultipliedARGBToRGBA(src, stride, out.data(), 4 * width, width, height);
+        return out;
+    }
+
+    void coverageToRGBA(const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height, uint32_t color) {
+        const unsigned char r = (color >> 16) & 0xff;
+        const unsigned char g = (color >> 8) & 0xff;
+        const unsigned char b = color & 0xff;
+        const unsigned a = color >> 24;
+        // Alpha of each coverage value
+        unsigned char alphas[256];
+        for (unsigned c = 0;c < 256;c++)
+            alphas[c] = (unsigned char)((c * a + 127) / 255);
+        for (int y = 0;y < height;y++) {
+            const unsigned char* in = src + (size_t)y * src_stride;
+            unsigned char* out = dst + (size_t)y * dst_stride;
+            for (int x = 0;x < width;x++) {
+                out[4 * x + 0] = r;
+                out[4 * x + 1] = g;
+                out[4 * x + 2] = b;
+                out[4 * x + 3] = alphas[in[x]];
+            }
+        }
+    }
+
+    std::vector<unsigned char> toRGBA(const PixelBuffer& pixels) {
+        if (pixels.empty())
+            return {};
+        if (pixels.format == PixelBuffer::A8) {
+            std::vector<unsigned char> out((size_t)4 * pixels.width * pixels.height);
+            coverageToRGBA(pixels.pixels(), pixels.stride, out.data(), 4 * pixels.width, pixels.width, pixels.height, pixels.tint);
+            return out;
+        }
+        return toRGBA(pixels.pixels(), pixels.width, pixels.height, pixels.stride);
+    }
+}
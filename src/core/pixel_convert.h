@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "pixel_buffer.h"
+
+/**
+ * Pixel kernels for the images produced by Cairo.
+ *
+ * Conversion of the pixels produced by Cairo (premultiplied, native endian ARGB32,
+ * i.e. B, G, R, A bytes on little endian machines) into straight (non premultiplied)
+ * R, G, B, A bytes, as expected by OpenGL (GL_RGBA), stb_image_write and clip.
+ *
+ * SIMD kernels are selected at runtime, depending on the CPU.
+ */
+namespace PixelConvert {
+    enum Kernel { SCALAR, SSE2, AVX2 };
+
+    /**
+     * @brief Returns true if the kernel can be used on this CPU (and build)
+     */
+    bool isSupported(Kernel kernel);
+
+    /**
+     * @brief Returns the fastest kernel supported by this CPU
+     */
+    Kernel getBestKernel();
+
+    const char* getKernelName(Kernel kernel);
+
+    /**
+     * @brief Converts premultiplied ARGB32 pixels into straight RGBA bytes
+     *
+     * Can be done in place (src == dst with the same stride)
+     *
+     * @param src_stride bytes per row of src
+     * @param dst_stride bytes per row of dst
+     */
+    void premultipliedARGBToRGBA(const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height);
+
+    /**
+     * @brief Same as premultipliedARGBToRGBA, with a given kernel (must be supported)
+     */
+    void premultipliedARGBToRGBA(Kernel kernel, const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height);
+
+    /**
+     * @brief Converts premultiplied ARGB32 pixels into a new, tightly packed RGBA buffer
+     */
+    std::vector<unsigned char> toRGBA(const unsigned char* src, int width, int height, int stride);
+
+    /**
+     * @brief Finds the smallest rectangle containing all the visible pixels of a
+     * premultiplied ARGB32 image (transparent pixels are all zeros)
+     *
+     * @param x, y, w, h filled with the rectangle
+     * @return false if the image is fully transparent
+     */
+    bool findOpaqueBounds(const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h);
+
+    /**
+     * @brief Same as findOpaqueBounds, with a given kernel (must be supported)
+     */
+    bool findOpaqueBounds(Kernel kernel, const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h);
+
+    /**
+     * @brief Same as findOpaqueBounds for A8 coverage images (one byte per pixel)
+     */
+    bool findCoverageBounds(const unsigned char* data, int width, int height, int stride, int& x, int& y, int& w, int& h);
+
+    /**
+     * @brief Colorizes A8 coverage into straight RGBA bytes: the color of every pixel is
+     * color (ARGB, as microtex::color), its alpha the coverage times the alpha of color
+     */
+    void coverageToRGBA(const unsigned char* src, int src_stride, unsigned char* dst, int dst_stride, int width, int height, uint32_t color);
+
+    /**
+     * @brief Converts rendered pixels (premultiplied ARGB32 or A8 colorized with their tint)
+     * into a new, tightly packed RGBA buffer
+     */
+    std::vector<unsigned char> toRGBA(const PixelBuffer& pixels);
+}
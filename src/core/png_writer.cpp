@@ -0,0 +1,533 @@
+#include "png_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <unordered_map>
+
+#include <zlib.h>
+
+#include "stage_profiler.h"
+
+namespace PngWriter {
+    const char* getColorModeName(ColorMode mode) {
+        switch (mode) {
+        case AUTO: return "auto";
+        case RGBA: return "rgba";
+        case GREY_ALPHA: return "grey+alpha";
+        case PALETTE: return "palette";
+        }
+        return "unknown";
+    }
+
+    static void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    static void put_chunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size) {
+        put_u32(out, (uint32_t)size);
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0)
+            out.insert(out.end(), data, data + size);
+        // The CRC covers the type and the data
+        put_u32(out, (uint32_t)crc32(0, out.data() + start, (uInt)(out.size() - start)));
+    }
+
+    static uint32_t read_pixel(const unsigned char* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    static bool is_grey(const unsigned char* rgba, int width, int height, int stride) {
+        for (int y = 0;y < height;y++) {
+            const unsigned char* row = rgba + (size_t)y * stride;
+            for (int x = 0;x < width;x++) {
+                const unsigned char* p = row + 4 * x;
+                if (p[0] != p[1] || p[0] != p[2])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Collects the colors of the image, stops (and returns false) after 256
+     */
+    static bool find_palette(const unsigned char* rgba, int width, int height, int stride, std::vector<uint32_t>& palette, std::unordered_map<uint32_t, unsigned char>& indices) {
+        for (int y = 0;y < height;y++) {
+            const unsigned char* row = rgba + (size_t)y * stride;
+            uint32_t previous = 0;
+            bool has_previous = false;
+            for (int x = 0;x < width;x++) {
+                uint32_t pixel = read_pixel(row + 4 * x);
+                // Runs of the same color are frequent (transparent background, solid strokes)
+                if (has_previous && pixel == previous)
+                    continue;
+                previous = pixel;
+                has_previous = true;
+                if (indices.find(pixel) != indices.end())
+                    continue;
+                if (palette.size() == 256)
+                    return false;
+                indices[pixel] = (unsigned char)palette.size();
+                palette.push_back(pixel);
+            }
+        }
+        return true;
+    }
+
+    static ColorMode choose_mode(const unsigned char* rgba, int width, int height, int stride, ColorMode mode, std::vector<uint32_t>& palette, std::unordered_map<uint32_t, unsigned char>& indices) {
+        if (mode == RGBA)
+            return RGBA;
+        if (mode == GREY_ALPHA)
+            return is_grey(rgba, width, height, stride) ? GREY_ALPHA : RGBA;
+        bool fits_palette = find_palette(rgba, width, height, stride, palette, indices);
+        if (mode == PALETTE)
+            return fits_palette ? PALETTE : RGBA;
+        // AUTO: the palette costs up to 5 bytes per color (PLTE + tRNS) but saves a byte per pixel over grey + alpha
+        bool grey = is_grey(rgba, width, height, stride);
+        if (fits_palette && (!grey || palette.size() * 5 < (size_t)width * height))
+            return PALETTE;
+        return grey ? GREY_ALPHA : RGBA;
+    }
+
+    /**
+     * Puts the opaque colors last, such that they can be left out of the tRNS chunk
+     */
+    static void sort_palette(std::vector<uint32_t>& palette, std::unordered_map<uint32_t, unsigned char>& indices) {
+        std::stable_sort(palette.begin(), palette.end(), [](uint32_t a, uint32_t b) { return (a >> 24) < (b >> 24); });
+        for (size_t i = 0;i < palette.size();i++)
+            indices[palette[i]] = (unsigned char)i;
+    }
+
+    static unsigned char paeth(int a, int b, int c) {
+        int p = a + b - c;
+        int pa = std::abs(p - a);
+        int pb = std::abs(p - b);
+        int pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return (unsigned char)a;
+        if (pb <= pc)
+            return (unsigned char)b;
+        return (unsigned char)c;
+    }
+
+    /**
+     * Applies the PNG filter to a row of raw (reduced) bytes, writes filter type + bytes
+     */
+    static void filter_row(int filter, const unsigned char* row, const unsigned char* prev, size_t size, int bpp, unsigned char* out) {
+        out[0] = (unsigned char)filter;
+        out++;
+        for (size_t i = 0;i < size;i++) {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            int b = prev != nullptr ? prev[i] : 0;
+            int c = prev != nullptr && i >= (size_t)bpp ? prev[i - bpp] : 0;
+            int value = row[i];
+            switch (filter) {
+            case 1: value -= a; break;
+            case 2: value -= b; break;
+            case 3: value -= (a + b) / 2; break;
+            case 4: value -= paeth(a, b, c); break;
+            default: break;
+            }
+            out[i] = (unsigned char)value;
+        }
+    }
+
+    struct ReducedImage {
+        const unsigned char* rgba = nullptr;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        ColorMode mode = RGBA;
+        int bpp = 4; // bytes per reduced pixel
+        const std::unordered_map<uint32_t, unsigned char>* indices = nullptr;
+
+        size_t rowSize() const { return (size_t)width * bpp; }
+    };
+
+    /**
+     * Converts a row of RGBA pixels to the color mode of the image
+     */
+    static void reduce_row(const ReducedImage& image, int y, unsigned char* raw) {
+        const unsigned char* src = image.rgba + (size_t)y * image.stride;
+        if (image.mode == RGBA) {
+            memcpy(raw, src, image.rowSize());
+        }
+        else if (image.mode == GREY_ALPHA) {
+            for (int x = 0;x < image.width;x++) {
+                raw[2 * x] = src[4 * x];
+                raw[2 * x + 1] = src[4 * x + 3];
+            }
+        }
+        else {
+            uint32_t previous = 0;
+            unsigned char index = 0;
+            for (int x = 0;x < image.width;x++) {
+                uint32_t pixel = read_pixel(src + 4 * x);
+                if (x == 0 || pixel != previous)
+                    index = image.indices->at(pixel);
+                previous = pixel;
+                raw[x] = index;
+            }
+        }
+    }
+
+    /**
+     * Reduces and filters the rows [begin, end) into out (one filter byte per row)
+     * The filter of each row minimizes the sum of the absolute (signed) differences,
+     * palette images are not filtered (as recommended by the PNG specification)
+     */
+    static void filter_reduced_row(const ReducedImage& image, const unsigned char* raw, const unsigned char* prev, bool adaptive, unsigned char* candidate, unsigned char* out) {
+        const size_t row_size = image.rowSize();
+        if (image.mode == PALETTE || !adaptive) {
+            filter_row(0, raw, prev, row_size, image.bpp, out);
+            return;
+        }
+        size_t best_sum = SIZE_MAX;
+        for (int filter = 0;filter <= 4;filter++) {
+            filter_row(filter, raw, prev, row_size, image.bpp, candidate);
+            size_t sum = 0;
+            for (size_t i = 1;i <= row_size;i++)
+                sum += (size_t)std::abs((int)(signed char)candidate[i]);
+            if (sum < best_sum) {
+                best_sum = sum;
+                memcpy(out, candidate, row_size + 1);
+            }
+        }
+    }
+
+    static void filter_rows(const ReducedImage& image, int begin, int end, bool adaptive, unsigned char* out) {
+        const size_t row_size = image.rowSize();
+        std::vector<unsigned char> raw(row_size), prev_raw(row_size);
+        std::vector<unsigned char> candidate(row_size + 1);
+        if (begin > 0)
+            reduce_row(image, begin - 1, prev_raw.data());
+
+        for (int y = begin;y < end;y++) {
+            reduce_row(image, y, raw.data());
+            filter_reduced_row(image, raw.data(), y > 0 ? prev_raw.data() : nullptr, adaptive, candidate.data(), out);
+            out += row_size + 1;
+            std::swap(raw, prev_raw);
+        }
+    }
+
+    /**
+     * Runs task(i) for i in [0, count) on up to threads threads (including the caller)
+     */
+    template<typename Task>
+    static void run_parallel(size_t count, int threads, Task task) {
+        std::atomic<size_t> next = 0;
+        auto worker = [&]() {
+            for (size_t i = next++;i < count;i = next++) {
+                task(i);
+            }
+            };
+        std::vector<std::thread> workers;
+        for (int i = 1;i < std::min<int>(threads, (int)count);i++) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
+
+    struct DeflateChunk {
+        size_t begin = 0;
+        size_t end = 0;
+        std::vector<unsigned char> out;
+        uLong adler = 0;
+        bool success = false;
+    };
+
+    /**
+     * Raw deflate of data[begin, end), primed with the 32 KB before begin
+     * Only the last chunk is final, the others end on a byte boundary (sync flush)
+     */
+    static void deflate_chunk(const unsigned char* data, DeflateChunk& chunk, int level, int strategy, bool last) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+            return;
+        const size_t window = 32 * 1024;
+        if (chunk.begin > 0) {
+            size_t dictionary = std::min(window, chunk.begin);
+            deflateSetDictionary(&stream, data + chunk.begin - dictionary, (uInt)dictionary);
+        }
+        const size_t size = chunk.end - chunk.begin;
+        chunk.out.resize(deflateBound(&stream, (uLong)size) + 64);
+        stream.next_in = (Bytef*)(data + chunk.begin);
+        stream.avail_in = (uInt)size;
+        stream.next_out = chunk.out.data();
+        stream.avail_out = (uInt)chunk.out.size();
+        int ret = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+        chunk.success = last ? ret == Z_STREAM_END : (ret == Z_OK && stream.avail_in == 0);
+        chunk.out.resize(chunk.out.size() - stream.avail_out);
+        deflateEnd(&stream);
+        chunk.adler = adler32(adler32(0, nullptr, 0), data + chunk.begin, (uInt)size);
+    }
+
+    /**
+     * zlib stream of the image, filtered then deflated in chunks of whole rows
+     * Each step is done in parallel over the chunks (the deflate of a chunk needs
+     * the filtered end of the previous one as dictionary)
+     */
+    static bool deflate_image(const ReducedImage& image, const Options& options, std::vector<unsigned char>& out, size_t& chunk_count) {
+        const int level = std::clamp(options.level, 0, 9);
+        const int threads = options.threads > 0 ? options.threads : (int)std::max(1u, std::thread::hardware_concurrency());
+        const size_t row_size = image.rowSize() + 1;
+        const size_t rows = (size_t)image.height;
+        size_t count = 1;
+        if (threads > 1)
+            count = std::clamp(row_size * rows / std::max<size_t>(options.chunk_bytes, 1), (size_t)1, rows);
+
+        std::vector<unsigned char> filtered(row_size * rows);
+        std::vector<DeflateChunk> chunks(count);
+        for (size_t i = 0;i < count;i++) {
+            chunks[i].begin = rows * i / count * row_size;
+            chunks[i].end = rows * (i + 1) / count * row_size;
+        }
+
+        run_parallel(count, threads, [&](size_t i) {
+            filter_rows(image, int(chunks[i].begin / row_size), int(chunks[i].end / row_size), level > 0, filtered.data() + chunks[i].begin);
+            });
+        // Filtered rows compress better without favoring the long matches
+        const int strategy = image.mode == PALETTE ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+        run_parallel(count, threads, [&](size_t i) {
+            deflate_chunk(filtered.data(), chunks[i], level, strategy, i + 1 == count);
+            });
+
+        // zlib header: deflate with a 32K window, the level is only informative
+        const unsigned cmf = 0x78;
+        unsigned flg = (level <= 1 ? 0 : level <= 5 ? 1 : level == 6 ? 2 : 3) << 6;
+        flg += 31 - (cmf * 256 + flg) % 31;
+        out.push_back((unsigned char)cmf);
+        out.push_back((unsigned char)flg);
+        uLong adler = chunks[0].adler;
+        for (size_t i = 0;i < count;i++) {
+            if (!chunks[i].success)
+                return false;
+            out.insert(out.end(), chunks[i].out.begin(), chunks[i].out.end());
+            if (i > 0)
+                adler = adler32_combine(adler, chunks[i].adler, (z_off_t)(chunks[i].end - chunks[i].begin));
+        }
+        put_u32(out, (uint32_t)adler);
+        chunk_count = count;
+        return true;
+    }
+
+    /**
+     * Signature and IHDR chunk
+     */
+    static void put_header(std::vector<unsigned char>& out, int width, int height, ColorMode mode) {
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.insert(out.end(), signature, signature + 8);
+
+        std::vector<unsigned char> header;
+        put_u32(header, (uint32_t)width);
+        put_u32(header, (uint32_t)height);
+        header.push_back(8); // bit depth
+        header.push_back(mode == RGBA ? 6 : (mode == GREY_ALPHA ? 4 : 3)); // color type
+        header.push_back(0); // deflate
+        header.push_back(0); // adaptive filtering
+        header.push_back(0); // no interlace
+        put_chunk(out, "IHDR", header.data(), header.size());
+    }
+
+    bool encode(const unsigned char* rgba, int width, int height, int stride, std::vector<unsigned char>& out, const Options& options, Result* result) {
+        StageProfiler::Scope profile(StageProfiler::ENCODE);
+        out.clear();
+        if (rgba == nullptr || width <= 0 || height <= 0)
+            return false;
+        if (stride <= 0)
+            stride = 4 * width;
+
+        std::vector<uint32_t> palette;
+        std::unordered_map<uint32_t, unsigned char> indices;
+        ColorMode mode = choose_mode(rgba, width, height, stride, options.mode, palette, indices);
+        if (mode == PALETTE)
+            sort_palette(palette, indices);
+
+        ReducedImage image;
+        image.rgba = rgba;
+        image.width = width;
+        image.height = height;
+        image.stride = stride;
+        image.mode = mode;
+        image.bpp = mode == RGBA ? 4 : (mode == GREY_ALPHA ? 2 : 1);
+        image.indices = &indices;
+        std::vector<unsigned char> idat;
+        size_t chunk_count = 0;
+        if (!deflate_image(image, options, idat, chunk_count))
+            return false;
+
+        put_header(out, width, height, mode);
+        if (mode == PALETTE) {
+            std::vector<unsigned char> colors, alphas;
+            for (uint32_t color : palette) {
+                colors.push_back((unsigned char)color);
+                colors.push_back((unsigned char)(color >> 8));
+                colors.push_back((unsigned char)(color >> 16));
+                alphas.push_back((unsigned char)(color >> 24));
+            }
+            // Trailing opaque entries can be left out of the transparency chunk
+            while (!alphas.empty() && alphas.back() == 255)
+                alphas.pop_back();
+            put_chunk(out, "PLTE", colors.data(), colors.size());
+            if (!alphas.empty())
+                put_chunk(out, "tRNS", alphas.data(), alphas.size());
+        }
+        put_chunk(out, "IDAT", idat.data(), idat.size());
+        put_chunk(out, "IEND", nullptr, 0);
+
+        if (result != nullptr) {
+            result->mode = mode;
+            result->chunks = chunk_count;
+        }
+        return true;
+    }
+
+    bool write(const std::string& path, const unsigned char* rgba, int width, int height, int stride, const Options& options, Result* result) {
+        std::vector<unsigned char> data;
+        if (!encode(rgba, width, height, stride, data, options, result))
+            return false;
+        std::ofstream file(path, std::ios::binary);
+        return (bool)file.write((const char*)data.data(), data.size());
+    }
+
+    struct RowWriter::State {
+        std::ofstream file;
+        z_stream stream;
+        bool stream_open = false;
+        bool failed = false;
+        int level = 6;
+        int rows_written = 0;
+        ReducedImage image;
+        std::vector<unsigned char> raw, prev_raw, candidate, filtered;
+        std::vector<unsigned char> deflated; // output buffer of zlib
+        std::vector<unsigned char> idat; // deflated data waiting to be written as an IDAT chunk
+
+        // Deflated data is written in IDAT chunks of at least this size (except the last one)
+        static constexpr size_t idat_size = 256 * 1024;
+
+        void writeBytes(const std::vector<unsigned char>& bytes) {
+            if (!file.write((const char*)bytes.data(), bytes.size()))
+                failed = true;
+        }
+
+        void writeIdat() {
+            std::vector<unsigned char> chunk;
+            put_chunk(chunk, "IDAT", idat.data(), idat.size());
+            writeBytes(chunk);
+            idat.clear();
+        }
+
+        /**
+         * Deflates the given bytes, writing IDAT chunks as the deflated data grows
+         */
+        bool deflateBytes(const unsigned char* data, size_t size, int flush) {
+            stream.next_in = (Bytef*)data;
+            stream.avail_in = (uInt)size;
+            int ret = Z_OK;
+            do {
+                stream.next_out = deflated.data();
+                stream.avail_out = (uInt)deflated.size();
+                ret = deflate(&stream, flush);
+                if (ret == Z_STREAM_ERROR)
+                    return false;
+                idat.insert(idat.end(), deflated.data(), deflated.data() + (deflated.size() - stream.avail_out));
+                if (idat.size() >= idat_size)
+                    writeIdat();
+            } while (stream.avail_out == 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+            return !failed;
+        }
+    };
+
+    RowWriter::RowWriter(const std::string& path, int width, int height, const Options& options) : m_state(std::make_unique<State>()) {
+        State& state = *m_state;
+        state.image.width = width;
+        state.image.height = height;
+        state.image.mode = options.mode == GREY_ALPHA ? GREY_ALPHA : RGBA;
+        state.image.bpp = state.image.mode == GREY_ALPHA ? 2 : 4;
+        state.level = std::clamp(options.level, 0, 9);
+        if (width <= 0 || height <= 0) {
+            state.failed = true;
+            return;
+        }
+        state.file.open(path, std::ios::binary);
+        memset(&state.stream, 0, sizeof(state.stream));
+        if (!state.file.is_open() || deflateInit2(&state.stream, state.level, Z_DEFLATED, 15, 8, Z_FILTERED) != Z_OK) {
+            state.failed = true;
+            return;
+        }
+        state.stream_open = true;
+
+        const size_t row_size = state.image.rowSize();
+        state.raw.resize(row_size);
+        state.prev_raw.resize(row_size);
+        state.candidate.resize(row_size + 1);
+        state.filtered.resize(row_size + 1);
+        state.deflated.resize(64 * 1024);
+
+        std::vector<unsigned char> header;
+        put_header(header, width, height, state.image.mode);
+        state.writeBytes(header);
+    }
+
+    RowWriter::~RowWriter() {
+        if (m_state->stream_open)
+            deflateEnd(&m_state->stream);
+    }
+
+    bool RowWriter::isValid() const {
+        return !m_state->failed;
+    }
+
+    bool RowWriter::writeRows(const unsigned char* rgba, int rows, int stride) {
+        StageProfiler::Scope profile(StageProfiler::ENCODE);
+        State& state = *m_state;
+        if (state.failed || rgba == nullptr || rows <= 0 || state.rows_written + rows > state.image.height)
+            return false;
+        // The rows are reduced relative to the given pointer, the previous row is kept from the last call
+        state.image.rgba = rgba;
+        state.image.stride = stride > 0 ? stride : 4 * state.image.width;
+        for (int y = 0;y < rows;y++) {
+            reduce_row(state.image, y, state.raw.data());
+            const unsigned char* prev = state.rows_written > 0 ? state.prev_raw.data() : nullptr;
+            filter_reduced_row(state.image, state.raw.data(), prev, state.level > 0, state.candidate.data(), state.filtered.data());
+            if (!state.deflateBytes(state.filtered.data(), state.filtered.size(), Z_NO_FLUSH)) {
+                state.failed = true;
+                return false;
+            }
+            std::swap(state.raw, state.prev_raw);
+            state.rows_written++;
+        }
+        return true;
+    }
+
+    bool RowWriter::finish() {
+        StageProfiler::Scope profile(StageProfiler::ENCODE);
+        State& state = *m_state;
+        if (state.failed || state.rows_written != state.image.height)
+            return false;
+        if (!state.deflateBytes(nullptr, 0, Z_FINISH)) {
+            state.failed = true;
+            return false;
+        }
+        if (!state.idat.empty())
+            state.writeIdat();
+        std::vector<unsigned char> end;
+        put_chunk(end, "IEND", nullptr, 0);
+        state.writeBytes(end);
+        state.file.close();
+        return !state.failed;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * PNG encoder for the rendered formulas, built on zlib.
+ *
+ * Formulas are a single color plus alpha, so the pixels are first reduced to the
+ * smallest exact color type (palette or grey + alpha), then filtered and deflated.
+ * Large images are deflated in parallel: the filtered rows are split into chunks
+ * compressed independently (each primed with the end of the previous one as dictionary)
+ * and concatenated into a single zlib stream, whose checksum is combined from the chunks.
+ *
+ * Images too large to be held in memory (tiled formulas) are streamed with a RowWriter.
+ */
+namespace PngWriter {
+    enum ColorMode {
+        AUTO,       // smallest exact mode among the ones below
+        RGBA,       // 8 bits R, G, B, A
+        GREY_ALPHA, // 8 bits grey + alpha, only if R == G == B everywhere
+        PALETTE     // up to 256 RGBA colors, only if the image has no more
+    };
+
+    struct Options {
+        int level = 6; // zlib compression level, 0 (store) to 9 (smallest)
+        ColorMode mode = AUTO;
+        int threads = 1; // 0 -> number of hardware threads
+        size_t chunk_bytes = 256 * 1024; // filtered bytes deflated by each thread (at least)
+    };
+
+    struct Result {
+        ColorMode mode = RGBA; // mode actually written
+        size_t chunks = 0;     // number of chunks deflated (in parallel if > 1)
+    };
+
+    const char* getColorModeName(ColorMode mode);
+
+    /**
+     * @brief Encodes straight alpha RGBA pixels (as given to stb_image_write) as a PNG file in memory
+     *
+     * @param rgba first pixel, with stride bytes per row
+     * @param out replaced by the file content
+     * @param result optional, filled with what has been written
+     * @return false if the image is empty or zlib failed
+     */
+    bool encode(const unsigned char* rgba, int width, int height, int stride, std::vector<unsigned char>& out, const Options& options = Options(), Result* result = nullptr);
+
+    /**
+     * @brief Same as encode, then writes the file
+     *
+     * @return false if the image could not be encoded or written
+     */
+    bool write(const std::string& path, const unsigned char* rgba, int width, int height, int stride, const Options& options = Options(), Result* result = nullptr);
+
+    /**
+     * @brief Writes a PNG file row by row, only holding the current rows in memory
+     *
+     * The image cannot be scanned beforehand: options.mode GREY_ALPHA is trusted
+     * (R == G == B must hold for every pixel), AUTO and PALETTE are written as RGBA.
+     * Rows are filtered and deflated on the calling thread as they are given.
+     */
+    class RowWriter {
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    public:
+        RowWriter(const std::string& path, int width, int height, const Options& options = Options());
+        ~RowWriter();
+        RowWriter(const RowWriter&) = delete;
+        void operator=(const RowWriter&) = delete;
+
+        /**
+         * @brief Returns false if the file could not be created or a write failed
+         */
+        bool isValid() const;
+
+        /**
+         * @brief Appends the next rows of straight alpha RGBA pixels
+         *
+         * @param rgba first pixel, with stride bytes per row
+         */
+        bool writeRows(const unsigned char* rgba, int rows, int stride);
+
+        /**
+         * @brief Completes the file, all the rows must have been written
+         */
+        bool finish();
+    };
+}
@@ -0,0 +1,134 @@
+#include "stage_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+StageProfiler::StageProfiler() {
+    m_origin = Clock::now();
+}
+
+StageProfiler& StageProfiler::getInstance() {
+    static StageProfiler profiler;
+    return profiler;
+}
+
+const char* StageProfiler::getStageName(Stage stage) {
+    switch (stage) {
+    case PARSE: return "parse";
+    case LAYOUT: return "layout";
+    case REPLAY: return "replay";
+    case UPLOAD: return "upload";
+    case ENCODE: return "encode";
+    default: return "unknown";
+    }
+}
+
+void StageProfiler::record(Stage stage, Clock::time_point start, Clock::time_point end) {
+    if (!m_enabled || stage >= STAGE_COUNT)
+        return;
+    const Clock::duration duration = end - start;
+    const double ms = std::chrono::duration<double, std::milli>(duration).count();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& window = m_windows[stage];
+    if (window.size() < window_size)
+        window.push_back(ms);
+    else
+        window[m_window_next[stage]] = ms;
+    m_window_next[stage] = (m_window_next[stage] + 1) % window_size;
+    m_counts[stage]++;
+    m_totals[stage] += ms;
+
+    auto thread = m_threads.emplace(std::this_thread::get_id(), (int)m_threads.size()).first->second;
+    Span span = { stage, thread, start, duration };
+    if (m_spans.size() < trace_size)
+        m_spans.push_back(span);
+    else
+        m_spans[m_span_next] = span;
+    m_span_next = (m_span_next + 1) % trace_size;
+}
+
+StageProfiler::StageStats StageProfiler::getStats(Stage stage) {
+    StageStats stats;
+    if (stage >= STAGE_COUNT)
+        return stats;
+    std::vector<double> samples;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        samples = m_windows[stage];
+        stats.count = m_counts[stage];
+        stats.total_ms = m_totals[stage];
+    }
+    if (samples.empty())
+        return stats;
+    std::sort(samples.begin(), samples.end());
+    // Nearest rank
+    auto percentile = [&samples](double p) {
+        size_t rank = (size_t)std::ceil(p * samples.size());
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+        };
+    stats.p50_ms = percentile(0.50);
+    stats.p95_ms = percentile(0.95);
+    stats.p99_ms = percentile(0.99);
+    stats.max_ms = samples.back();
+    return stats;
+}
+
+double StageProfiler::getTotalMs(Stage stage) {
+    if (stage >= STAGE_COUNT)
+        return 0.;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_totals[stage];
+}
+
+void StageProfiler::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int i = 0;i < STAGE_COUNT;i++) {
+        m_windows[i].clear();
+        m_window_next[i] = 0;
+        m_counts[i] = 0;
+        m_totals[i] = 0.;
+    }
+    m_spans.clear();
+    m_span_next = 0;
+}
+
+bool StageProfiler::writeCSV(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+    file << "stage,count,total_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (int i = 0;i < STAGE_COUNT;i++) {
+        auto stats = getStats((Stage)i);
+        file << getStageName((Stage)i) << "," << stats.count << "," << stats.total_ms << ","
+            << stats.p50_ms << "," << stats.p95_ms << "," << stats.p99_ms << "," << stats.max_ms << "\n";
+    }
+    return file.good();
+}
+
+bool StageProfiler::writeChromeTrace(const std::string& path) {
+    std::vector<Span> spans;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // Oldest first
+        spans.assign(m_spans.begin() + (m_spans.size() < trace_size ? 0 : m_span_next), m_spans.end());
+        spans.insert(spans.end(), m_spans.begin(), m_spans.begin() + (m_spans.size() < trace_size ? 0 : m_span_next));
+    }
+    std::ofstream file(path);
+    if (!file.is_open())
+        return false;
+    file << "{\"traceEvents\":[";
+    char event[256];
+    for (size_t i = 0;i < spans.size();i++) {
+        const Span& span = spans[i];
+        // Microseconds since the creation of the profiler
+        double start_us = std::chrono::duration<double, std::micro>(span.start - m_origin).count();
+        double duration_us = std::chrono::duration<double, std::micro>(span.duration).count();
+        snprintf(event, sizeof(event), "%s\n{\"name\":\"%s\",\"cat\":\"render\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+            i == 0 ? "" : ",", getStageName(span.stage), start_us, duration_us, span.thread);
+        file << event;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return file.good();
+}
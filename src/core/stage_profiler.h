@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Monotonic timers of the stages of the render pipeline, from any thread
+ *
+ * Each stage keeps its last window_size durations (rolling percentiles) and the
+ * last trace_size timed spans of all the stages (Chrome trace events).
+ */
+class StageProfiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum Stage {
+        PARSE,   // MicroTeX::parse
+        LAYOUT,  // Render::draw into Graphics2D_abstract
+        REPLAY,  // replay of the recorded calls into a Cairo_Painter
+        UPLOAD,  // Image::setImage
+        ENCODE,  // PNG encoding
+        STAGE_COUNT
+    };
+
+    static constexpr size_t window_size = 1024;
+    static constexpr size_t trace_size = 16384;
+
+    struct StageStats {
+        size_t count = 0; // since the start (or the last reset)
+        double p50_ms = 0.;
+        double p95_ms = 0.;
+        double p99_ms = 0.;
+        double max_ms = 0.; // of the window
+        double total_ms = 0.;
+    };
+
+    /**
+     * @brief Times a stage from its construction to its destruction
+     */
+    class Scope {
+    private:
+        StageProfiler& m_profiler;
+        Stage m_stage;
+        Clock::time_point m_start;
+    public:
+        explicit Scope(Stage stage) : m_profiler(StageProfiler::getInstance()), m_stage(stage), m_start(Clock::now()) {}
+        ~Scope() { m_profiler.record(m_stage, m_start, Clock::now()); }
+
+        Scope(const Scope&) = delete;
+        void operator=(const Scope&) = delete;
+    };
+private:
+    struct Span {
+        Stage stage;
+        int thread;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    std::mutex m_mutex;
+    Clock::time_point m_origin;
+    std::atomic<bool> m_enabled = true;
+
+    // Ring buffers: the next sample / span replaces the oldest one once full
+    std::vector<double> m_windows[STAGE_COUNT];
+    size_t m_window_next[STAGE_COUNT] = {};
+    size_t m_counts[STAGE_COUNT] = {};
+    double m_totals[STAGE_COUNT] = {};
+    std::vector<Span> m_spans;
+    size_t m_span_next = 0;
+    std::unordered_map<std::thread::id, int> m_threads;
+
+    StageProfiler();
+public:
+    StageProfiler(const StageProfiler&) = delete;
+    void operator=(const StageProfiler&) = delete;
+
+    static StageProfiler& getInstance();
+
+    static const char* getStageName(Stage stage);
+
+    /**
+     * @brief Records a span of a stage (ignored if disabled)
+     */
+    void record(Stage stage, Clock::time_point start, Clock::time_point end);
+
+    /**
+     * @brief Returns the percentiles of the last window_size durations of the stage
+     */
+    StageStats getStats(Stage stage);
+
+    /**
+     * @brief Total time spent in the stage since the start (or the last reset)
+     */
+    double getTotalMs(Stage stage);
+
+    void setEnabled(bool enabled) { m_enabled = enabled; }
+    bool isEnabled() const { return m_enabled; }
+
+    void reset();
+
+    /**
+     * @brief Writes the statistics of each stage as CSV
+     *
+     * @return false if the file could not be written
+     */
+    bool writeCSV(const std::string& path);
+
+    /**
+     * @brief Writes the recorded spans in the Chrome trace event format
+     * (chrome://tracing, Perfetto), one track per thread
+     *
+     * @return false if the file could not be written
+     */
+    bool writeChromeTrace(const std::string& path);
+};
@@ -0,0 +1,90 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+// Set on the workers and on a thread running a loop: a loop started from inside a loop runs serially
+static thread_local bool in_parallel_loop = false;
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0)
+        threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1;i < threads;i++) {
+        m_workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::getInstance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::work() {
+    in_parallel_loop = true;
+    uint64_t seen_generation = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [&]() { return m_stop || m_generation != seen_generation; });
+        if (m_stop)
+            return;
+        seen_generation = m_generation;
+        if (m_helpers == 0)
+            continue;
+        m_helpers--;
+        m_active++;
+        const auto* task = m_task;
+        const size_t count = m_count;
+        lock.unlock();
+        for (size_t i = m_next++;i < count;i = m_next++) {
+            (*task)(i);
+        }
+        lock.lock();
+        if (--m_active == 0)
+            m_done.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task, int max_threads) {
+    if (count == 0)
+        return;
+    std::unique_lock<std::mutex> loop(m_loop_mutex, std::defer_lock);
+    size_t threads = max_threads > 0 ? std::min<size_t>(max_threads, getThreadCount()) : getThreadCount();
+    threads = std::min(threads, count);
+    if (threads <= 1 || in_parallel_loop || !loop.try_lock()) {
+        for (size_t i = 0;i < count;i++) {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_helpers = threads - 1;
+        m_generation++;
+    }
+    m_wake.notify_all();
+    in_parallel_loop = true;
+    for (size_t i = m_next++;i < count;i = m_next++) {
+        task(i);
+    }
+    in_parallel_loop = false;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // Workers waking up from now on have nothing left to do
+    m_helpers = 0;
+    m_done.wait(lock, [this]() { return m_active == 0; });
+    m_task = nullptr;
+}
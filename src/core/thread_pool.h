@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of worker threads running parallel loops
+ *
+ * parallelFor blocks until the whole loop is done, the calling thread takes part in it.
+ * Only one loop runs on the workers at a time: a loop submitted while another one
+ * is running (or from inside a loop) is run on the calling thread alone, such that
+ * callers that are already parallel (e.g. the batch renderer) never wait for each other.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::mutex m_loop_mutex; // held by the thread running a loop
+
+    // Current loop, guarded by m_mutex (except m_next)
+    const std::function<void(size_t)>* m_task = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next = 0;
+    size_t m_helpers = 0; // number of workers that may still join the loop
+    size_t m_active = 0;  // workers inside the loop
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    void work();
+public:
+    /**
+     * @param threads total number of threads running a loop (including the caller),
+     * 0 -> number of hardware threads
+     */
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    void operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Returns the shared pool, with one thread per hardware thread
+     */
+    static ThreadPool& getInstance();
+
+    /**
+     * @brief Returns the number of threads running a loop (workers + caller)
+     */
+    int getThreadCount() const { return (int)m_workers.size() + 1; }
+
+    /**
+     * @brief Runs task(i) for i in [0, count), on up to max_threads threads (0 -> all)
+     */
+    void parallelFor(size_t count, const std::function<void(size_t)>& task, int max_threads = 0);
+};
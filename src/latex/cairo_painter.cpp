@@ -1,7 +1,12 @@
 #include "cairo_painter.h"
 
+#include <cmath>
+
 using namespace microtex;
 
+// Above this size (in pixels), a path is filled directly instead of being cached
+static constexpr int max_glyph_mask_area = 256 * 256;
+
 inline float max(float a, float b) {
     if (a > b)
         return a;
@@ -15,37 +20,107 @@ inline float min(float a, float b) {
 
 void Cairo_Painter::destroy() {
     if (m_surface != nullptr) {
-        cairo_surface_destroy(m_surface);
-        cairo_destroy(m_context);
+        SurfacePool::getThreadInstance().release(m_pooled_surface);
+        m_pooled_surface = SurfacePool::Surface();
+        m_surface = nullptr;
+        m_context = nullptr;
+        m_image_data = nullptr;
     }
 }
 
 void Cairo_Painter::start(ImVec2 dimensions, ImVec2 scale, ImVec2 inner_padding) {
+    startRegion(
+        ImVec2(-inner_padding.x, -inner_padding.y),
+        ImVec2(dimensions.x + 2 * inner_padding.x, dimensions.y + 2 * inner_padding.y),
+        scale
+    );
+}
+
+void Cairo_Painter::startRegion(ImVec2 origin, ImVec2 size, ImVec2 scale) {
+    destroy();
+
+    // The pooled surface can be larger than the image, the image data then uses its stride
+    m_pooled_surface = SurfacePool::getThreadInstance().acquire(int(scale.x * size.x), int(scale.y * size.y), m_coverage ? CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32);
+    m_surface = m_pooled_surface.surface;
+    beginContext(m_pooled_surface.context, origin, size, scale);
+}
+
+void Cairo_Painter::startTile(ImVec2 origin, ImVec2 scale, int x, int y, int width, int height) {
+    destroy();
+
+    m_pooled_surface = SurfacePool::getThreadInstance().acquire(width, height, m_coverage ? CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32);
+    m_surface = m_pooled_surface.surface;
+    beginTile(m_pooled_surface.context, origin, scale, x, y, width, height);
+}
+
+void Cairo_Painter::startTarget(cairo_t* context, ImVec2 origin, ImVec2 scale, int x, int y, int width, int height) {
     destroy();
+    beginTile(context, origin, scale, x, y, width, height);
+}
+
+void Cairo_Painter::beginTile(cairo_t* context, ImVec2 origin, ImVec2 scale, int x, int y, int width, int height) {
+    beginContext(context, origin, ImVec2(width / scale.x, height / scale.y), scale);
+    // Exact pixel sizes, the division above can round down
+    m_dimensions = ImVec2((float)width, (float)height);
+    m_device_offset = ImVec2((float)x, (float)y);
+    resetMatrix();
+}
+
+void Cairo_Painter::beginContext(cairo_t* context, ImVec2 origin, ImVec2 size, ImVec2 scale) {
+    m_context = context;
     m_painting = true;
 
-    m_dimensions = ImVec2(
-        int(scale.x * (dimensions.x + 2 * inner_padding.x)),
-        int(scale.y * (dimensions.y + 2 * inner_padding.y))
-    );
+    m_dimensions = ImVec2(int(scale.x * size.x), int(scale.y * size.y));
     m_scale = scale;
-    m_offset = inner_padding;
-    m_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, m_dimensions.x, m_dimensions.y);
-    m_context = cairo_create(m_surface);
+    m_offset = ImVec2(-origin.x, -origin.y);
+    m_device_offset = ImVec2(0.f, 0.f);
+    m_recording_path = false;
+    resetMatrix();
+    // Pooled contexts get their state back when released
+    cairo_set_antialias(m_context, m_antialias);
+
+    // Glyphs are placed by MicroTeX: no hinting, which would move them away from the layout
+    cairo_font_options_t* options = cairo_font_options_create();
+    cairo_font_options_set_hint_style(options, CAIRO_HINT_STYLE_NONE);
+    cairo_font_options_set_hint_metrics(options, CAIRO_HINT_METRICS_OFF);
+    cairo_font_options_set_antialias(options, m_antialias);
+    cairo_set_font_options(m_context, options);
+    cairo_font_options_destroy(options);
+    m_font_face = nullptr;
+    m_font_size = 0.f;
 
     setColor(BLACK);
     setStroke(Stroke());
 }
 void Cairo_Painter::finish() {
+    if (m_painting && m_surface == nullptr) {
+        // Target owned by the caller
+        cairo_surface_flush(cairo_get_target(m_context));
+        endContext();
+        return;
+    }
     if (m_dimensions.x > 0 && m_dimensions.y > 0 && m_painting) {
         // data is a borrowed pointer, its creation / destruction is managed by cairo
+        cairo_surface_flush(m_surface);
         m_image_data = cairo_image_surface_get_data(m_surface);
         m_painting = false;
     }
 }
 
+int Cairo_Painter::getImageStride() {
+    if (m_surface == nullptr)
+        return 0;
+    return cairo_image_surface_get_stride(m_surface);
+}
+
 ImVec2 Cairo_Painter::getRealPos(float x, float y) {
-    return ImVec2(m_scale.x * (x + m_sx * m_offset.x), m_scale.y * (y + m_sy * m_offset.y));
+    return ImVec2(m_scale.x * x, m_scale.y * y);
+}
+
+void Cairo_Painter::resetMatrix() {
+    // The offset is applied once, in device space, below all the transformations of MicroTeX
+    cairo_identity_matrix(m_context);
+    cairo_translate(m_context, (double)m_scale.x * m_offset.x - m_device_offset.x, (double)m_scale.y * m_offset.y - m_device_offset.y);
 }
 
 Cairo_Painter::Cairo_Painter() {
@@ -55,8 +130,20 @@ Cairo_Painter::~Cairo_Painter() {
     destroy();
 }
 
+void Cairo_Painter::setColorReplacement(color from, color to) {
+    m_replace_color = true;
+    m_replaced_color = from;
+    m_replacement_color = to;
+}
+
 void Cairo_Painter::setColor(color c) {
+    if (m_replace_color && c == m_replaced_color)
+        c = m_replacement_color;
     m_color = c;
+    if (m_coverage) {
+        cairo_set_source_rgba(m_context, 0., 0., 0., 1.);
+        return;
+    }
     const double a = color_a(c) / 255.;
     const double r = color_r(c) / 255.;
     const double g = color_g(c) / 255.;
@@ -116,11 +203,25 @@ void Cairo_Painter::setDash(const std::vector<float>& dash) {
     }
 }
 
-void Cairo_Painter::setFont(const std::string&, float, int, const std::string&) {
+void Cairo_Painter::applyFont() {
+    if (m_font_face == nullptr)
+        return;
+    cairo_set_font_face(m_context, m_font_face);
+    cairo_matrix_t matrix;
+    cairo_matrix_init_scale(&matrix, (double)m_font_size * m_scale.x, (double)m_font_size * m_scale.y);
+    cairo_set_font_matrix(m_context, &matrix);
 }
 
+void Cairo_Painter::setFont(const std::string& path, float size, int, const std::string&) {
+    m_font_face = FontRegistry::getInstance().getFace(path);
+    m_font_size = size;
+    applyFont();
+}
 
-void Cairo_Painter::setFontSize(float) {
+
+void Cairo_Painter::setFontSize(float size) {
+    m_font_size = size;
+    applyFont();
 }
 
 void Cairo_Painter::translate(float dx, float dy) {
@@ -129,8 +230,6 @@ void Cairo_Painter::translate(float dx, float dy) {
 }
 
 void Cairo_Painter::scale(float sx, float sy) {
-    m_sx *= sx;
-    m_sy *= sy;
     cairo_scale(m_context, (double)sx, (double)sy);
 }
 
@@ -146,28 +245,48 @@ void Cairo_Painter::rotate(float angle, float px, float py) {
 }
 
 void Cairo_Painter::reset() {
-    cairo_identity_matrix(m_context);
-    m_sx = m_sy = 1.f;
+    resetMatrix();
 }
 
-void Cairo_Painter::drawGlyph(u16, float, float) {
+void Cairo_Painter::drawGlyph(u16 glyph, float x, float y) {
+    if (m_font_face == nullptr)
+        return;
+    ImVec2 pos = getRealPos(x, y);
+    cairo_glyph_t cairo_glyph = { glyph, (double)pos.x, (double)pos.y };
+    cairo_show_glyphs(m_context, &cairo_glyph, 1);
 }
 
 void Cairo_Painter::beginPath(i32 id) {
     cairo_new_path(m_context);
+    // An id < 0 means that the path is not cacheable
+    m_recording_path = id >= 0 && m_cache_glyphs && GlyphCache::isEnabled();
+    m_path_id = id;
+    m_path_ops.clear();
+    m_path_coords.clear();
+}
+
+void Cairo_Painter::recordPathOp(PathOp op, std::initializer_list<float> coords) {
+    m_path_ops.push_back(op);
+    m_path_coords.insert(m_path_coords.end(), coords);
 }
 
 void Cairo_Painter::moveTo(float x, float y) {
+    if (m_recording_path)
+        return recordPathOp(PATH_MOVE, { x, y });
     ImVec2 pos = getRealPos(x, y);
     cairo_move_to(m_context, (double)pos.x, (double)pos.y);
 }
 
 void Cairo_Painter::lineTo(float x, float y) {
+    if (m_recording_path)
+        return recordPathOp(PATH_LINE, { x, y });
     ImVec2 pos = getRealPos(x, y);
     cairo_line_to(m_context, pos.x, pos.y);
 }
 
 void Cairo_Painter::cubicTo(float x1, float y1, float x2, float y2, float x3, float y3) {
+    if (m_recording_path)
+        return recordPathOp(PATH_CUBIC, { x1, y1, x2, y2, x3, y3 });
     ImVec2 p1 = getRealPos(x1, y1);
     ImVec2 p2 = getRealPos(x2, y2);
     ImVec2 p3 = getRealPos(x3, y3);
@@ -175,6 +294,8 @@ void Cairo_Painter::cubicTo(float x1, float y1, float x2, float y2, float x3, fl
 }
 
 void Cairo_Painter::quadTo(float x1, float y1, float x2, float y2) {
+    if (m_recording_path)
+        return recordPathOp(PATH_QUAD, { x1, y1, x2, y2 });
     // See https://en.wikipedia.org/wiki/B%C3%A9zier_curve#Degree_elevation
     // and https://lists.cairographics.org/archives/cairo/2010-April/019691.html
     // for details
@@ -188,18 +309,167 @@ void Cairo_Painter::quadTo(float x1, float y1, float x2, float y2) {
         2.0 / 3.0 * p1.y + 1.0 / 3.0 * y0,
         2.0 / 3.0 * p1.x + 1.0 / 3.0 * p2.x,
         2.0 / 3.0 * p1.y + 1.0 / 3.0 * p2.y,
-        y1, y2
+        p2.x, p2.y
     );
 }
 
 void Cairo_Painter::closePath() {
+    if (m_recording_path)
+        return recordPathOp(PATH_CLOSE, {});
     cairo_close_path(m_context);
 }
 
 void Cairo_Painter::fillPath(i32 id) {
+    if (m_recording_path) {
+        m_recording_path = false;
+        fillRecordedPath();
+        return;
+    }
     cairo_fill(m_context);
 }
 
+template<typename Transform>
+void Cairo_Painter::replayRecordedPath(cairo_t* cr, Transform transform) {
+    const float* c = m_path_coords.data();
+    float cx = 0.f, cy = 0.f; // current point, in path space
+    for (u8 op : m_path_ops) {
+        switch (op) {
+        case PATH_MOVE: {
+            ImVec2 p = transform(c[0], c[1]);
+            cairo_move_to(cr, p.x, p.y);
+            cx = c[0]; cy = c[1];
+            c += 2;
+            break;
+        }
+        case PATH_LINE: {
+            ImVec2 p = transform(c[0], c[1]);
+            cairo_line_to(cr, p.x, p.y);
+            cx = c[0]; cy = c[1];
+            c += 2;
+            break;
+        }
+        case PATH_CUBIC: {
+            ImVec2 p1 = transform(c[0], c[1]);
+            ImVec2 p2 = transform(c[2], c[3]);
+            ImVec2 p3 = transform(c[4], c[5]);
+            cairo_curve_to(cr, p1.x, p1.y, p2.x, p2.y, p3.x, p3.y);
+            cx = c[4]; cy = c[5];
+            c += 6;
+            break;
+        }
+        case PATH_QUAD: {
+            ImVec2 p1 = transform(2.f / 3.f * c[0] + 1.f / 3.f * cx, 2.f / 3.f * c[1] + 1.f / 3.f * cy);
+            ImVec2 p2 = transform(2.f / 3.f * c[0] + 1.f / 3.f * c[2], 2.f / 3.f * c[1] + 1.f / 3.f * c[3]);
+            ImVec2 p3 = transform(c[2], c[3]);
+            cairo_curve_to(cr, p1.x, p1.y, p2.x, p2.y, p3.x, p3.y);
+            cx = c[2]; cy = c[3];
+            c += 4;
+            break;
+        }
+        case PATH_CLOSE:
+            cairo_close_path(cr);
+            break;
+        }
+    }
+}
+
+void Cairo_Painter::fillRecordedPath() {
+    if (m_path_ops.empty() || m_path_coords.size() < 2)
+        return;
+
+    // The path is made relative to its first point, such that the same glyph
+    // gives the same key wherever it is drawn
+    const float x0 = m_path_coords[0];
+    const float y0 = m_path_coords[1];
+
+    // Path space -> device space: getRealPos, then the current matrix of cairo
+    cairo_matrix_t ctm;
+    cairo_get_matrix(m_context, &ctm);
+    GlyphCache::Key key;
+    key.xx = float(ctm.xx * m_scale.x);
+    key.yx = float(ctm.yx * m_scale.x);
+    key.xy = float(ctm.xy * m_scale.y);
+    key.yy = float(ctm.yy * m_scale.y);
+    key.antialias = (u8)m_antialias;
+
+    ImVec2 origin_pos = getRealPos(x0, y0);
+    double ox = origin_pos.x, oy = origin_pos.y;
+    cairo_user_to_device(m_context, &ox, &oy);
+    const double fx = std::floor(ox);
+    const double fy = std::floor(oy);
+    const int buckets = GlyphCache::subpixel_buckets;
+    key.bucket_x = (u8)std::min(buckets - 1, int((ox - fx) * buckets));
+    key.bucket_y = (u8)std::min(buckets - 1, int((oy - fy) * buckets));
+
+    // FNV-1a of the path id, operations and relative coordinates
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto hash_bytes = [&hash](const void* data, size_t size) {
+        auto bytes = (const unsigned char*)data;
+        for (size_t i = 0;i < size;i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+        };
+    hash_bytes(&m_path_id, sizeof(m_path_id));
+    hash_bytes(m_path_ops.data(), m_path_ops.size());
+    for (size_t i = 0;i < m_path_coords.size();i++) {
+        float value = m_path_coords[i] - (i % 2 == 0 ? x0 : y0);
+        hash_bytes(&value, sizeof(value));
+    }
+    key.path_hash = hash;
+
+    // Relative path space -> mask space (up to the integer offset of the mask)
+    const float sub_x = (key.bucket_x + 0.5f) / buckets;
+    const float sub_y = (key.bucket_y + 0.5f) / buckets;
+    auto to_mask = [&](float x, float y) {
+        x -= x0;
+        y -= y0;
+        return ImVec2(key.xx * x + key.xy * y + sub_x, key.yx * x + key.yy * y + sub_y);
+        };
+
+    auto& cache = GlyphCache::getThreadInstance();
+    const GlyphCache::Mask* mask = cache.get(key);
+    if (mask == nullptr) {
+        // Bounds of the control points, which contain the curves
+        float min_x = 0.f, min_y = 0.f, max_x = 0.f, max_y = 0.f;
+        for (size_t i = 0;i + 1 < m_path_coords.size();i += 2) {
+            ImVec2 p = to_mask(m_path_coords[i], m_path_coords[i + 1]);
+            min_x = min(min_x, p.x);
+            min_y = min(min_y, p.y);
+            max_x = max(max_x, p.x);
+            max_y = max(max_y, p.y);
+        }
+        const int left = (int)std::floor(min_x) - 1;
+        const int top = (int)std::floor(min_y) - 1;
+        const int width = (int)std::ceil(max_x) + 1 - left;
+        const int height = (int)std::ceil(max_y) + 1 - top;
+
+        if (width * height > max_glyph_mask_area) {
+            replayRecordedPath(m_context, [this](float x, float y) { return getRealPos(x, y); });
+            cairo_fill(m_context);
+            return;
+        }
+
+        cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_A8, width, height);
+        cairo_t* cr = cairo_create(surface);
+        cairo_set_antialias(cr, m_antialias);
+        replayRecordedPath(cr, [&](float x, float y) {
+            ImVec2 p = to_mask(x, y);
+            return ImVec2(p.x - left, p.y - top);
+            });
+        cairo_fill(cr);
+        cairo_destroy(cr);
+        cairo_surface_flush(surface);
+        mask = cache.put(key, surface, left, top);
+    }
+
+    // Composite the coverage with the current source (color)
+    cairo_save(m_context);
+    cairo_identity_matrix(m_context);
+    cairo_mask_surface(m_context, mask->surface, fx + mask->x, fy + mask->y);
+    cairo_restore(m_context);
+}
+
 void Cairo_Painter::drawLine(float x1, float y1, float x2, float y2) {
     ImVec2 p1 = getRealPos(x1, y1);
     ImVec2 p2 = getRealPos(x2, y2);
@@ -2,44 +2,128 @@
 #include "cairo.h"
 
 #include "graphic_abstract.h"
+#include "glyph_cache.h"
+#include "font_registry.h"
+#include "surface_pool.h"
 #include "core/image.h"
 
 namespace microtex {
+    /**
+     * @brief Painter rasterizing into an ARGB32 cairo surface
+     *
+     * Surfaces come from the SurfacePool of the thread, so a painter must
+     * stay on the thread where start() has been called.
+     */
     class Cairo_Painter : public Painter {
     private:
+        SurfacePool::Surface m_pooled_surface;
         cairo_t* m_context = nullptr;
         cairo_surface_t* m_surface = nullptr;
 
         ImVec2 m_offset, m_scale, m_dimensions;
+        // Pixel of the region drawn at the top left corner of the surface (tiles)
+        ImVec2 m_device_offset;
 
         color m_color;
+        bool m_replace_color = false;
+        color m_replaced_color = BLACK;
+        color m_replacement_color = BLACK;
         Stroke m_stroke;
         std::vector<float> m_dash;
 
         bool m_painting = false;
+        // Coverage only (A8 surfaces): every color is drawn opaque
+        bool m_coverage = false;
+        cairo_antialias_t m_antialias = CAIRO_ANTIALIAS_DEFAULT;
 
         // ARGB_Imageptr m_image_data;
         unsigned char* m_image_data = nullptr;
 
-        float m_dx = 0.f;
-        float m_dy = 0.f;
+        // Glyph mode: current font face (borrowed from the FontRegistry) and size
+        cairo_font_face_t* m_font_face = nullptr;
+        float m_font_size = 0.f;
 
-        float m_sx = 1.f;
-        float m_sy = 1.f;
+        // Cacheable paths (glyphs) are recorded until fillPath, then drawn from the GlyphCache
+        enum PathOp : u8 { PATH_MOVE, PATH_LINE, PATH_CUBIC, PATH_QUAD, PATH_CLOSE };
+        bool m_recording_path = false;
+        i32 m_path_id = -1;
+        std::vector<u8> m_path_ops;
+        std::vector<float> m_path_coords;
 
         inline ImVec2 getRealPos(float x, float y);
-
+        void resetMatrix();
+
+        void recordPathOp(PathOp op, std::initializer_list<float> coords);
+        /**
+         * Replays the recorded path into cr, transforming each point with transform(x, y)
+         * (affine, such that the degree elevation of quadratic curves can be done in path space)
+         */
+        template<typename Transform>
+        void replayRecordedPath(cairo_t* cr, Transform transform);
+        void fillRecordedPath();
+
+        void applyFont();
         void roundRect(float x, float y, float w, float h, float rx, float ry);
+        void beginTile(cairo_t* context, ImVec2 origin, ImVec2 scale, int x, int y, int width, int height);
         void destroy();
+
+    protected:
+        // Glyph paths are composited from the GlyphCache (raster targets only)
+        bool m_cache_glyphs = true;
+
+        /**
+         * @brief Prepares context to paint the region of the formula starting at origin
+         * The context stays owned by the caller
+         */
+        void beginContext(cairo_t* context, ImVec2 origin, ImVec2 size, ImVec2 scale);
+        void endContext() { m_context = nullptr; m_painting = false; }
+        bool isPainting() const { return m_painting; }
     public:
         Cairo_Painter();
         ~Cairo_Painter();
 
-        // ARGB_Imageptr getImageDataPtr() { return m_image_data; }
         unsigned char* getImageData() { return m_image_data; }
 
+        /**
+         * @brief Returns the buffer holding the image data (after finish), to be adopted without copy
+         *
+         * The painter never draws into an adopted buffer again: the surface is only
+         * reused by the pool once all the other owners of the buffer dropped it.
+         * The buffer can be larger than the image, see getImageStride().
+         */
+        ARGB_Imageptr getImageBuffer() { return m_image_data == nullptr ? nullptr : m_pooled_surface.buffer; }
+
         ImVec2 getImageDimensions() { return m_dimensions; }
 
+        /**
+         * @brief Returns the number of bytes per row of the image data
+         */
+        int getImageStride();
+
+        /**
+         * @brief Every following setColor(from) will paint with the color to instead
+         *
+         * Used to recolor a recorded formula without parsing it again
+         */
+        void setColorReplacement(color from, color to);
+
+        /**
+         * @brief Paints the coverage only (A8 image) instead of ARGB32, from the next start
+         *
+         * Only meaningful for formulas drawn in a single color, which is then applied
+         * when the image is displayed or exported
+         */
+        void setCoverageOnly(bool coverage) { m_coverage = coverage; }
+        bool isCoverageOnly() const { return m_coverage; }
+
+        /**
+         * @brief Sets the antialiasing of the shapes and glyphs, from the next start
+         *
+         * CAIRO_ANTIALIAS_FAST trades quality for speed (drafts), default: CAIRO_ANTIALIAS_DEFAULT
+         */
+        void setAntialias(cairo_antialias_t antialias) { m_antialias = antialias; }
+        cairo_antialias_t getAntialias() const { return m_antialias; }
+
         virtual void setColor(color c) override;
 
         virtual void setStroke(const Stroke& s) override;
@@ -93,6 +177,31 @@ namespace microtex {
 
         virtual void start(ImVec2 dimensions, ImVec2 scale = ImVec2(1.f, 1.f), ImVec2 inner_padding = ImVec2(20.f, 20.f)) override;
 
+        /**
+         * @brief Starts painting a region of the formula
+         *
+         * @param origin point of the formula (in MicroTeX units) drawn at the top left corner of the image
+         * @param size size of the region (in MicroTeX units)
+         * @param scale rescale the image (in x and y)
+         */
+        virtual void startRegion(ImVec2 origin, ImVec2 size, ImVec2 scale = ImVec2(1.f, 1.f));
+
+        /**
+         * @brief Starts painting a tile: the pixels [x, x + width) x [y, y + height)
+         * of the region starting at origin (as drawn by startRegion)
+         *
+         * Tiles of the same region line up exactly with each other.
+         */
+        void startTile(ImVec2 origin, ImVec2 scale, int x, int y, int width, int height);
+
+        /**
+         * @brief Same as startTile, but paints into a context owned by the caller
+         * (e.g. a band of a larger image, see ParsedLatex::rasterize)
+         *
+         * finish() only flushes the target, the image getters stay empty.
+         */
+        void startTarget(cairo_t* context, ImVec2 origin, ImVec2 scale, int x, int y, int width, int height);
+
         virtual void finish() override;
     };
 }
\ No newline at end of file
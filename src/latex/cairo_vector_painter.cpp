@@ -0,0 +1,61 @@
+#include "cairo_vector_painter.h"
+
+#include "cairo-svg.h"
+#include "cairo-pdf.h"
+
+using namespace microtex;
+
+Cairo_Vector_Painter::Cairo_Vector_Painter(Format format) : m_format(format) {
+    // Masks from the cache would be embedded as images
+    m_cache_glyphs = false;
+}
+
+Cairo_Vector_Painter::~Cairo_Vector_Painter() {
+    destroyVector();
+}
+
+const char* Cairo_Vector_Painter::getExtension(Format format) {
+    return format == PDF ? "pdf" : "svg";
+}
+
+cairo_status_t Cairo_Vector_Painter::write_document(void* closure, const unsigned char* data, unsigned int length) {
+    static_cast<std::string*>(closure)->append((const char*)data, length);
+    return CAIRO_STATUS_SUCCESS;
+}
+
+void Cairo_Vector_Painter::destroyVector() {
+    endContext();
+    if (m_vector_context != nullptr) {
+        cairo_destroy(m_vector_context);
+        m_vector_context = nullptr;
+    }
+    if (m_vector_surface != nullptr) {
+        cairo_surface_destroy(m_vector_surface);
+        m_vector_surface = nullptr;
+    }
+}
+
+void Cairo_Vector_Painter::startRegion(ImVec2 origin, ImVec2 size, ImVec2 scale) {
+    destroyVector();
+    m_document.clear();
+
+    const double width = (double)scale.x * size.x;
+    const double height = (double)scale.y * size.y;
+    if (m_format == PDF)
+        m_vector_surface = cairo_pdf_surface_create_for_stream(write_document, &m_document, width, height);
+    else
+        m_vector_surface = cairo_svg_surface_create_for_stream(write_document, &m_document, width, height);
+    m_vector_context = cairo_create(m_vector_surface);
+    beginContext(m_vector_context, origin, size, scale);
+}
+
+void Cairo_Vector_Painter::finish() {
+    if (!isPainting() || m_vector_surface == nullptr)
+        return;
+    cairo_show_page(m_vector_context);
+    // The document is only complete once the surface is finished
+    cairo_surface_finish(m_vector_surface);
+    if (cairo_surface_status(m_vector_surface) != CAIRO_STATUS_SUCCESS)
+        m_document.clear();
+    destroyVector();
+}
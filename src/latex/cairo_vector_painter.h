@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+
+#include "cairo_painter.h"
+
+namespace microtex {
+    /**
+     * @brief Painter writing an SVG or PDF document through Cairo's vector surfaces
+     *
+     * Same drawing code as the Cairo_Painter, but nothing is rasterized:
+     * outlines stay paths and glyphs drawn with the font engine are embedded as fonts.
+     * One unit of the formula (at scale 1) is one SVG pixel / one PDF point.
+     */
+    class Cairo_Vector_Painter : public Cairo_Painter {
+    public:
+        enum Format { SVG, PDF };
+    private:
+        Format m_format;
+        cairo_surface_t* m_vector_surface = nullptr;
+        cairo_t* m_vector_context = nullptr;
+        std::string m_document;
+
+        static cairo_status_t write_document(void* closure, const unsigned char* data, unsigned int length);
+        void destroyVector();
+    public:
+        Cairo_Vector_Painter(Format format);
+        ~Cairo_Vector_Painter();
+
+        Cairo_Vector_Painter(const Cairo_Vector_Painter&) = delete;
+        void operator=(const Cairo_Vector_Painter&) = delete;
+
+        /**
+         * @brief Returns the document written by the last start() / finish() (empty if it failed)
+         */
+        const std::string& getDocument() const { return m_document; }
+
+        Format getFormat() const { return m_format; }
+
+        /**
+         * @brief File extension of the format, without the dot ("svg", "pdf")
+         */
+        static const char* getExtension(Format format);
+
+        void startRegion(ImVec2 origin, ImVec2 size, ImVec2 scale = ImVec2(1.f, 1.f)) override;
+
+        void finish() override;
+    };
+}
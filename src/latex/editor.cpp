@@ -2,6 +2,7 @@
 
 #include "microtex/lib/core/formula.h"
 #include "microtex/lib/core/parser.h"
+#include "core/stage_profiler.h"
 #include <algorithm> 
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui_internal.h"
@@ -856,10 +857,48 @@ void LatexEditor::debug_window() {
             }
             ImGui::TreePop();
         }
+        render_timings();
         ImGui::End();
     }
 }
 
+void LatexEditor::render_timings() {
+    if (!ImGui::TreeNodeEx("Render stages", ImGuiTreeNodeFlags_DefaultOpen))
+        return;
+    auto& profiler = StageProfiler::getInstance();
+    if (ImGui::BeginTable("stages", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingFixedFit)) {
+        for (const char* column : { "Stage", "Count", "p50 (ms)", "p95 (ms)", "p99 (ms)", "Max (ms)" })
+            ImGui::TableSetupColumn(column);
+        ImGui::TableHeadersRow();
+        for (int i = 0;i < StageProfiler::STAGE_COUNT;i++) {
+            auto stats = profiler.getStats((StageProfiler::Stage)i);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", StageProfiler::getStageName((StageProfiler::Stage)i));
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", stats.count);
+            for (double value : { stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms }) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", value);
+            }
+        }
+        ImGui::EndTable();
+    }
+    // Written next to the executable (working directory)
+    static std::string dump_message;
+    if (ImGui::Button("Dump CSV"))
+        dump_message = profiler.writeCSV("render_timings.csv") ? "Written to render_timings.csv" : "Could not write render_timings.csv";
+    ImGui::SameLine();
+    if (ImGui::Button("Dump Chrome trace"))
+        dump_message = profiler.writeChromeTrace("render_trace.json") ? "Written to render_trace.json" : "Could not write render_trace.json";
+    ImGui::SameLine();
+    if (ImGui::Button("Reset"))
+        profiler.reset();
+    if (!dump_message.empty())
+        ImGui::Text("%s", dump_message.c_str());
+    ImGui::TreePop();
+}
+
 void LatexEditor::draw(std::string& latex, ImVec2 size) {
     set_std_char_info();
     debug_window();
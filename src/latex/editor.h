@@ -163,6 +163,7 @@ private:
     void parse();
 
     void debug_window();
+    void render_timings();
 public:
     void draw(std::string& latex, ImVec2 size = ImVec2(0, 0));
 
@@ -170,4 +171,6 @@ public:
     std::string get_text();
     bool has_text_changed();
     void set_focus(bool focus) { m_is_focused = focus; }
+    void set_debug(bool debug) { m_config.debug = debug; }
+    bool is_debug() { return m_config.debug; }
 };
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "environment_render.h"
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+
+#include "core/pixel_convert.h"
+#include "core/thread_pool.h"
+
+namespace Latex {
+    // Spacing of the layout, in em (font size)
+    static constexpr float align_column_gap = 2.f; // between two pairs of align columns
+    static constexpr float matrix_column_gap = 1.f; // 2 \arraycolsep
+    // Rows are at least as high as a strut
+    static constexpr float strut_ascent = 0.7f;
+    static constexpr float strut_descent = 0.3f;
+
+    static const char* whitespace = " \t\r\n";
+
+    static std::string trim(const std::string& str) {
+        size_t first = str.find_first_not_of(whitespace);
+        if (first == std::string::npos)
+            return "";
+        size_t last = str.find_last_not_of(whitespace);
+        return str.substr(first, last - first + 1);
+    }
+
+    /**
+     * Commands which change the layout of the whole environment, or of more than a row
+     */
+    static bool is_layout_command(const std::string& command) {
+        static const char* commands[] = {
+            "\\hline", "\\cline", "\\intertext", "\\shortintertext", "\\tag", "\\label",
+            "\\notag", "\\nonumber", "\\multicolumn", "\\noalign", "\\hdotsfor",
+            "\\vspace", "\\displaybreak", "\\cr", "\\newline"
+        };
+        for (const char* c : commands) {
+            if (command == c)
+                return true;
+        }
+        return false;
+    }
+
+    bool splitEnvironment(const std::string& latex, Environment& environment) {
+        static const std::string begin_command = "\\begin{";
+        size_t begin = latex.find_first_not_of(whitespace);
+        if (begin == std::string::npos || latex.compare(begin, begin_command.size(), begin_command) != 0)
+            return false;
+        size_t name_end = latex.find('}', begin + begin_command.size());
+        if (name_end == std::string::npos)
+            return false;
+        std::string name = latex.substr(begin + begin_command.size(), name_end - begin - begin_command.size());
+        if (name == "align" || name == "align*" || name == "aligned")
+            environment.layout = Environment::ALIGN;
+        else if (name == "gather" || name == "gather*" || name == "gathered")
+            environment.layout = Environment::GATHER;
+        else if (name == "matrix")
+            environment.layout = Environment::MATRIX;
+        else
+            return false;
+
+        const std::string end_command = "\\end{" + name + "}";
+        size_t last = latex.find_last_not_of(whitespace) + 1;
+        if (last < name_end + 1 + end_command.size() || latex.compare(last - end_command.size(), end_command.size(), end_command) != 0)
+            return false;
+        const size_t body = name_end + 1;
+        const size_t end = last - end_command.size();
+        // Position argument of aligned / gathered ([t], [b])
+        size_t first = latex.find_first_not_of(whitespace, body);
+        if (first < end && latex[first] == '[')
+            return false;
+
+        environment.name = name;
+        environment.rows.clear();
+        std::vector<std::string> row;
+        std::string cell;
+        int depth = 0; // braces and nested environments
+        for (size_t i = body;i < end;i++) {
+            char c = latex[i];
+            if (c == '%')
+                return false;
+            if (c == '\\') {
+                if (i + 1 < end && latex[i + 1] == '\\') {
+                    i++;
+                    if (depth > 0) {
+                        cell += "\\\\";
+                        continue;
+                    }
+                    size_t next = latex.find_first_not_of(whitespace, i + 1);
+                    if (next < end && (latex[next] == '[' || latex[next] == '*'))
+                        return false;
+                    row.push_back(trim(cell));
+                    environment.rows.push_back(std::move(row));
+                    row.clear();
+                    cell.clear();
+                    continue;
+                }
+                size_t j = i + 1;
+                while (j < end && std::isalpha((unsigned char)latex[j]))
+                    j++;
+                // Single character commands (\&, \{...)
+                if (j == i + 1 && j < end)
+                    j++;
+                std::string command = latex.substr(i, j - i);
+                if (is_layout_command(command))
+                    return false;
+                if (command == "\\begin")
+                    depth++;
+                else if (command == "\\end" && --depth < 0)
+                    return false;
+                cell += command;
+                i = j - 1;
+                continue;
+            }
+            if (c == '{') {
+                depth++;
+            }
+            else if (c == '}') {
+                if (--depth < 0)
+                    return false;
+            }
+            else if (c == '&' && depth == 0) {
+                row.push_back(trim(cell));
+                cell.clear();
+                continue;
+            }
+            cell += c;
+        }
+        if (depth != 0)
+            return false;
+        // A trailing \\ does not start a new row
+        row.push_back(trim(cell));
+        if (row.size() > 1 || !row[0].empty())
+            environment.rows.push_back(std::move(row));
+        if (environment.rows.empty())
+            return false;
+        if (environment.layout == Environment::GATHER) {
+            for (const auto& r : environment.rows) {
+                if (r.size() > 1)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Source of a cell parsed on its own
+     */
+    static std::string cell_source(Environment::Layout layout, size_t column, const std::string& cell) {
+        if (layout == Environment::MATRIX)
+            return "\\[\\textstyle " + cell + "\\]";
+        // The right column of an align pair starts with an empty atom, such that
+        // relations and binary operators keep their spacing (as in amsmath)
+        if (layout == Environment::ALIGN && column % 2 == 1)
+            return "\\[{}" + cell + "\\]";
+        return "\\[" + cell + "\\]";
+    }
+
+    bool EnvironmentRenderer::parseRow(const Environment& environment, const std::vector<std::string>& cells, float font_size, float line_space, microtex::color text_color, Row& row) {
+        row.cells.resize(cells.size());
+        for (size_t i = 0;i < cells.size();i++) {
+            if (cells[i].empty())
+                continue;
+            auto parsed = std::make_shared<const ParsedLatex>(cell_source(environment.layout, i, cells[i]), font_size, line_space, text_color, m_font_family);
+            if (!parsed->getLatexErrorMsg().empty())
+                return false;
+            row.cells[i].parsed = parsed;
+        }
+        return true;
+    }
+
+    void EnvironmentRenderer::evict(size_t row_count) {
+        // Rows that just went out of the formula are kept for a while (undo, retyping)
+        if (m_rows.size() <= std::max<size_t>(2 * row_count, 64))
+            return;
+        for (auto it = m_rows.begin();it != m_rows.end();) {
+            if (it->second.last_used != m_generation)
+                it = m_rows.erase(it);
+            else
+                it++;
+        }
+    }
+
+    void EnvironmentRenderer::clear() {
+        m_rows.clear();
+    }
+
+    bool EnvironmentRenderer::render(const Environment& environment, const std::string& math_font, float font_size, float line_space, microtex::color text_color,
+        ImVec2 scale, ImVec2 inner_padding, PixelBuffer::Format format, PixelBuffer& pixels,
+        const std::function<bool()>& is_cancelled) {
+        if (environment.rows.size() < min_rows)
+            return false;
+
+        // Parses are only valid for the same fonts, rasters for the same scale and color
+        bool render_glyphs = isRenderingGlyphs();
+        if (math_font != m_font_family || font_size != m_font_size || line_space != m_line_space || render_glyphs != m_render_glyphs) {
+            m_rows.clear();
+            m_font_family = math_font;
+            m_font_size = font_size;
+            m_line_space = line_space;
+            m_render_glyphs = render_glyphs;
+        }
+        if (scale.x != m_scale.x || scale.y != m_scale.y || text_color != m_text_color) {
+            const bool rescaled = scale.x != m_scale.x || scale.y != m_scale.y;
+            for (auto& entry : m_rows) {
+                for (auto& cell : entry.second.cells) {
+                    // Coverage does not depend on the color
+                    if (rescaled || cell.pixels.format != PixelBuffer::A8)
+                        cell.pixels = PixelBuffer();
+                }
+            }
+            m_scale = scale;
+            m_text_color = text_color;
+        }
+
+        // Only the rows that are not cached are parsed
+        m_generation++;
+        std::vector<Row*> rows;
+        rows.reserve(environment.rows.size());
+        for (const auto& cells : environment.rows) {
+            std::string key(1, (char)environment.layout);
+            for (const auto& cell : cells) {
+                key += '\0';
+                key += cell;
+            }
+            auto it = m_rows.find(key);
+            if (it == m_rows.end()) {
+                Row row;
+                if (!parseRow(environment, cells, font_size, line_space, text_color, row))
+                    return false;
+                it = m_rows.emplace(std::move(key), std::move(row)).first;
+                m_parsed_rows++;
+            }
+            else {
+                m_reused_rows++;
+            }
+            it->second.last_used = m_generation;
+            rows.push_back(&it->second);
+        }
+        evict(environment.rows.size());
+        if (is_cancelled != nullptr && is_cancelled())
+            return false;
+
+        // All the cells are composited in the same format
+        for (const Row* row : rows) {
+            for (const auto& cell : row->cells) {
+                if (cell.parsed != nullptr && !cell.parsed->isMonochrome())
+                    format = PixelBuffer::ARGB32_PREMULTIPLIED;
+            }
+        }
+
+        // Cells that are not rasterized yet (or in another format), in parallel
+        std::vector<Cell*> missing;
+        for (Row* row : rows) {
+            for (auto& cell : row->cells) {
+                if (cell.parsed != nullptr && (cell.pixels.empty() || cell.pixels.format != format))
+                    missing.push_back(&cell);
+            }
+        }
+        const int threads = getRasterThreads();
+        ThreadPool::getInstance().parallelFor(missing.size(), [&](size_t i) {
+            Cell& cell = *missing[i];
+            ImVec2 size = cell.parsed->getRasterSize(scale, ImVec2(0.f, 0.f));
+            cell.origin = cell.parsed->getRasterOrigin(scale, ImVec2(0.f, 0.f));
+            cell.pixels = cell.parsed->rasterizeRegion(scale, ImVec2(0.f, 0.f), text_color, 0, 0, (int)size.x, (int)size.y, format);
+            }, threads == 0 ? ThreadPool::getInstance().getThreadCount() : threads);
+
+        // Layout (in MicroTeX units): shared column widths, rows as high as their highest cell
+        size_t columns = 0;
+        for (const Row* row : rows)
+            columns = std::max(columns, row->cells.size());
+        std::vector<float> column_widths(columns, 0.f);
+        std::vector<float> baselines(rows.size());
+        float y = 0.f;
+        for (size_t r = 0;r < rows.size();r++) {
+            float ascent = strut_ascent * font_size;
+            float descent = strut_descent * font_size;
+            for (size_t c = 0;c < rows[r]->cells.size();c++) {
+                const auto& parsed = rows[r]->cells[c].parsed;
+                if (parsed == nullptr)
+                    continue;
+                column_widths[c] = std::max(column_widths[c], parsed->getWidth());
+                ascent = std::max(ascent, parsed->getAscent());
+                descent = std::max(descent, parsed->getDescent());
+            }
+            baselines[r] = y + ascent;
+            y = baselines[r] + descent + line_space;
+        }
+        std::vector<float> column_x(columns, 0.f);
+        float x = 0.f;
+        for (size_t c = 0;c < columns;c++) {
+            column_x[c] = x;
+            x += column_widths[c];
+            if (environment.layout == Environment::MATRIX)
+                x += matrix_column_gap * font_size;
+            else if (environment.layout == Environment::ALIGN && c % 2 == 1)
+                x += align_column_gap * font_size;
+        }
+
+        // Placement of the cell rasters, on whole pixels such that they can be reused as is
+        struct Placement {
+            Cell* cell;
+            int x, y;
+        };
+        std::vector<Placement> placements;
+        int min_x = INT_MAX, min_y = INT_MAX, max_x = INT_MIN, max_y = INT_MIN;
+        for (size_t r = 0;r < rows.size();r++) {
+            for (size_t c = 0;c < rows[r]->cells.size();c++) {
+                Cell& cell = rows[r]->cells[c];
+                if (cell.parsed == nullptr || cell.pixels.empty())
+                    continue;
+                float width = cell.parsed->getWidth();
+                float cell_x = column_x[c] + (column_widths[c] - width) / 2.f;
+                if (environment.layout == Environment::ALIGN)
+                    cell_x = c % 2 == 0 ? column_x[c] + column_widths[c] - width : column_x[c];
+                float cell_y = baselines[r] - cell.parsed->getAscent();
+                Placement placement = { &cell, (int)round(scale.x * cell_x - cell.origin.x), (int)round(scale.y * cell_y - cell.origin.y) };
+                min_x = std::min(min_x, placement.x);
+                min_y = std::min(min_y, placement.y);
+                max_x = std::max(max_x, placement.x + cell.pixels.width);
+                max_y = std::max(max_y, placement.y + cell.pixels.height);
+                placements.push_back(placement);
+            }
+        }
+        if (placements.empty())
+            return false;
+
+        // Composited over each other: ink overflowing a row blends with its neighbours
+        const int pad_x = (int)round(scale.x * inner_padding.x);
+        const int pad_y = (int)round(scale.y * inner_padding.y);
+        const int width = max_x - min_x + 2 * pad_x;
+        const int height = max_y - min_y + 2 * pad_y;
+        const bool coverage = format == PixelBuffer::A8;
+        const cairo_format_t cairo_format = coverage ? CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32;
+        auto& pool = microtex::SurfacePool::getThreadInstance();
+        auto target = pool.acquire(width, height, cairo_format);
+        for (const auto& placement : placements) {
+            PixelBuffer& source = placement.cell->pixels;
+            cairo_surface_t* surface = cairo_image_surface_create_for_data(source.pixels(), cairo_format, source.width, source.height, source.stride);
+            cairo_set_source_surface(target.context, surface, placement.x - min_x + pad_x, placement.y - min_y + pad_y);
+            cairo_paint(target.context);
+            cairo_surface_destroy(surface);
+        }
+        cairo_surface_flush(target.surface);
+        const int stride = cairo_image_surface_get_stride(target.surface);
+        ARGB_Imageptr buffer = target.buffer;
+        pool.release(target);
+
+        // Trimmed to the ink and padded, as ParsedLatex::rasterize
+        int ink_x = 0, ink_y = 0, ink_w = width, ink_h = height;
+        bool visible = coverage
+            ? PixelConvert::findCoverageBounds(buffer->data(), width, height, stride, ink_x, ink_y, ink_w, ink_h)
+            : PixelConvert::findOpaqueBounds(buffer->data(), width, height, stride, ink_x, ink_y, ink_w, ink_h);
+        if (visible) {
+            int x1 = std::min(width, ink_x + ink_w + pad_x);
+            int y1 = std::min(height, ink_y + ink_h + pad_y);
+            ink_x = std::max(0, ink_x - pad_x);
+            ink_y = std::max(0, ink_y - pad_y);
+            ink_w = x1 - ink_x;
+            ink_h = y1 - ink_y;
+        }
+        else {
+            ink_x = ink_y = 0;
+            ink_w = width;
+            ink_h = height;
+        }
+
+        pixels = PixelBuffer();
+        pixels.width = ink_w;
+        pixels.height = ink_h;
+        pixels.stride = stride;
+        pixels.format = format;
+        pixels.offset = (size_t)ink_y * stride + (size_t)ink_x * pixels.bytesPerPixel();
+        pixels.tint = text_color;
+        pixels.data = buffer;
+        // Baseline of the first row
+        pixels.ascent = scale.y * baselines[0] - (min_y - pad_y) - ink_y;
+        pixels.descent = ink_h - pixels.ascent;
+        return true;
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "latex.h"
+
+namespace Latex {
+    /**
+     * @brief Source of a top-level multi-row environment, split into its rows and cells
+     */
+    struct Environment {
+        enum Layout {
+            ALIGN,  // columns by pairs, right then left aligned (align, align*, aligned)
+            GATHER, // a single centered column (gather, gather*, gathered)
+            MATRIX  // centered columns, cells in text style (matrix)
+        };
+        std::string name;
+        Layout layout = ALIGN;
+        std::vector<std::vector<std::string>> rows; // source of the cells of each row
+    };
+
+    /**
+     * @brief Splits a latex source into the rows (\\) and cells (&) of an environment
+     *
+     * Only succeeds if the whole source is a single supported environment whose rows
+     * can be laid out on their own: no \hline, \intertext, \tag, row spacing (\\[1ex]),
+     * comments... Separators inside braces or nested environments are left in their cell.
+     *
+     * @return false if the source is not such an environment
+     */
+    bool splitEnvironment(const std::string& latex, Environment& environment);
+
+    /**
+     * @brief Renders multi-row environments from their rows, parsing and rasterizing
+     * only the rows that changed since the previous renders
+     *
+     * Each row is cached with its cells, parsed and rasterized on their own. The column
+     * widths and row heights are recomputed from the cached metrics on every render and the
+     * cell rasters are composited at their positions (rounded to pixels): editing one row
+     * of a 40-row align only parses and rasterizes that row.
+     *
+     * The layout follows MicroTeX's closely but not exactly (fixed column and row spacing),
+     * it is meant for previews to be replaced by the render of the whole formula.
+     *
+     * Not thread safe, owned by a single thread (e.g. the RenderWorker).
+     */
+    class EnvironmentRenderer {
+    public:
+        // Smaller environments are rendered at once
+        static constexpr size_t min_rows = 4;
+    private:
+        struct Cell {
+            ParsedLatexPtr parsed = nullptr; // nullptr for an empty cell
+            PixelBuffer pixels; // untrimmed raster, see ParsedLatex::rasterizeRegion
+            ImVec2 origin; // position of the origin of the cell in its raster
+        };
+        struct Row {
+            std::vector<Cell> cells;
+            uint64_t last_used = 0;
+        };
+        // Rows by layout and source
+        std::unordered_map<std::string, Row> m_rows;
+        uint64_t m_generation = 0;
+
+        // Parameters of the cached parses and rasters
+        std::string m_font_family;
+        float m_font_size = 0.f;
+        float m_line_space = 0.f;
+        bool m_render_glyphs = false;
+        ImVec2 m_scale = ImVec2(0.f, 0.f);
+        microtex::color m_text_color = microtex::BLACK;
+
+        size_t m_parsed_rows = 0;
+        size_t m_reused_rows = 0;
+
+        bool parseRow(const Environment& environment, const std::vector<std::string>& cells, float font_size, float line_space, microtex::color text_color, Row& row);
+        void evict(size_t row_count);
+    public:
+        /**
+         * @brief Renders the environment, from the cached rows when possible
+         *
+         * @param math_font math font to parse the cells with (see getMathFontFamily)
+         * @param format A8 to only keep the coverage, ARGB if a cell is not monochrome
+         * @param is_cancelled optional, checked between parsing and rasterization
+         * @return false if the environment could not be rendered this way (too few rows,
+         * latex error in a cell, cancelled), it must then be rendered at once
+         */
+        bool render(const Environment& environment, const std::string& math_font, float font_size, float line_space, microtex::color text_color,
+            ImVec2 scale, ImVec2 inner_padding, PixelBuffer::Format format, PixelBuffer& pixels,
+            const std::function<bool()>& is_cancelled = nullptr);
+
+        void clear();
+
+        /**
+         * @brief Number of rows that had to be parsed / were taken from the cache
+         */
+        size_t getParsedRowCount() const { return m_parsed_rows; }
+        size_t getReusedRowCount() const { return m_reused_rows; }
+    };
+}
@@ -0,0 +1,58 @@
+#include "font_registry.h"
+
+#include "cairo-ft.h"
+
+namespace microtex {
+    static const cairo_user_data_key_t ft_face_key = {};
+
+    static void done_ft_face(void* face) {
+        FT_Done_Face((FT_Face)face);
+    }
+
+    FontRegistry::FontRegistry() {
+        if (FT_Init_FreeType(&m_library))
+            m_library = nullptr;
+    }
+    FontRegistry::~FontRegistry() {
+        // The FT_Faces are released by cairo once it drops its last reference;
+        // the library is left to the end of the process for the same reason
+        for (auto& [path, face] : m_faces) {
+            if (face != nullptr)
+                cairo_font_face_destroy(face);
+        }
+    }
+
+    FontRegistry& FontRegistry::getInstance() {
+        static FontRegistry registry;
+        return registry;
+    }
+
+    cairo_font_face_t* FontRegistry::getFace(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_faces.find(path);
+        if (it != m_faces.end())
+            return it->second;
+
+        // Failures are remembered too, such that the file is not opened for every glyph
+        cairo_font_face_t*& face = m_faces[path];
+        if (m_library == nullptr)
+            return face;
+
+        FT_Face ft_face;
+        if (FT_New_Face(m_library, path.c_str(), 0, &ft_face))
+            return face;
+        face = cairo_ft_font_face_create_for_ft_face(ft_face, 0);
+        // Ties the lifetime of the FT_Face to the cairo face
+        if (cairo_font_face_set_user_data(face, &ft_face_key, ft_face, done_ft_face) != CAIRO_STATUS_SUCCESS) {
+            cairo_font_face_destroy(face);
+            FT_Done_Face(ft_face);
+            face = nullptr;
+        }
+        return face;
+    }
+
+    size_t FontRegistry::count() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_faces.size();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "cairo.h"
+
+namespace microtex {
+    /**
+     * @brief Interned Cairo font faces of the bundled font files
+     *
+     * Each .otf file is opened once with FreeType and wrapped in a cairo font face,
+     * which is then shared by all the painters (and threads). Cairo keeps its own
+     * cache of rasterized glyphs per scaled font.
+     */
+    class FontRegistry {
+    private:
+        FT_Library m_library = nullptr;
+        std::unordered_map<std::string, cairo_font_face_t*> m_faces;
+        std::mutex m_mutex;
+
+        FontRegistry();
+    public:
+        ~FontRegistry();
+
+        FontRegistry(const FontRegistry&) = delete;
+        void operator=(const FontRegistry&) = delete;
+
+        static FontRegistry& getInstance();
+
+        /**
+         * @brief Returns the font face of a font file, loaded on first use
+         *
+         * @param path path of the font file (as given to MicroTeX)
+         * @return borrowed face, valid until the registry is destroyed; nullptr if the file could not be loaded
+         */
+        cairo_font_face_t* getFace(const std::string& path);
+
+        /**
+         * @brief Number of loaded font faces
+         */
+        size_t count();
+    };
+}
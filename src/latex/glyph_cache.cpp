@@ -0,0 +1,109 @@
+#include "glyph_cache.h"
+
+#include <atomic>
+
+namespace microtex {
+    static std::atomic<bool> enabled = true;
+    static std::atomic<size_t> byte_budget = 8 * 1024 * 1024;
+    static std::atomic<size_t> hits = 0;
+    static std::atomic<size_t> misses = 0;
+    static std::atomic<size_t> entries = 0;
+    static std::atomic<size_t> bytes = 0;
+
+    bool GlyphCache::Key::operator==(const Key& other) const {
+        return path_hash == other.path_hash
+            && xx == other.xx && yx == other.yx && xy == other.xy && yy == other.yy
+            && bucket_x == other.bucket_x && bucket_y == other.bucket_y
+            && antialias == other.antialias;
+    }
+
+    size_t GlyphCache::KeyHash::operator()(const Key& key) const {
+        size_t seed = std::hash<uint64_t>()(key.path_hash);
+        auto combine = [&seed](size_t value) {
+            seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+            };
+        combine(std::hash<float>()(key.xx));
+        combine(std::hash<float>()(key.yx));
+        combine(std::hash<float>()(key.xy));
+        combine(std::hash<float>()(key.yy));
+        combine((size_t)key.antialias << 16 | (size_t)key.bucket_x << 8 | key.bucket_y);
+        return seed;
+    }
+
+    GlyphCache::~GlyphCache() {
+        clear();
+    }
+
+    void GlyphCache::clear() {
+        for (auto& [key, mask] : m_masks) {
+            cairo_surface_destroy(mask.surface);
+        }
+        entries -= m_masks.size();
+        bytes -= m_bytes;
+        m_masks.clear();
+        m_bytes = 0;
+    }
+
+    GlyphCache& GlyphCache::getThreadInstance() {
+        static thread_local GlyphCache cache;
+        return cache;
+    }
+
+    const GlyphCache::Mask* GlyphCache::get(const Key& key) {
+        auto it = m_masks.find(key);
+        if (it == m_masks.end()) {
+            misses++;
+            return nullptr;
+        }
+        hits++;
+        return &it->second;
+    }
+
+    const GlyphCache::Mask* GlyphCache::put(const Key& key, cairo_surface_t* surface, int x, int y) {
+        Mask mask;
+        mask.surface = surface;
+        mask.x = x;
+        mask.y = y;
+        mask.bytes = (size_t)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+
+        // Glyph sets are small, dropping everything is good enough
+        if (m_bytes + mask.bytes > byte_budget)
+            clear();
+
+        auto [it, inserted] = m_masks.emplace(key, mask);
+        if (!inserted) {
+            cairo_surface_destroy(surface);
+            return &it->second;
+        }
+        m_bytes += mask.bytes;
+        entries++;
+        bytes += mask.bytes;
+        return &it->second;
+    }
+
+    void GlyphCache::setEnabled(bool value) {
+        enabled = value;
+    }
+    bool GlyphCache::isEnabled() {
+        return enabled;
+    }
+
+    void GlyphCache::setByteBudget(size_t value) {
+        byte_budget = value;
+    }
+
+    GlyphCacheStats GlyphCache::getStats() {
+        GlyphCacheStats stats;
+        stats.hits = hits;
+        stats.misses = misses;
+        stats.entries = entries;
+        stats.bytes = bytes;
+        stats.byte_budget = byte_budget;
+        return stats;
+    }
+
+    void GlyphCache::resetStats() {
+        hits = 0;
+        misses = 0;
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "cairo.h"
+
+namespace microtex {
+    struct GlyphCacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t byte_budget = 0; // per thread
+    };
+
+    /**
+     * @brief Cache of rasterized glyph coverage masks (CAIRO_FORMAT_A8)
+     *
+     * Glyphs are drawn as paths by MicroTeX; instead of filling the same path
+     * again for every occurrence, the Cairo_Painter rasterizes it once into a mask
+     * and composites the mask with the current color.
+     *
+     * Masks are keyed by the path itself (its geometry, which identifies the font
+     * and the glyph), the linear part of the transformation (size, rotation) and
+     * the sub-pixel position of the glyph, rounded to a quarter of a pixel, and the
+     * antialiasing it was drawn with (drafts and final renders do not share masks).
+     *
+     * There is one cache per thread, so painters never wait on each other;
+     * the statistics are shared between all the threads.
+     */
+    class GlyphCache {
+    public:
+        static constexpr int subpixel_buckets = 4;
+
+        struct Key {
+            uint64_t path_hash = 0;
+            float xx = 0.f, yx = 0.f, xy = 0.f, yy = 0.f;
+            uint8_t bucket_x = 0;
+            uint8_t bucket_y = 0;
+            uint8_t antialias = 0; // cairo_antialias_t
+
+            bool operator==(const Key& other) const;
+        };
+        struct KeyHash {
+            size_t operator()(const Key& key) const;
+        };
+
+        struct Mask {
+            cairo_surface_t* surface = nullptr;
+            // Position of the top left corner of the mask, relative to the pixel containing the origin of the path
+            int x = 0;
+            int y = 0;
+            size_t bytes = 0;
+        };
+    private:
+        std::unordered_map<Key, Mask, KeyHash> m_masks;
+        size_t m_bytes = 0;
+
+        GlyphCache() = default;
+        void clear();
+    public:
+        ~GlyphCache();
+
+        GlyphCache(const GlyphCache&) = delete;
+        void operator=(const GlyphCache&) = delete;
+
+        /**
+         * @brief Returns the cache of the calling thread
+         */
+        static GlyphCache& getThreadInstance();
+
+        /**
+         * @brief Returns the mask of key, or nullptr (counts as a hit / miss)
+         */
+        const Mask* get(const Key& key);
+
+        /**
+         * @brief Stores a mask, the cache takes ownership of the surface
+         *
+         * If the cache goes over its budget, all its masks are dropped first.
+         *
+         * @return the stored mask
+         */
+        const Mask* put(const Key& key, cairo_surface_t* surface, int x, int y);
+
+        /**
+         * @brief Enables / disables the use of the cache by all the painters (enabled by default)
+         */
+        static void setEnabled(bool enabled);
+        static bool isEnabled();
+
+        /**
+         * @brief Sets the maximum number of bytes of masks kept by each thread
+         */
+        static void setByteBudget(size_t bytes);
+
+        static GlyphCacheStats getStats();
+        static void resetStats();
+    };
+}
@@ -35,6 +35,7 @@ void History::load() {
         std::fstream out("data/history.toml", std::ios::out | std::ios::trunc);
     }
     auto file = toml::parse("data/history.toml");
+    m_thumbnails.open("data/history.pack");
     auto history = toml::find_or<toml::table>(file, "history", toml::table());
     for (auto& pair : history) {
         auto& value = pair.second;
@@ -111,6 +112,34 @@ bool History::must_retrieve_latex(LatexHistory& history_point) {
     return false;
 }
 
+std::shared_ptr<Image> History::load_thumbnail(const std::string& latex) {
+    const float font_size = 50.f;
+    const float line_space = 1.2f;
+    auto image = std::make_shared<Image>();
+
+    // Every input of the render, not only the latex source (verified by the pack)
+    std::string key = latex;
+    key += '\0' + Latex::getMathFontFamily();
+    key += '\0' + std::to_string(font_size) + "/" + std::to_string(line_space);
+    key += Latex::isRenderingGlyphs() ? "/glyphs" : "/paths";
+
+    Latex::PixelView view;
+    if (m_thumbnails.get(key, view)) {
+        // Uploaded directly from the mapped file, coverage thumbnails are drawn in the default (black) tint
+        const Image::Format format = view.format == PixelBuffer::A8 ? Image::A8 : Image::ARGB;
+        image->setImageView(view.data, view.width, view.height, view.stride, Image::FILTER_BILINEAR, format);
+        return image;
+    }
+
+    Latex::LatexImage latex_image(latex, font_size, line_space);
+    const PixelBuffer& pixels = latex_image.getPixels();
+    if (!pixels.empty()) {
+        m_thumbnails.append(key, pixels);
+        image->setImage(pixels, Image::FILTER_BILINEAR);
+    }
+    return image;
+}
+
 void History::show_history_point(const LatexHistory& history_point, const Rect& boundaries) {
     ImGui::PushID(history_point.timepoint);
     if (ImGui::Button("X")) {
@@ -118,10 +147,10 @@ void History::show_history_point(const LatexHistory& history_point, const Rect&
     }
     ImGui::SameLine();
     if (m_history_images.find(history_point.timepoint) == m_history_images.end()) {
-        m_history_images[history_point.timepoint] = std::make_unique<Latex::LatexImage>(history_point.latex, 50.f, 1.2f);
+        m_history_images[history_point.timepoint] = load_thumbnail(history_point.latex);
     }
     // Show image
-    auto image = m_history_images[history_point.timepoint]->getImage();
+    auto image = m_history_images[history_point.timepoint];
     float width = image->width();
     float height = image->height();
     float aspect_ratio = width / height;
@@ -132,7 +161,7 @@ void History::show_history_point(const LatexHistory& history_point, const Rect&
     }
     auto cursor = ImGui::GetCursorScreenPos();
     ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(cursor.x, cursor.y), ImVec2(cursor.x + width, cursor.y + height), Colors::white, 0.f, 0);
-    ImGui::Image((void*)image->texture(), ImVec2(width, height), ImVec2(0, 0), ImVec2(1, 1), ImVec4(1.f, 1.f, 1.f, 1.f), ImGui::GetStyleColorVec4(ImGuiCol_FrameBgHovered));
+    ImGui::Image((void*)image->texture(), ImVec2(width, height), ImVec2(0, 0), ImVec2(1, 1), ImGui::ColorConvertU32ToFloat4(image->getDrawColor()), ImGui::GetStyleColorVec4(ImGuiCol_FrameBgHovered));
     if (ImGui::IsItemClicked()) {
         m_to_retrieve = history_point.timepoint;
         m_open = false;
@@ -5,6 +5,7 @@
 #include <map>
 
 #include "latex.h"
+#include "thumbnail_pack.h"
 #include "core/basic.h"
 
 struct LatexHistory {
@@ -22,7 +23,9 @@ private:
 
     uint64_t m_to_retrieve = 0;
 
-    std::map<uint64_t, std::unique_ptr<Latex::LatexImage>> m_history_images;
+    std::map<uint64_t, std::shared_ptr<Image>> m_history_images;
+    // Rendered thumbnails persisted between sessions
+    Latex::ThumbnailPack m_thumbnails;
 
     bool m_is_loaded = false;
     bool m_open = false;
@@ -31,6 +34,7 @@ private:
     void load();
     void clean();
 
+    std::shared_ptr<Image> load_thumbnail(const std::string& latex);
     void show_history_point(const LatexHistory& history_point, const Rect& boundaries);
 public:
     void saveToHistory(LatexHistory history_point);
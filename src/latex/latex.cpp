@@ -1,43 +1,169 @@
 #include "latex.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "core/mapped_file.h"
+#include "core/pixel_convert.h"
+#include "core/stage_profiler.h"
+#include "core/thread_pool.h"
+#include "tiled_raster.h"
 
 namespace Latex {
     bool is_initialized = false;
 
     static std::string font_family = "XITS";
     static std::string font_family_math = "XITS Math";
+    static std::mutex microtex_mutex;
+    static std::mutex font_family_mutex;
+    static std::atomic<bool> render_glyphs = false;
+    static std::atomic<int> max_untiled_size = 4096;
+    static std::atomic<int> raster_threads = 1;
+
+    // Below this number of pixels, a formula is always rasterized on a single thread
+    static constexpr size_t min_parallel_pixels = 512 * 512;
+    static constexpr int min_band_height = 64;
+
+    struct FontFile {
+        const char* clm;
+        const char* otf;
+    };
+    struct FontFamily {
+        const char* name;
+        const char* math_font; // as given to MicroTeX::parse
+        FontFile file;
+        bool loaded;
+    };
+    // Fonts are only registered by path in init(), and loaded (under microtex_mutex) on first use
+    static FontFamily font_families[] = {
+        { "XITS", "XITS Math", { "data/xits/XITSMath-Regular.clm2", "data/xits/XITSMath-Regular.otf" }, false },
+        // { "XITS Bold", "XITS Math Bold", { "data/xits/XITSMath-Bold.clm2", "data/xits/XITSMath-Bold.otf" }, false }, // Is broken
+        { "Latin Modern", "LatinModernMath-Regular", { "data/lm-math/latinmodern-math.clm2", "data/lm-math/latinmodern-math.otf" }, false },
+        { "Fira Math", "Fira Math Regular", { "data/firamath/FiraMath-Regular.clm2", "data/firamath/FiraMath-Regular.otf" }, false },
+        { "Gyre DejaVu", "TeXGyreDejaVuMath-Regular", { "data/tex-gyre/texgyredejavu-math.clm2", "data/tex-gyre/texgyredejavu-math.otf" }, false },
+    };
+    // Main (text) font of every family
+    static const FontFile text_fonts[] = {
+        { "data/xits/XITS-BoldItalic.clm2", "data/xits/XITS-BoldItalic.otf" },
+        { "data/xits/XITS-Regular.clm2", "data/xits/XITS-Regular.otf" },
+        { "data/xits/XITS-Bold.clm2", "data/xits/XITS-Bold.otf" },
+        { "data/xits/XITS-Italic.clm2", "data/xits/XITS-Italic.otf" },
+    };
+    static bool text_fonts_loaded = false;
+    static bool microtex_initialized = false;
+    static std::atomic<bool> stop_preload = false;
+
+    /**
+     * Joined at exit if release() was not called (defined after the state it uses)
+     */
+    struct PreloadThread {
+        std::thread thread;
+
+        void stop() {
+            stop_preload = true;
+            if (thread.joinable())
+                thread.join();
+        }
+        ~PreloadThread() { stop(); }
+    };
+    static PreloadThread preload_thread;
+
+    static FontFamily* find_family(const std::string& name) {
+        for (auto& family : font_families) {
+            if (family.name == name)
+                return &family;
+        }
+        return nullptr;
+    }
+
+    static FontFamily* find_math_font(const std::string& math_font) {
+        for (auto& family : font_families) {
+            if (family.math_font == math_font)
+                return &family;
+        }
+        return nullptr;
+    }
+
+    /**
+     * Reads the metrics of a font from a read-only mapping of its .clm2 file, instead of
+     * a heap copy of the file (FontSrcFile), which only saves that transient read buffer.
+     *
+     * The metrics are not used in place: MicroTeX deserializes the whole mapping into its
+     * own heap objects, and the mapping is closed right after. Sharing the metrics between
+     * processes through the page cache would need MicroTeX to read them from the mapping.
+     *
+     * @param init true for the first math font, which initializes MicroTeX
+     */
+    static void add_font(const FontFile& file, bool init) {
+        using namespace microtex;
+        MappedFile clm;
+        if (!clm.open(file.clm))
+            throw std::runtime_error(std::string("Could not map font file ") + file.clm);
+        const FontSrcData src(clm.size(), clm.data(), file.otf);
+        if (init)
+            MicroTeX::init(src);
+        else
+            MicroTeX::addFont(src);
+    }
+
+    /**
+     * The first math font loaded initializes MicroTeX, microtex_mutex must be held
+     */
+    static void load_family(FontFamily& family) {
+        using namespace microtex;
+        if (family.loaded)
+            return;
+        add_font(family.file, !microtex_initialized);
+        if (!microtex_initialized) {
+            MicroTeX::setDefaultMathFont(family.math_font);
+            microtex_initialized = true;
+        }
+        family.loaded = true;
+    }
+
+    /**
+     * Needs a loaded math font, microtex_mutex must be held
+     */
+    static void load_text_fonts() {
+        using namespace microtex;
+        if (text_fonts_loaded)
+            return;
+        for (const auto& file : text_fonts)
+            add_font(file, false);
+        MicroTeX::setDefaultMainFont("XITS");
+        text_fonts_loaded = true;
+    }
 
     std::string init(const std::string& family) {
         using namespace microtex;
 
         microtex::MicroTeX::setRenderGlyphUsePath(true);
         try {
-            const FontSrcFile tex_gyre("data/tex-gyre/texgyredejavu-math.clm2", "data/tex-gyre/texgyredejavu-math.otf");
-            const FontSrcFile latin_modern("data/lm-math/latinmodern-math.clm2", "data/lm-math/latinmodern-math.otf");
-            const FontSrcFile fira_math("data/firamath/FiraMath-Regular.clm2", "data/firamath/FiraMath-Regular.otf");
-            // XITS
-            const FontSrcFile math_regular("data/xits/XITSMath-Regular.clm2", "data/xits/XITSMath-Regular.otf");
-            // const FontSrcFile math_bold("data/xits/XITSMath-Bold.clm2", "data/xits/XITSMath-Bold.otf");
-            const FontSrcFile xits_boldItalic("data/xits/XITS-BoldItalic.clm2", "data/xits/XITS-BoldItalic.otf");
-            const FontSrcFile xits_regular("data/xits/XITS-Regular.clm2", "data/xits/XITS-Regular.otf");
-            const FontSrcFile xits_bold("data/xits/XITS-Bold.clm2", "data/xits/XITS-Bold.otf");
-            const FontSrcFile xits_italic("data/xits/XITS-Italic.clm2", "data/xits/XITS-Italic.otf");
-            // auto auto_font = microtex::InitFontSenseAuto();
-
-            MicroTeX::init(math_regular);
-            // MicroTeX::addFont(math_bold);
-            MicroTeX::addFont(xits_boldItalic);
-            MicroTeX::addFont(xits_regular);
-            MicroTeX::addFont(xits_bold);
-            MicroTeX::addFont(xits_italic);
-            MicroTeX::addFont(tex_gyre);
-            MicroTeX::addFont(latin_modern);
-            MicroTeX::addFont(fira_math);
-            MicroTeX::setDefaultMainFont("XITS");
-            MicroTeX::setDefaultMathFont("XITS");
+            // Only checks the files, see loadMathFont
+            std::vector<FontFile> files(std::begin(text_fonts), std::end(text_fonts));
+            for (const auto& entry : font_families)
+                files.push_back(entry.file);
+            for (const auto& file : files) {
+                for (const char* path : { file.clm, file.otf }) {
+                    if (!std::filesystem::exists(path))
+                        return std::string("Font file not found: ") + path;
+                }
+            }
+            if (auto* selected = find_family(family)) {
+                std::lock_guard<std::mutex> lock(font_family_mutex);
+                font_family = selected->name;
+                font_family_math = selected->math_font;
+            }
 
             PlatformFactory::registerFactory("abstract", std::make_unique<PlatformFactory_abstract>());
             PlatformFactory::activate("abstract");
+            // Set once here instead of for every image, as it is not safe to do while other threads render
+            std::locale::global(std::locale(""));
             is_initialized = true;
             return "";
         }
@@ -48,23 +174,111 @@ namespace Latex {
     std::vector<std::string> getFontFamilies() {
         return { "Latin Modern", "XITS" ,  /*"XITS Bold" // Is broken, */ "Fira Math",  "Gyre DejaVu" };
     }
-    void setDefaultFontFamily(const std::string& family) {
+    std::string setDefaultFontFamily(const std::string& family) {
         using namespace microtex;
-        if (family == "XITS") {
-            font_family_math = "XITS Math";
-        }
-        // else if (family == "XITS Bold") {
-        //     font_family_math = "XITS Math Bold";
-        // }
-        else if (family == "Fira Math") {
-            font_family_math = "Fira Math Regular";
-        }
-        else if (family == "Latin Modern") {
-            font_family_math = "LatinModernMath-Regular";
-        }
-        else if (family == "Gyre DejaVu") {
-            font_family_math = "TeXGyreDejaVuMath-Regular";
+        FontFamily* selected = find_family(family);
+        if (selected == nullptr)
+            return "Unknown font family " + family;
+        // Only the math font: the text fonts are loaded by the first render
+        // The family is selected even if it failed to load, the renders then fail with the same message
+        std::string err;
+        if (is_initialized) {
+            std::lock_guard<std::mutex> lock(microtex_mutex);
+            try {
+                load_family(*selected);
+            }
+            catch (std::exception& e) {
+                err = e.what();
+            }
         }
+        // font_family_math is read by parsers running on other threads
+        std::lock_guard<std::mutex> lock(font_family_mutex);
+        font_family = selected->name;
+        font_family_math = selected->math_font;
+        return err;
+    }
+
+    void loadMathFont(const std::string& math_font) {
+        FontFamily* family = find_math_font(math_font);
+        if (family == nullptr)
+            throw std::invalid_argument("Unknown math font " + math_font);
+        load_family(*family);
+        load_text_fonts();
+    }
+
+    void preloadFontFamilies() {
+        if (!is_initialized || preload_thread.thread.joinable())
+            return;
+        stop_preload = false;
+        preload_thread.thread = std::thread([]() {
+            // One family at a time, such that renders are not blocked for long
+            for (auto& family : font_families) {
+                if (stop_preload)
+                    return;
+                std::lock_guard<std::mutex> lock(microtex_mutex);
+                try {
+                    load_family(family);
+                    load_text_fonts();
+                }
+                catch (std::exception& e) {
+                    // Nobody waits for this thread: logged, and reported again by the renders of this family
+                    std::cerr << "Could not preload font family " << family.name << ": " << e.what() << std::endl;
+                }
+            }
+            });
+    }
+
+    microtex::color toMicroTeXColor(const ImVec4& color) {
+        auto channel = [](float value) { return (microtex::color)(std::clamp(value, 0.f, 1.f) * 255.f + 0.5f); };
+        return channel(color.w) << 24 | channel(color.x) << 16 | channel(color.y) << 8 | channel(color.z);
+    }
+
+    void setRenderGlyphs(bool use_font_engine) {
+        std::lock_guard<std::mutex> lock(microtex_mutex);
+        microtex::MicroTeX::setRenderGlyphUsePath(!use_font_engine);
+        render_glyphs = use_font_engine;
+    }
+    bool isRenderingGlyphs() {
+        return render_glyphs;
+    }
+
+    void setMaxUntiledSize(int pixels) {
+        max_untiled_size = std::max(TiledRaster::tile_size, pixels);
+    }
+    int getMaxUntiledSize() {
+        return max_untiled_size;
+    }
+
+    void setRasterThreads(int threads) {
+        raster_threads = std::max(0, threads);
+    }
+    int getRasterThreads() {
+        return raster_threads;
+    }
+
+    /**
+     * Returns the threads to use for a raster (0 -> the whole pool)
+     */
+    static int raster_thread_count() {
+        int threads = raster_threads;
+        return threads == 0 ? ThreadPool::getInstance().getThreadCount() : threads;
+    }
+
+    static int raster_band_count(int width, int height) {
+        int threads = raster_threads == 1 ? 1 : raster_thread_count();
+        if (threads <= 1 || (size_t)width * height < min_parallel_pixels)
+            return 1;
+        // More bands than threads, as the ink is not evenly spread over the height
+        return std::clamp(height / min_band_height, 1, 2 * threads);
+    }
+
+    std::string getMathFontFamily() {
+        std::lock_guard<std::mutex> lock(font_family_mutex);
+        return font_family_math;
+    }
+
+    std::mutex& getMicroTeXMutex() {
+        return microtex_mutex;
     }
 
     bool isInitialized() {
@@ -72,74 +286,477 @@ namespace Latex {
     }
 
     void release() {
-        microtex::MicroTeX::release();
+        preload_thread.stop();
+        std::lock_guard<std::mutex> lock(microtex_mutex);
+        if (microtex_initialized)
+            microtex::MicroTeX::release();
+        microtex_initialized = false;
+        text_fonts_loaded = false;
+        for (auto& family : font_families)
+            family.loaded = false;
         is_initialized = false;
     }
 
-    void LatexImage::render(ImVec2 scale, ImVec2 inner_padding) {
-        m_painter.start(ImVec2(ceil(m_render->getWidth()), ceil(m_render->getHeight())), scale, inner_padding);
-        m_graphics.distributeCallList(&m_painter);
-        m_painter.finish();
-        auto data = m_painter.getImageData();
-        if (data != nullptr)
-            m_image->setImage(data, m_painter.getImageDimensions().x, m_painter.getImageDimensions().y, Image::FILTER_BILINEAR);
+    /**
+     * Returns true if the source uses a color command (\color, \textcolor, \colorbox...)
+     */
+    static bool has_color_command(const std::string& latex) {
+        for (size_t i = 0;i < latex.size();i++) {
+            if (latex[i] != '\\')
+                continue;
+            size_t end = i + 1;
+            while (end < latex.size() && std::isalpha((unsigned char)latex[end]))
+                end++;
+            if (latex.substr(i + 1, end - i - 1).find("color") != std::string::npos)
+                return true;
+            // Skips the escaped character of \\, \{...
+            i = std::max(i + 1, end - 1);
+        }
+        return false;
     }
 
-    LatexImage::LatexImage(const std::string& latex_src, float font_size, float line_space, microtex::color text_color, ImVec2 scale, ImVec2 inner_padding) {
+    ParsedLatex::ParsedLatex(const std::string& latex_src, float font_size, float line_space, microtex::color text_color,
+        const std::string& math_font_name) {
+        m_font_size = font_size;
+        m_text_color = text_color;
         if (!is_initialized) {
             m_latex_error_msg = "LateX has not been initialized";
             return;
         }
-        m_image = std::make_shared<Image>();
         using namespace microtex;
+        Render* render = nullptr;
         try {
-            std::locale::global(std::locale(""));
+            std::string math_font = math_font_name.empty() ? getMathFontFamily() : math_font_name;
+            std::lock_guard<std::mutex> lock(microtex_mutex);
+            loadMathFont(math_font);
             // Default width large enough
 
-            m_render = MicroTeX::parse(
-                latex_src,
-                0, font_size, line_space, text_color,
-                true,
-                OverrideTeXStyle(false, TexStyle::display),
-                font_family_math
-            );
-            float height = m_render->getHeight(); // total height of the box = ascent + descent
-            m_descent = m_render->getDepth();   // depth = descent
-            m_ascent = height - m_descent;
+            {
+                StageProfiler::Scope profile(StageProfiler::PARSE);
+                render = MicroTeX::parse(
+                    latex_src,
+                    0, font_size, line_space, text_color,
+                    true,
+                    OverrideTeXStyle(false, TexStyle::display),
+                    math_font
+                );
+            }
+            m_width = render->getWidth();
+            m_height = render->getHeight(); // total height of the box = ascent + descent
+            m_descent = render->getDepth();   // depth = descent
+            m_ascent = m_height - m_descent;
 
-            m_render->draw(m_graphics, 0.f, 0.f);
-            // m_render->~Render();
+            // All the draw calls are recorded, the render is not needed anymore
+            {
+                StageProfiler::Scope profile(StageProfiler::LAYOUT);
+                render->draw(m_graphics, 0.f, 0.f);
+            }
+            delete render;
 
+            // \color, \colorbox... make the formula multicolored, even in the text color
+            m_explicit_colors = has_color_command(latex_src);
+            m_monochrome = !m_explicit_colors;
+            for (const auto& command : m_graphics.getCallList().commands()) {
+                if (command.op == OpCode::SET_COLOR && (color)command.i[0] != text_color) {
+                    m_monochrome = false;
+                    break;
+                }
+            }
         }
         catch (std::exception& e) {
             m_latex_error_msg = e.what();
+            if (render != nullptr) {
+                std::lock_guard<std::mutex> lock(microtex_mutex);
+                delete render;
+            }
+        }
+    }
+
+    void ParsedLatex::getDrawRegion(ImVec2 margin, ImVec2& origin, ImVec2& size) const {
+        // Only the region holding ink is drawn
+        // Estimated text boxes are merged with the layout box, which bounds the glyphs better
+        ImVec2 min_pos(0.f, 0.f);
+        ImVec2 max_pos(ceil(m_width), ceil(m_height));
+        ImVec2 ink_min, ink_max;
+        if (m_graphics.getInkBounds(ink_min, ink_max)) {
+            if (m_graphics.areInkBoundsExact()) {
+                min_pos = ink_min;
+                max_pos = ink_max;
+            }
+            else {
+                min_pos = ImVec2(std::min(min_pos.x, ink_min.x), std::min(min_pos.y, ink_min.y));
+                max_pos = ImVec2(std::max(max_pos.x, ink_max.x), std::max(max_pos.y, ink_max.y));
+            }
+        }
+        origin = ImVec2(floor(min_pos.x - margin.x), floor(min_pos.y - margin.y));
+        size = ImVec2(ceil(max_pos.x + margin.x) - origin.x, ceil(max_pos.y + margin.y) - origin.y);
+    }
+
+    PixelBuffer ParsedLatex::rasterize(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format, Quality quality) const {
+        PixelBuffer pixels;
+        if (!m_latex_error_msg.empty())
+            return pixels;
+        if (!m_monochrome)
+            format = PixelBuffer::ARGB32_PREMULTIPLIED;
+        const bool coverage = format == PixelBuffer::A8;
+
+        // One more pixel for the antialiasing
+        ImVec2 origin, size;
+        getDrawRegion(ImVec2(inner_padding.x + 1.f / scale.x, inner_padding.y + 1.f / scale.y), origin, size);
+
+        int width = int(scale.x * size.x);
+        int height = int(scale.y * size.y);
+        int stride = 0;
+        if (width <= 0 || height <= 0)
+            return pixels;
+        ARGB_Imageptr buffer = nullptr;
+        int bands = raster_band_count(width, height);
+        StageProfiler::Scope profile(StageProfiler::REPLAY);
+        if (bands > 1) {
+            buffer = paintBands(origin, scale, width, height, bands, text_color, coverage, quality, stride);
+        }
+        else {
+            microtex::Cairo_Painter painter;
+            if (canReplaceColor(text_color))
+                painter.setColorReplacement(m_text_color, text_color);
+            painter.setCoverageOnly(coverage);
+            painter.setAntialias(quality == Quality::DRAFT ? CAIRO_ANTIALIAS_FAST : CAIRO_ANTIALIAS_DEFAULT);
+            painter.startRegion(origin, size, scale);
+            m_graphics.getCallList().replay(&painter);
+            painter.finish();
+            buffer = painter.getImageBuffer();
+            stride = painter.getImageStride();
+        }
+        if (buffer == nullptr)
+            return pixels;
+
+        // Trims the transparent border left by the estimates, then puts the padding back
+        int x = 0, y = 0, w = width, h = height;
+        bool visible = coverage
+            ? PixelConvert::findCoverageBounds(buffer->data(), width, height, stride, x, y, w, h)
+            : PixelConvert::findOpaqueBounds(buffer->data(), width, height, stride, x, y, w, h);
+        if (visible) {
+            int pad_x = (int)round(scale.x * inner_padding.x);
+            int pad_y = (int)round(scale.y * inner_padding.y);
+            int x1 = std::min(width, x + w + pad_x);
+            int y1 = std::min(height, y + h + pad_y);
+            x = std::max(0, x - pad_x);
+            y = std::max(0, y - pad_y);
+            w = x1 - x;
+            h = y1 - y;
+        }
+        else {
+            x = y = 0;
+            w = width;
+            h = height;
+        }
+
+        pixels.width = w;
+        pixels.height = h;
+        pixels.stride = stride;
+        pixels.format = format;
+        pixels.offset = (size_t)y * stride + (size_t)x * pixels.bytesPerPixel();
+        pixels.tint = text_color;
+        // Adopts the surface's buffer, no copy: the crop is a view into it
+        pixels.data = buffer;
+        pixels.ascent = scale.y * (m_ascent - origin.y) - y;
+        pixels.descent = h - pixels.ascent;
+        return pixels;
+    }
+
+    ARGB_Imageptr ParsedLatex::paintBands(ImVec2 origin, ImVec2 scale, int width, int height, int bands, microtex::color text_color, bool coverage, Quality quality, int& stride) const {
+        auto& pool = microtex::SurfacePool::getThreadInstance();
+        const cairo_format_t cairo_format = coverage ? CAIRO_FORMAT_A8 : CAIRO_FORMAT_ARGB32;
+        auto target = pool.acquire(width, height, cairo_format);
+        cairo_surface_flush(target.surface);
+        unsigned char* data = cairo_image_surface_get_data(target.surface);
+        stride = cairo_image_surface_get_stride(target.surface);
+
+        ThreadPool::getInstance().parallelFor((size_t)bands, [&](size_t i) {
+            const int y0 = (int)(height * i / bands);
+            const int y1 = (int)(height * (i + 1) / bands);
+            // Each band is a surface over its own rows of the target: it clips the whole
+            // call list to them, and the bands never write to the same pixels
+            cairo_surface_t* surface = cairo_image_surface_create_for_data(data + (size_t)y0 * stride, cairo_format, width, y1 - y0, stride);
+            cairo_t* context = cairo_create(surface);
+            microtex::Cairo_Painter painter;
+            if (canReplaceColor(text_color))
+                painter.setColorReplacement(m_text_color, text_color);
+            painter.setCoverageOnly(coverage);
+            painter.setAntialias(quality == Quality::DRAFT ? CAIRO_ANTIALIAS_FAST : CAIRO_ANTIALIAS_DEFAULT);
+            painter.startTarget(context, origin, scale, 0, y0, width, y1 - y0);
+            m_graphics.getCallList().replay(&painter);
+            painter.finish();
+            cairo_destroy(context);
+            cairo_surface_destroy(surface);
+            }, raster_thread_count());
+        cairo_surface_mark_dirty(target.surface);
+
+        // Adopted like the surface of a painter: only reused by the pool once the pixels are dropped
+        ARGB_Imageptr buffer = target.buffer;
+        pool.release(target);
+        return buffer;
+    }
+
+    ImVec2 ParsedLatex::getRasterSize(ImVec2 scale, ImVec2 inner_padding) const {
+        if (!m_latex_error_msg.empty())
+            return ImVec2(0.f, 0.f);
+        ImVec2 origin, size;
+        getDrawRegion(ImVec2(inner_padding.x + 1.f / scale.x, inner_padding.y + 1.f / scale.y), origin, size);
+        return ImVec2((float)int(scale.x * size.x), (float)int(scale.y * size.y));
+    }
+
+    ImVec2 ParsedLatex::getRasterOrigin(ImVec2 scale, ImVec2 inner_padding) const {
+        if (!m_latex_error_msg.empty())
+            return ImVec2(0.f, 0.f);
+        ImVec2 origin, size;
+        getDrawRegion(ImVec2(inner_padding.x + 1.f / scale.x, inner_padding.y + 1.f / scale.y), origin, size);
+        return ImVec2(-scale.x * origin.x, -scale.y * origin.y);
+    }
+
+    PixelBuffer ParsedLatex::rasterizeRegion(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, int x, int y, int width, int height, PixelBuffer::Format format) const {
+        PixelBuffer pixels;
+        if (!m_latex_error_msg.empty() || width <= 0 || height <= 0)
+            return pixels;
+        if (!m_monochrome)
+            format = PixelBuffer::ARGB32_PREMULTIPLIED;
+
+        // Same region as rasterize
+        ImVec2 origin, size;
+        getDrawRegion(ImVec2(inner_padding.x + 1.f / scale.x, inner_padding.y + 1.f / scale.y), origin, size);
+
+        StageProfiler::Scope profile(StageProfiler::REPLAY);
+        microtex::Cairo_Painter painter;
+        if (canReplaceColor(text_color))
+            painter.setColorReplacement(m_text_color, text_color);
+        painter.setCoverageOnly(format == PixelBuffer::A8);
+        painter.startTile(origin, scale, x, y, width, height);
+        m_graphics.getCallList().replay(&painter);
+        painter.finish();
+
+        auto buffer = painter.getImageBuffer();
+        if (buffer == nullptr)
+            return pixels;
+        pixels.width = width;
+        pixels.height = height;
+        pixels.stride = painter.getImageStride();
+        pixels.format = format;
+        pixels.tint = text_color;
+        pixels.data = buffer;
+        pixels.ascent = scale.y * (m_ascent - origin.y) - y;
+        pixels.descent = height - pixels.ascent;
+        return pixels;
+    }
+
+    std::string ParsedLatex::toVector(microtex::Cairo_Vector_Painter::Format format, float scale, ImVec2 inner_padding, microtex::color text_color) const {
+        if (!m_latex_error_msg.empty())
+            return "";
+
+        ImVec2 origin, size;
+        getDrawRegion(inner_padding, origin, size);
+
+        microtex::Cairo_Vector_Painter painter(format);
+        if (canReplaceColor(text_color))
+            painter.setColorReplacement(m_text_color, text_color);
+        painter.startRegion(origin, size, ImVec2(scale, scale));
+        m_graphics.getCallList().replay(&painter);
+        painter.finish();
+        return painter.getDocument();
+    }
+
+    void LatexImage::render(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color) {
+        m_text_color = text_color;
+        m_tiles = nullptr;
+        ImVec2 size = m_parsed->getRasterSize(scale, inner_padding);
+        const float max_size = (float)getMaxUntiledSize();
+        if (size.x > max_size || size.y > max_size) {
+            // Too large for a single surface / texture: tiles are rasterized when needed
+            m_tiles = std::make_unique<TiledRaster>(m_parsed, scale, inner_padding, text_color, m_format);
+            m_pixels = PixelBuffer();
+        }
+        else if (m_quality == Quality::DRAFT) {
+            m_pixels = m_parsed->rasterize(ImVec2(draft_scale * scale.x, draft_scale * scale.y), inner_padding, text_color, m_format, Quality::DRAFT);
+        }
+        else {
+            m_pixels = m_parsed->rasterize(scale, inner_padding, text_color, m_format);
+        }
+        m_uploaded = false;
+    }
+
+    LatexImage::LatexImage(const std::string& latex_src, float font_size, float line_space, microtex::color text_color, ImVec2 scale, ImVec2 inner_padding, const std::function<bool()>& is_cancelled, PixelBuffer::Format format) {
+        m_format = format;
+        if (!is_initialized) {
+            m_latex_error_msg = "LateX has not been initialized";
+            return;
+        }
+        m_image = std::make_shared<Image>();
+        m_parsed = std::make_shared<const ParsedLatex>(latex_src, font_size, line_space, text_color);
+        m_latex_error_msg = m_parsed->getLatexErrorMsg();
+        m_ascent = m_parsed->getAscent();
+        m_descent = m_parsed->getDescent();
+        if (is_cancelled != nullptr && is_cancelled()) {
+            m_cancelled = true;
+            return;
         }
         if (m_latex_error_msg.empty())
-            render(scale, inner_padding);
+            render(scale, inner_padding, text_color);
     }
-    LatexImage::~LatexImage() {
-        if (m_render != nullptr) {
-            delete m_render;
+    LatexImage::LatexImage(ParsedLatexPtr parsed, ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format, Quality quality) {
+        m_format = format;
+        m_quality = quality;
+        m_parsed = parsed;
+        if (m_parsed == nullptr) {
+            m_latex_error_msg = "No parsed formula";
+            return;
         }
+        m_latex_error_msg = m_parsed->getLatexErrorMsg();
+        if (!m_latex_error_msg.empty())
+            return;
+        m_image = std::make_shared<Image>();
+        m_ascent = m_parsed->getAscent();
+        m_descent = m_parsed->getDescent();
+        render(scale, inner_padding, text_color);
+    }
+    LatexImage::LatexImage(const PixelBuffer& pixels, const std::string& latex_error_msg, ParsedLatexPtr parsed, microtex::color text_color) {
+        m_parsed = parsed;
+        m_text_color = text_color;
+        m_latex_error_msg = latex_error_msg;
+        if (!m_latex_error_msg.empty())
+            return;
+        m_image = std::make_shared<Image>();
+        m_pixels = pixels;
+        m_format = pixels.format;
+        if (m_parsed != nullptr) {
+            m_ascent = m_parsed->getAscent();
+            m_descent = m_parsed->getDescent();
+        }
+        if (m_format == PixelBuffer::A8)
+            m_text_color = pixels.tint;
+    }
+    LatexImage::~LatexImage() {
     }
 
     std::shared_ptr<Image> LatexImage::getImage() {
+        if (m_image != nullptr && !m_uploaded) {
+            m_uploaded = true;
+            if (m_pixels.empty())
+                m_image->reset();
+            else
+                m_image->setImage(m_pixels, Image::FILTER_BILINEAR);
+        }
         return m_image;
     }
 
     ImVec2 LatexImage::getDimensions() {
+        if (m_latex_error_msg.empty() && m_tiles != nullptr)
+            return ImVec2((float)m_tiles->getWidth(), (float)m_tiles->getHeight());
+        if (m_latex_error_msg.empty() && isDraft())
+            return ImVec2(round(m_pixels.width / draft_scale), round(m_pixels.height / draft_scale));
         if (m_latex_error_msg.empty())
-            return m_painter.getImageDimensions();
+            return ImVec2((float)m_pixels.width, (float)m_pixels.height);
         else
             return ImVec2(0, 0);
     }
 
     void LatexImage::forgetImage() {
-        m_image->reset();
+        // No image is created for latex errors
+        if (m_image != nullptr)
+            m_image->reset();
+        m_pixels = PixelBuffer();
+        if (m_tiles != nullptr)
+            m_tiles->releaseAll();
+        m_uploaded = true;
     }
 
     void LatexImage::redraw(ImVec2 scale, ImVec2 inner_padding) {
-        if (m_latex_error_msg.empty())
-            render(scale, inner_padding);
+        redraw(scale, inner_padding, m_text_color);
+    }
+
+    void LatexImage::redraw(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color) {
+        if (m_latex_error_msg.empty() && m_parsed != nullptr)
+            render(scale, inner_padding, text_color);
+    }
+
+    std::string LatexImage::toVector(microtex::Cairo_Vector_Painter::Format format, float scale, ImVec2 inner_padding) {
+        if (!m_latex_error_msg.empty() || m_parsed == nullptr)
+            return "";
+        return m_parsed->toVector(format, scale, inner_padding, m_text_color);
+    }
+
+    std::vector<PixelBuffer> LatexImage::rasterize(const std::vector<float>& scales, ImVec2 inner_padding) {
+        std::vector<PixelBuffer> out;
+        if (!m_latex_error_msg.empty() || m_parsed == nullptr)
+            return out;
+        for (float scale : scales) {
+            out.push_back(m_parsed->rasterize(ImVec2(scale, scale), inner_padding, m_text_color, m_format));
+        }
+        return out;
+    }
+
+    std::vector<unsigned char> LatexImage::getRGBA() const {
+        if (!m_latex_error_msg.empty())
+            return {};
+        if (m_tiles == nullptr)
+            return m_pixels.empty() ? std::vector<unsigned char>() : PixelConvert::toRGBA(m_pixels);
+        const size_t row_bytes = (size_t)4 * m_tiles->getWidth();
+        std::vector<unsigned char> out(row_bytes * m_tiles->getHeight());
+        m_tiles->streamRGBA([&](const unsigned char* rgba, int y, int rows) {
+            memcpy(out.data() + y * row_bytes, rgba, rows * row_bytes);
+            return true;
+            });
+        return out;
+    }
+
+    bool LatexImage::streamRGBA(const std::function<bool(const unsigned char* rgba, int y, int rows)>& write) const {
+        if (!m_latex_error_msg.empty())
+            return false;
+        if (m_tiles != nullptr)
+            return m_tiles->streamRGBA(write);
+        if (m_pixels.empty())
+            return false;
+        auto rgba = PixelConvert::toRGBA(m_pixels);
+        return write(rgba.data(), 0, m_pixels.height);
+    }
+
+    bool LatexImage::savePNG(const std::string& path, const PngWriter::Options& options) const {
+        if (!m_latex_error_msg.empty())
+            return false;
+        if (m_tiles == nullptr) {
+            if (m_pixels.empty())
+                return false;
+            auto rgba = PixelConvert::toRGBA(m_pixels);
+            return PngWriter::write(path, rgba.data(), m_pixels.width, m_pixels.height, m_pixels.width * 4, options);
+        }
+
+        // The whole image is never in memory: the color mode is known from the tint instead of a scan
+        PngWriter::Options stream_options = options;
+        stream_options.mode = PngWriter::RGBA;
+        const microtex::color c = m_text_color;
+        if (m_tiles->getFormat() == PixelBuffer::A8 && ((c >> 16) & 0xff) == ((c >> 8) & 0xff) && (c & 0xff) == ((c >> 8) & 0xff))
+            stream_options.mode = PngWriter::GREY_ALPHA;
+        PngWriter::RowWriter writer(path, m_tiles->getWidth(), m_tiles->getHeight(), stream_options);
+        if (!writer.isValid())
+            return false;
+        bool written = m_tiles->streamRGBA([&](const unsigned char* rgba, int, int rows) {
+            return writer.writeRows(rgba, rows, 4 * m_tiles->getWidth());
+            });
+        return written && writer.finish();
+    }
+
+    bool LatexImage::recolor(microtex::color text_color) {
+        if (m_latex_error_msg.empty() && m_tiles != nullptr) {
+            if (m_tiles->getFormat() != PixelBuffer::A8)
+                return false;
+            m_text_color = text_color;
+            m_tiles->setTint(text_color);
+            return true;
+        }
+        if (!m_latex_error_msg.empty() || m_pixels.empty() || m_pixels.format != PixelBuffer::A8)
+            return false;
+        m_text_color = text_color;
+        m_pixels.tint = text_color;
+        if (m_image != nullptr)
+            m_image->setTint(text_color);
+        return true;
     }
 }
\ No newline at end of file
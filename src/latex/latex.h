@@ -2,21 +2,104 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
+#include <functional>
 #include <tempo.h>
 
 #include "core/image.h"
+#include "core/pixel_buffer.h"
+#include "core/png_writer.h"
 #include "cairo_painter.h"
+#include "cairo_vector_painter.h"
 
 namespace Latex {
     /**
-     * @brief Initializes the latex fonts and parser
+     * @brief Initializes the latex parser and registers the fonts
+     *
+     * The fonts are only checked here: the math font of a family is loaded on its
+     * first use (setDefaultFontFamily or a render), see preloadFontFamilies.
      *
      * @return std::string error message if failed
      */
     std::string init(const std::string& family = "XITS");
 
     std::vector<std::string> getFontFamilies();
-    void setDefaultFontFamily(const std::string& family);
+
+    /**
+     * @brief Converts a color of the GUI into a microtex::color (0xAARRGGBB)
+     *
+     * ImGui::ColorConvertFloat4ToU32 packs red in the low byte (ABGR), it must
+     * not be given to the renderer.
+     */
+    microtex::color toMicroTeXColor(const ImVec4& color);
+    /**
+     * @brief Selects the math font used by the parser, loading it if needed
+     *
+     * The family is selected even if its font could not be loaded.
+     *
+     * @return std::string error message if the family is unknown or its font could not be loaded
+     */
+    std::string setDefaultFontFamily(const std::string& family);
+
+    /**
+     * @brief Loads a math font (and the text fonts) if it has not been loaded yet
+     *
+     * getMicroTeXMutex() must be held. Throws if the font could not be loaded.
+     *
+     * @param math_font name of the math font, as returned by getMathFontFamily
+     */
+    void loadMathFont(const std::string& math_font);
+
+    /**
+     * @brief Loads all the font families on a background thread (once), e.g. after the first frame
+     *
+     * Stopped and joined by release(). Failures are written to stderr.
+     */
+    void preloadFontFamilies();
+
+    /**
+     * @brief Returns the name of the math font used by the parser
+     * (as set by setDefaultFontFamily)
+     */
+    std::string getMathFontFamily();
+
+    /**
+     * @brief Mutex that must be held while parsing / laying out with MicroTeX
+     *
+     * MicroTeX keeps global state in its parser, so only one thread at a time
+     * may call MicroTeX::parse and Render::draw. Rasterization with a
+     * Cairo_Painter does not need it.
+     */
+    std::mutex& getMicroTeXMutex();
+
+    /**
+     * @brief Chooses how glyphs are recorded by the parser
+     *
+     * @param use_font_engine if true, glyphs are drawn with the font engine (cairo_show_glyphs),
+     * otherwise as filled outlines (default). Only affects formulas parsed afterwards.
+     */
+    void setRenderGlyphs(bool use_font_engine);
+    bool isRenderingGlyphs();
+
+    /**
+     * @brief Sets the largest width / height (in pixels) rasterized as a single image
+     *
+     * Larger LatexImages are rasterized in tiles (see TiledRaster), e.g. to stay below
+     * the maximum texture size of the GPU. Default: 4096
+     */
+    void setMaxUntiledSize(int pixels);
+    int getMaxUntiledSize();
+
+    /**
+     * @brief Sets the number of threads rasterizing a single large formula
+     *
+     * Large formulas are split into horizontal bands replayed in parallel on the
+     * shared ThreadPool, the missing tiles of a tiled image are rasterized in parallel.
+     *
+     * @param threads 1 (default): single-threaded, 0: all the hardware threads
+     */
+    void setRasterThreads(int threads);
+    int getRasterThreads();
 
 
     /**
@@ -27,25 +110,162 @@ namespace Latex {
 
     void release();
 
+    /**
+     * @brief Quality of a raster
+     */
+    enum class Quality {
+        FINAL, // antialiased
+        DRAFT  // CAIRO_ANTIALIAS_FAST, quick to rasterize but jagged (previews)
+    };
+
+    /**
+     * @brief Parsed latex: the recorded draw calls and the metrics of the formula
+     *
+     * Immutable once created, can be shared between threads and rasterized
+     * many times (at any scale, padding or text color) without parsing again.
+     */
+    class ParsedLatex {
+    private:
+        microtex::Graphics2D_abstract m_graphics;
+        float m_width = 0.f;
+        float m_height = 0.f;
+        float m_ascent = 0.f;
+        float m_descent = 0.f;
+        float m_font_size = 0.f;
+        microtex::color m_text_color = microtex::BLACK;
+        bool m_monochrome = true; // everything is drawn in m_text_color
+        bool m_explicit_colors = false; // the source sets colors, which must not be replaced
+
+        std::string m_latex_error_msg;
+
+        /**
+         * @brief Region to draw (in MicroTeX units): the ink grown by margin, on integer coordinates
+         */
+        void getDrawRegion(ImVec2 margin, ImVec2& origin, ImVec2& size) const;
+
+        /**
+         * @brief Paints the region in horizontal bands on the ThreadPool, in place into a pooled surface
+         *
+         * @param stride set to the number of bytes per row of the returned buffer
+         */
+        ARGB_Imageptr paintBands(ImVec2 origin, ImVec2 scale, int width, int height, int bands, microtex::color text_color, bool coverage, Quality quality, int& stride) const;
+    public:
+        /**
+         * @brief Parses the latex source and records its draw calls
+         *
+         * @param latex_src latex source
+         * @param font_size indicative font size for latex
+         * @param line_space space between lines
+         * @param text_color default text color
+         * @param math_font math font to parse with (see getMathFontFamily), the current one if empty
+         */
+        ParsedLatex(const std::string& latex_src, float font_size = 18.f, float line_space = 7.f, microtex::color text_color = microtex::BLACK,
+            const std::string& math_font = "");
+
+        /**
+         * @brief Rasterizes the recorded draw calls into a new pixel buffer
+         *
+         * @param scale rescale the image (in x and y)
+         * @param inner_padding horizontal and vertical inner padding (will be scaled)
+         * @param text_color replaces the text color given when parsing (see hasExplicitColors)
+         * @param format A8 only keeps the coverage (text_color becomes the tint of the buffer),
+         * ignored if the formula is not monochrome
+         * @param quality DRAFT for a quick, non antialiased raster
+         */
+        PixelBuffer rasterize(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format = PixelBuffer::ARGB32_PREMULTIPLIED, Quality quality = Quality::FINAL) const;
+
+        /**
+         * @brief Size in pixels of the untrimmed raster of the formula, see rasterizeRegion
+         */
+        ImVec2 getRasterSize(ImVec2 scale, ImVec2 inner_padding) const;
+
+        /**
+         * @brief Position in pixels of the origin of the formula (left of the box, on its top)
+         * in the untrimmed raster, see rasterizeRegion
+         */
+        ImVec2 getRasterOrigin(ImVec2 scale, ImVec2 inner_padding) const;
+
+        /**
+         * @brief Rasterizes only the pixels [x, x + width) x [y, y + height) of the untrimmed raster
+         *
+         * Contrary to rasterize, the result is not trimmed to the ink: regions of the same
+         * raster (e.g. tiles) line up exactly. Same parameters as rasterize.
+         */
+        PixelBuffer rasterizeRegion(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, int x, int y, int width, int height, PixelBuffer::Format format = PixelBuffer::ARGB32_PREMULTIPLIED) const;
+
+        /**
+         * @brief Writes the recorded draw calls as a vector document (nothing is rasterized)
+         *
+         * @param format SVG or PDF
+         * @param scale rescale the document
+         * @param inner_padding horizontal and vertical inner padding (will be scaled)
+         * @param text_color replaces the text color given when parsing
+         * @return the document (empty if it could not be written)
+         */
+        std::string toVector(microtex::Cairo_Vector_Painter::Format format, float scale, ImVec2 inner_padding, microtex::color text_color) const;
+
+        const microtex::Graphics2D_abstract& getGraphics() const { return m_graphics; }
+
+        std::string getLatexErrorMsg() const { return m_latex_error_msg; }
+        float getWidth() const { return m_width; }
+        float getHeight() const { return m_height; }
+        float getAscent() const { return m_ascent; }
+        float getDescent() const { return m_descent; }
+        float getFontSize() const { return m_font_size; }
+        microtex::color getTextColor() const { return m_text_color; }
+        /**
+         * @brief Returns true if the whole formula is drawn in the text color (see rasterize)
+         */
+        bool isMonochrome() const { return m_monochrome; }
+        /**
+         * @brief Returns true if the source sets colors (\color, \colorbox...): the text
+         * color given when parsing is then kept by the rasters, it must be parsed again
+         */
+        bool hasExplicitColors() const { return m_explicit_colors; }
+        /**
+         * @brief Returns true if rasterizing in text_color replaces the text color given when parsing
+         */
+        bool canReplaceColor(microtex::color text_color) const { return text_color != m_text_color && !m_explicit_colors; }
+    };
+
+    using ParsedLatexPtr = std::shared_ptr<const ParsedLatex>;
+
+    class TiledRaster;
+
     /**
      * @brief A LatexImage generates an image from a latex source
      *
-     * Can only be rescaled after creation
+     * Can only be rescaled / recolored after creation, which does not parse again
      *
+     * Parsing and rasterization only produce a CPU PixelBuffer, so a LatexImage
+     * can be created on any thread. The GL texture is only created when
+     * getImage() is called, which must be done on the thread owning the GL context.
+     *
+     * Images larger than getMaxUntiledSize() are tiled: getPixels() and getImage() are then
+     * empty, the tiles are rasterized and uploaded on demand through getTiles().
+     *
+     * Draft images are rasterized at draft_scale without antialiasing, to be shown
+     * (stretched to getDimensions()) until the final image is ready.
      */
     class LatexImage {
+    public:
+        static constexpr float draft_scale = 0.5f;
     private:
-        microtex::Render* m_render = nullptr;
-        microtex::Graphics2D_abstract m_graphics;
+        ParsedLatexPtr m_parsed = nullptr;
         std::shared_ptr<Image> m_image;
-        microtex::Cairo_Painter m_painter;
-        float m_ascent;
-        float m_descent;
-        float m_baseline;
+        PixelBuffer m_pixels;
+        std::unique_ptr<TiledRaster> m_tiles;
+        bool m_uploaded = false;
+        float m_ascent = 0.f;
+        float m_descent = 0.f;
+        microtex::color m_text_color = microtex::BLACK;
+        PixelBuffer::Format m_format = PixelBuffer::ARGB32_PREMULTIPLIED; // requested, see ParsedLatex::rasterize
+        Quality m_quality = Quality::FINAL;
 
         std::string m_latex_error_msg;
+        bool m_cancelled = false;
 
-        void render(ImVec2 scale, ImVec2 inner_padding);
+        void render(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color);
     public:
         /**brief Create a Latex Image
          *
@@ -54,8 +274,35 @@ namespace Latex {
          * @param text_color defaut text color
          * @param scale rescale the image (in x and y)
          * @param inner_padding horizontal and vertical inner padding (will be scaled)
+         * @param is_cancelled optional, checked between parsing and rasterization;
+         * if it returns true, the image is not rasterized (see isCancelled)
+         * @param format A8 to only keep the coverage of monochrome formulas (see recolor)
          */
-        LatexImage(const std::string& latex_src, float font_size = 18.f, float line_space = 7.f, microtex::color text_color = microtex::BLACK, ImVec2 scale = ImVec2(1.f, 1.f), ImVec2 inner_padding = ImVec2(20.f, 20.f));
+        LatexImage(const std::string& latex_src, float font_size = 18.f, float line_space = 7.f, microtex::color text_color = microtex::BLACK, ImVec2 scale = ImVec2(1.f, 1.f), ImVec2 inner_padding = ImVec2(20.f, 20.f), const std::function<bool()>& is_cancelled = nullptr, PixelBuffer::Format format = PixelBuffer::ARGB32_PREMULTIPLIED);
+
+        /**
+         * @brief Create a Latex Image by rasterizing already parsed latex
+         *
+         * @param parsed parsed latex (shared, not copied)
+         * @param scale rescale the image (in x and y)
+         * @param inner_padding horizontal and vertical inner padding (will be scaled)
+         * @param text_color replaces the text color given when parsing
+         * @param format A8 to only keep the coverage of monochrome formulas (see recolor)
+         * @param quality DRAFT for a draft image (ignored for tiled images)
+         */
+        LatexImage(ParsedLatexPtr parsed, ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format = PixelBuffer::ARGB32_PREMULTIPLIED, Quality quality = Quality::FINAL);
+
+        /**
+         * @brief Create a Latex Image from already rendered pixels (e.g. from a cache)
+         *
+         * @param pixels rendered pixels
+         * @param latex_error_msg error message of the original render (if any)
+         * @param parsed optional, parsed latex of the pixels; without it, redraw, rasterize
+         * and toVector do nothing
+         * @param text_color color the pixels have been rendered in, used to render the parse
+         * again (A8 pixels use their tint)
+         */
+        LatexImage(const PixelBuffer& pixels, const std::string& latex_error_msg = "", ParsedLatexPtr parsed = nullptr, microtex::color text_color = microtex::BLACK);
 
         ~LatexImage();
 
@@ -65,14 +312,67 @@ namespace Latex {
          * Could be empty if forgetImage has been called or
          * if an latex error has occured
          *
+         * Uploads the pixels to the GPU on first call after a (re)draw,
+         * so must only be called from the thread owning the GL context
+         *
          * @return const Image&
          */
         std::shared_ptr<Image> getImage();
 
+        /**
+         * @brief Returns the rendered pixels, without any GPU involvement
+         *
+         * Empty if forgetImage has been called or if a latex error has occured
+         */
+        const PixelBuffer& getPixels() const { return m_pixels; }
+
+        /**
+         * @brief Returns true for a draft image, whose pixels are smaller than getDimensions()
+         */
+        bool isDraft() const { return m_quality == Quality::DRAFT && m_tiles == nullptr; }
+
+        /**
+         * @brief Returns true if the image is too large to be rasterized at once, see getTiles
+         */
+        bool isTiled() const { return m_tiles != nullptr; }
+
+        /**
+         * @brief Returns the tiles of a tiled image (nullptr otherwise)
+         */
+        TiledRaster* getTiles() { return m_tiles.get(); }
+
+        /**
+         * @brief Returns the whole image as straight alpha RGBA bytes, tightly packed
+         * (stitched from the tiles for tiled images)
+         */
+        std::vector<unsigned char> getRGBA() const;
+
+        /**
+         * @brief Gives the image as consecutive bands of straight alpha RGBA rows,
+         * without holding a tiled image in memory at once (see TiledRaster::streamRGBA)
+         *
+         * @return false if the image is empty or write stopped the stream
+         */
+        bool streamRGBA(const std::function<bool(const unsigned char* rgba, int y, int rows)>& write) const;
+
+        /**
+         * @brief Writes the image as a PNG file, streamed row by row for tiled images
+         * (which are then written as grey + alpha or RGBA, without palette reduction)
+         *
+         * @return false if the image is empty or could not be written
+         */
+        bool savePNG(const std::string& path, const PngWriter::Options& options = PngWriter::Options()) const;
+
+        /**
+         * @brief Returns the parsed latex (nullptr if not available)
+         */
+        ParsedLatexPtr getParsed() const { return m_parsed; }
+
         /**
          * @brief Returns the dimensions of the latex image
          *
          * Returns the correct dimensions even if the image has been forgotten with forgetImage()
+         * (those of the final image for a draft)
          * If a latex error occured in the creation of the object, returns (0,0)
          *
          * @return ImVec2
@@ -84,6 +384,11 @@ namespace Latex {
          */
         std::string getLatexErrorMsg() { return m_latex_error_msg; }
 
+        /**
+         * @brief Returns true if the rendering was cancelled before rasterization
+         */
+        bool isCancelled() { return m_cancelled; }
+
         float getAscent() { return m_ascent; }
         float getDescent() { return m_descent; }
 
@@ -102,6 +407,42 @@ namespace Latex {
          * @param inner_padding horizontal and vertical inner padding (will be scaled)
          */
         void redraw(ImVec2 scale = ImVec2(1.f, 1.f), ImVec2 inner_padding = ImVec2(20.f, 20.f));
+
+        /**
+         * @brief Redraws the parsed latex into an image with another text color
+         *
+         * @param text_color replaces the text color given at creation
+         */
+        void redraw(ImVec2 scale, ImVec2 inner_padding, microtex::color text_color);
+
+        /**
+         * @brief Rasterizes the parsed latex at several scales in one call (e.g. 1x, 2x, 3x exports)
+         * Does not modify the image
+         *
+         * @param scales uniform scales
+         * @param inner_padding horizontal and vertical inner padding (will be scaled)
+         * @return one pixel buffer per scale (empty if no parsed latex is available)
+         */
+        std::vector<PixelBuffer> rasterize(const std::vector<float>& scales, ImVec2 inner_padding);
+
+        /**
+         * @brief Writes the parsed latex as an SVG or PDF document, see ParsedLatex::toVector
+         * Does not modify the image
+         *
+         * @return the document (empty if no parsed latex is available)
+         */
+        std::string toVector(microtex::Cairo_Vector_Painter::Format format, float scale = 1.f, ImVec2 inner_padding = ImVec2(0.f, 0.f));
+
+        /**
+         * @brief Changes the text color without rendering again, only possible
+         * for coverage (A8) images: the color is applied when displayed / exported
+         *
+         * @param text_color 0xAARRGGBB, see toMicroTeXColor for GUI colors
+         * @return false if the image has to be redrawn to change its color
+         */
+        bool recolor(microtex::color text_color);
+
+        microtex::color getTextColor() const { return m_text_color; }
     };
 
     using LatexImagePtr = std::shared_ptr<LatexImage>;
@@ -0,0 +1,151 @@
+#include "render_cache.h"
+
+#include <functional>
+
+namespace Latex {
+    static bool is_whitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    std::string canonicalizeLatex(const std::string& latex) {
+        std::string out;
+        out.reserve(latex.size());
+        bool pending_space = false;
+        int pending_lines = 0; // line breaks in the pending whitespaces
+        bool in_comment = false;
+        for (size_t i = 0;i < latex.size();i++) {
+            char c = latex[i];
+            if (in_comment) {
+                // A comment is only ended by a line break, which must be kept
+                if (c == '\n') {
+                    out += '\n';
+                    in_comment = false;
+                }
+                else if (c != '\r') {
+                    out += c;
+                }
+                continue;
+            }
+            if (is_whitespace(c)) {
+                pending_space = true;
+                pending_lines += c == '\n' ? 1 : 0;
+                continue;
+            }
+            if (pending_space && !out.empty()) {
+                // A blank line is a paragraph break (\par in text mode), not a space.
+                // The line break ending a comment is the first line break of the run.
+                const bool after_comment = out.back() == '\n';
+                if (pending_lines + (after_comment ? 1 : 0) >= 2)
+                    out += after_comment ? "\n" : "\n\n";
+                else if (!after_comment)
+                    out += ' ';
+            }
+            pending_space = false;
+            pending_lines = 0;
+            // \% is an escaped percent sign, not a comment, but \\% is a line break followed by one:
+            // the percent sign is escaped only by an odd number of backslashes
+            if (c == '%') {
+                size_t backslashes = 0;
+                while (backslashes < i && latex[i - 1 - backslashes] == '\\')
+                    backslashes++;
+                in_comment = backslashes % 2 == 0;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    bool RenderKey::operator==(const RenderKey& other) const {
+        return latex == other.latex && font_family == other.font_family
+            && font_size == other.font_size && line_space == other.line_space
+            && text_color == other.text_color && is_inline == other.is_inline
+            && scale.x == other.scale.x && scale.y == other.scale.y
+            && inner_padding.x == other.inner_padding.x && inner_padding.y == other.inner_padding.y
+            && render_glyphs == other.render_glyphs && coverage == other.coverage;
+    }
+
+    size_t RenderKeyHash::operator()(const RenderKey& key) const {
+        size_t seed = std::hash<std::string>()(key.latex);
+        auto combine = [&seed](size_t value) {
+            seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+            };
+        combine(std::hash<std::string>()(key.font_family));
+        combine(std::hash<float>()(key.font_size));
+        combine(std::hash<float>()(key.line_space));
+        combine(std::hash<microtex::color>()(key.text_color));
+        combine(std::hash<bool>()(key.is_inline));
+        combine(std::hash<float>()(key.scale.x));
+        combine(std::hash<float>()(key.scale.y));
+        combine(std::hash<float>()(key.inner_padding.x));
+        combine(std::hash<float>()(key.inner_padding.y));
+        combine(std::hash<bool>()(key.render_glyphs));
+        combine(std::hash<bool>()(key.coverage));
+        return seed;
+    }
+
+    void RenderCache::evict() {
+        // Always keep the most recent entry, even if it is larger than the budget
+        while (m_bytes > m_byte_budget && m_entries.size() > 1) {
+            auto& entry = m_entries.back();
+            m_bytes -= entry.bytes;
+            m_index.erase(entry.key);
+            m_entries.pop_back();
+            m_evictions++;
+        }
+    }
+
+    bool RenderCache::get(const RenderKey& key, PixelBuffer& pixels, ParsedLatexPtr& parsed, std::string& error) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            m_misses++;
+            return false;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        pixels = it->second->pixels;
+        parsed = it->second->parsed;
+        error = it->second->error;
+        m_hits++;
+        return true;
+    }
+
+    void RenderCache::put(const RenderKey& key, const PixelBuffer& pixels, ParsedLatexPtr parsed, const std::string& error) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_bytes -= it->second->bytes;
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+        size_t bytes = pixels.byteSize() + key.latex.size() + error.size() + sizeof(Entry);
+        m_entries.push_front(Entry{ key, pixels, std::move(parsed), error, bytes });
+        m_index[key] = m_entries.begin();
+        m_bytes += bytes;
+        evict();
+    }
+
+    void RenderCache::setByteBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_byte_budget = bytes;
+        evict();
+    }
+
+    RenderCacheStats RenderCache::getStats() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        RenderCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.evictions = m_evictions;
+        stats.entries = m_entries.size();
+        stats.bytes = m_bytes;
+        stats.byte_budget = m_byte_budget;
+        return stats;
+    }
+
+    void RenderCache::clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+}
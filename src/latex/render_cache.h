@@ -0,0 +1,117 @@
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "core/pixel_buffer.h"
+#include "latex.h"
+
+namespace Latex {
+    /**
+     * @brief Normalizes the whitespaces of a latex source
+     *
+     * Runs of whitespaces are collapsed into a single space, or into a blank line if they
+     * hold one (a paragraph break), and leading / trailing whitespaces are removed.
+     * Line breaks ending a % comment are kept.
+     */
+    std::string canonicalizeLatex(const std::string& latex);
+
+    /**
+     * @brief Everything that influences the pixels of a rendered formula
+     */
+    struct RenderKey {
+        std::string latex; // canonicalized source
+        std::string font_family;
+        float font_size = 0.f;
+        float line_space = 0.f;
+        microtex::color text_color = 0;
+        bool is_inline = false;
+        ImVec2 scale = ImVec2(1.f, 1.f);
+        ImVec2 inner_padding = ImVec2(0.f, 0.f);
+        bool render_glyphs = false; // see Latex::setRenderGlyphs
+        bool coverage = false; // see RenderRequest::coverage
+
+        bool operator==(const RenderKey& other) const;
+    };
+
+    struct RenderKeyHash {
+        size_t operator()(const RenderKey& key) const;
+    };
+
+    struct RenderCacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+        size_t byte_budget = 0;
+    };
+
+    /**
+     * @brief Thread safe, bounded LRU cache of rendered formulas
+     *
+     * Stores the pixels (shared, not copied), the parse and the latex error message of
+     * renders, such that toggling between the same formulas does not parse nor rasterize
+     * again. The parse is kept for the exports of a cached image (vector formats, other
+     * scales), it is not counted in the byte budget.
+     */
+    class RenderCache {
+    private:
+        struct Entry {
+            RenderKey key;
+            PixelBuffer pixels;
+            ParsedLatexPtr parsed;
+            std::string error;
+            size_t bytes;
+        };
+        // Most recently used first
+        std::list<Entry> m_entries;
+        std::unordered_map<RenderKey, std::list<Entry>::iterator, RenderKeyHash> m_index;
+
+        size_t m_byte_budget = 64 * 1024 * 1024;
+        size_t m_bytes = 0;
+        size_t m_hits = 0;
+        size_t m_misses = 0;
+        size_t m_evictions = 0;
+
+        std::mutex m_mutex;
+
+        void evict();
+        RenderCache() {}
+    public:
+        RenderCache(RenderCache const&) = delete;
+        void operator=(RenderCache const&) = delete;
+
+        static RenderCache& getInstance() {
+            static RenderCache instance;
+            return instance;
+        }
+
+        /**
+         * @brief Looks up a render
+         *
+         * @param pixels filled with the cached pixels on hit
+         * @param parsed filled with the parse of the pixels on hit
+         * @param error filled with the cached latex error message on hit
+         * @return true on hit
+         */
+        bool get(const RenderKey& key, PixelBuffer& pixels, ParsedLatexPtr& parsed, std::string& error);
+
+        /**
+         * @brief Inserts (or refreshes) a render, evicting the least recently used
+         * entries if the byte budget is exceeded
+         */
+        void put(const RenderKey& key, const PixelBuffer& pixels, ParsedLatexPtr parsed, const std::string& error);
+
+        /**
+         * @brief Sets the maximum memory used by the cached renders (in bytes)
+         */
+        void setByteBudget(size_t bytes);
+
+        RenderCacheStats getStats();
+
+        void clear();
+    };
+}
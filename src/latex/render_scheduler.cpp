@@ -0,0 +1,43 @@
+#include "render_scheduler.h"
+
+#include <algorithm>
+
+namespace Latex {
+    // Weight of the last render time in the moving average
+    static constexpr double render_time_weight = 0.3;
+
+    void RenderScheduler::request(const RenderRequest& request, Clock::time_point now) {
+        if (!m_has_pending)
+            m_first_change = now;
+        m_pending = request;
+        m_has_pending = true;
+        m_last_change = now;
+        m_requests++;
+    }
+
+    bool RenderScheduler::poll(RenderRequest& request, Clock::time_point now) {
+        if (!m_has_pending)
+            return false;
+        if (now - m_last_change < getDebounce() && now - m_first_change < max_delay)
+            return false;
+        request = std::move(m_pending);
+        m_has_pending = false;
+        m_submitted++;
+        return true;
+    }
+
+    void RenderScheduler::addRenderTime(double ms) {
+        if (!m_has_render_time)
+            m_render_ms = ms;
+        else
+            m_render_ms += render_time_weight * (ms - m_render_ms);
+        m_has_render_time = true;
+    }
+
+    RenderScheduler::Clock::duration RenderScheduler::getDebounce() const {
+        if (m_render_ms < immediate_render_ms)
+            return Clock::duration::zero();
+        auto debounce = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(m_render_ms / 2.));
+        return std::min<Clock::duration>(debounce, max_debounce);
+    }
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+
+#include "render_worker.h"
+
+namespace Latex {
+    /**
+     * @brief Decides when the changes made in the UI are handed to the RenderWorker
+     *
+     * Bursts of changes (typing, dragging the size or the color...) are coalesced into
+     * a single request: it is submitted once no change came for the debounce delay,
+     * or at the latest max_delay after the first change of the burst, such that a
+     * continuous drag still updates the image regularly.
+     *
+     * The debounce adapts to the recent render times: formulas rendered within a frame
+     * are submitted right away, slower ones wait for half of their render time (at most
+     * max_debounce), as a render started earlier would most likely be outdated anyway.
+     *
+     * Only used from the UI thread.
+     */
+    class RenderScheduler {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr double immediate_render_ms = 16.;
+        static constexpr std::chrono::milliseconds max_debounce{ 150 };
+        static constexpr std::chrono::milliseconds max_delay{ 300 };
+    private:
+        RenderRequest m_pending;
+        bool m_has_pending = false;
+        Clock::time_point m_first_change;
+        Clock::time_point m_last_change;
+
+        // Moving average of the recent render times
+        double m_render_ms = 0.;
+        bool m_has_render_time = false;
+
+        size_t m_requests = 0;
+        size_t m_submitted = 0;
+    public:
+        /**
+         * @brief Replaces the pending request (if any) by a new one
+         */
+        void request(const RenderRequest& request, Clock::time_point now = Clock::now());
+
+        /**
+         * @brief Returns the pending request once it is due
+         *
+         * @param request replaced by the request to submit
+         * @return true if the request must be submitted now
+         */
+        bool poll(RenderRequest& request, Clock::time_point now = Clock::now());
+
+        /**
+         * @brief Returns true if a request is waiting to be submitted
+         */
+        bool hasPending() const { return m_has_pending; }
+
+        /**
+         * @brief Records the time a full quality render that missed the cache took
+         * (see RenderWorker::poll)
+         */
+        void addRenderTime(double ms);
+
+        /**
+         * @brief Current debounce delay, from the recent render times
+         */
+        Clock::duration getDebounce() const;
+
+        double getAverageRenderMs() const { return m_render_ms; }
+
+        /**
+         * @brief Number of requests made / submitted to the renderer
+         */
+        size_t getRequestCount() const { return m_requests; }
+        size_t getSubmittedCount() const { return m_submitted; }
+        /**
+         * @brief Number of renders avoided by coalescing requests
+         */
+        size_t getAvoidedCount() const { return m_requests - m_submitted - (m_has_pending ? 1 : 0); }
+    };
+}
@@ -0,0 +1,245 @@
+#include "render_worker.h"
+
+namespace Latex {
+    /**
+     * @brief Returns true if two keys only differ by parameters which can be applied
+     * when rasterizing (text color, scale and padding)
+     *
+     * The font size and line space change the layout (e.g. the rounding of the glyph
+     * metrics, rules), they need a new parse.
+     */
+    static bool same_parse(const RenderKey& a, const RenderKey& b) {
+        return a.latex == b.latex && a.font_family == b.font_family
+            && a.font_size == b.font_size && a.line_space == b.line_space
+            && a.is_inline == b.is_inline && a.render_glyphs == b.render_glyphs;
+    }
+
+    static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    RenderWorker::RenderWorker() {
+        m_thread = std::thread(&RenderWorker::loop, this);
+    }
+    RenderWorker::~RenderWorker() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    bool RenderWorker::canReuseParse(const RenderKey& key) const {
+        if (m_parsed == nullptr || !same_parse(key, m_parsed_key))
+            return false;
+        // Explicit colors equal to the text color of the parse must stay as they are
+        return key.text_color == m_parsed_key.text_color || !m_parsed->hasExplicitColors();
+    }
+
+    bool RenderWorker::canRescaleParse(const RenderKey& key) const {
+        if (m_parsed == nullptr || m_parsed->getFontSize() <= 0.f || !m_parsed->getLatexErrorMsg().empty())
+            return false;
+        RenderKey resized = key;
+        resized.font_size = m_parsed_key.font_size;
+        return canReuseParse(resized);
+    }
+
+    LatexImageUPtr RenderWorker::renderRescaled(const RenderRequest& request) {
+        auto format = request.coverage ? PixelBuffer::A8 : PixelBuffer::ARGB32_PREMULTIPLIED;
+        // The padding is scaled with the formula, it must stay the same in pixels
+        const float ratio = request.font_size / m_parsed->getFontSize();
+        const ImVec2 scale(request.scale.x * ratio, request.scale.y * ratio);
+        const ImVec2 padding(request.inner_padding.x / ratio, request.inner_padding.y / ratio);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reused_parses++;
+        }
+        return std::make_unique<LatexImage>(m_parsed, scale, padding, request.text_color, format);
+    }
+
+    LatexImageUPtr RenderWorker::renderExact(const RenderRequest& request, const RenderKey& key, const std::function<bool()>& is_outdated) {
+        auto format = request.coverage ? PixelBuffer::A8 : PixelBuffer::ARGB32_PREMULTIPLIED;
+        const ImVec2 scale = request.scale;
+        const ImVec2 padding = request.inner_padding;
+        if (canReuseParse(key)) {
+            // Gives the same pixels as a new parse, the result can be cached
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_reused_parses++;
+        }
+        else {
+            std::string latex = request.latex;
+            if (!request.is_inline)
+                latex = "\\[" + latex + "\\]";
+            m_parsed = std::make_shared<const ParsedLatex>(latex, request.font_size, request.line_space, request.text_color, request.font_family);
+            m_parsed_key = key;
+            if (is_outdated())
+                return nullptr;
+        }
+
+        // Large formulas are shown as a draft first, the final raster is skipped if outdated in the meantime
+        if (request.draft && m_parsed->getLatexErrorMsg().empty()) {
+            ImVec2 size = m_parsed->getRasterSize(scale, padding);
+            const float max_size = (float)getMaxUntiledSize();
+            if (size.x * size.y >= draft_min_pixels && size.x <= max_size && size.y <= max_size) {
+                const auto draft_start = std::chrono::steady_clock::now();
+                auto draft = std::make_unique<LatexImage>(m_parsed, scale, padding, request.text_color, format, Quality::DRAFT);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (is_outdated())
+                    return nullptr;
+                m_result = std::move(draft);
+                m_result_ms = -1.;
+                m_drafts++;
+                // The draft is not part of the render time (parse and final raster)
+                m_job_start += std::chrono::steady_clock::now() - draft_start;
+            }
+            if (is_outdated())
+                return nullptr;
+        }
+
+        auto image = std::make_unique<LatexImage>(m_parsed, scale, padding, request.text_color, format);
+        // Tiled images are rasterized on demand, there are no pixels to cache
+        if (!image->isTiled())
+            RenderCache::getInstance().put(key, image->getPixels(), m_parsed, image->getLatexErrorMsg());
+        return image;
+    }
+
+    LatexImageUPtr RenderWorker::renderPreview(const RenderRequest& request, const std::function<bool()>& is_outdated) {
+        Environment environment;
+        if (!request.incremental || request.is_inline || !splitEnvironment(request.latex, environment))
+            return nullptr;
+        auto format = request.coverage ? PixelBuffer::A8 : PixelBuffer::ARGB32_PREMULTIPLIED;
+        PixelBuffer pixels;
+        if (!m_environment_renderer.render(environment, request.font_family, request.font_size, request.line_space, request.text_color,
+            request.scale, request.inner_padding, format, pixels, is_outdated))
+            return nullptr;
+        return std::make_unique<LatexImage>(pixels);
+    }
+
+    void RenderWorker::loop() {
+        while (true) {
+            RenderRequest request;
+            RenderKey key;
+            uint64_t generation;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_stop || m_has_pending; });
+                if (m_stop)
+                    return;
+                request = std::move(m_pending);
+                key = std::move(m_pending_key);
+                m_has_pending = false;
+                generation = m_generation;
+            }
+            auto is_outdated = [this, generation]() { return m_generation != generation; };
+            m_job_start = std::chrono::steady_clock::now();
+
+            // Cached formulas are neither previewed nor rendered
+            LatexImageUPtr image;
+            PixelBuffer pixels;
+            ParsedLatexPtr parsed;
+            std::string error;
+            bool full_render = false;
+            if (RenderCache::getInstance().get(key, pixels, parsed, error)) {
+                // With the parse, the image can still be exported (vector formats, other scales)
+                image = std::make_unique<LatexImage>(pixels, error, parsed, request.text_color);
+            }
+            else if (request.resize_preview && canRescaleParse(key)) {
+                // Not the exact layout of this size, neither cached nor timed
+                image = renderRescaled(request);
+            }
+            else {
+                // A new size or color of the last parse is rasterized at once
+                LatexImageUPtr preview = nullptr;
+                if (!canReuseParse(key))
+                    preview = renderPreview(request, is_outdated);
+                if (preview != nullptr) {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    if (is_outdated())
+                        continue;
+                    // Shown right away, the worker stays busy until the exact image is there
+                    m_result = std::move(preview);
+                    m_result_ms = -1.;
+                    m_previews++;
+                    // Keystrokes coming in the meantime only get a new preview
+                    if (m_condition.wait_for(lock, exact_render_delay, [this] { return m_stop || m_has_pending; }))
+                        continue;
+                    m_job_start = std::chrono::steady_clock::now();
+                }
+                image = renderExact(request, key, is_outdated);
+                full_render = true;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_finished_generation = generation;
+            if (image == nullptr || image->isCancelled() || is_outdated()) {
+                m_dropped++;
+                continue;
+            }
+            // The image has never been uploaded, it is safe to drop an unretrieved result here
+            m_result = std::move(image);
+            m_result_ms = full_render ? elapsed_ms(m_job_start) : -1.;
+            m_rendered++;
+        }
+    }
+
+    void RenderWorker::submit(const RenderRequest& request) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            // Resolved once: the parse must use the font of the key, even if it is changed in the meantime
+            m_pending = request;
+            if (m_pending.font_family.empty())
+                m_pending.font_family = getMathFontFamily();
+            m_pending_key.latex = canonicalizeLatex(request.latex);
+            m_pending_key.font_family = m_pending.font_family;
+            m_pending_key.font_size = request.font_size;
+            m_pending_key.line_space = request.line_space;
+            m_pending_key.text_color = request.text_color;
+            m_pending_key.is_inline = request.is_inline;
+            m_pending_key.scale = request.scale;
+            m_pending_key.inner_padding = request.inner_padding;
+            m_pending_key.render_glyphs = isRenderingGlyphs();
+            m_pending_key.coverage = request.coverage;
+            m_has_pending = true;
+            m_generation++;
+        }
+        m_condition.notify_one();
+    }
+
+    bool RenderWorker::poll(LatexImageUPtr& image, double* render_ms) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_result == nullptr)
+            return false;
+        image = std::move(m_result);
+        if (render_ms != nullptr)
+            *render_ms = m_result_ms;
+        return true;
+    }
+
+    bool RenderWorker::isBusy() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_finished_generation != m_generation || m_result != nullptr;
+    }
+
+    size_t RenderWorker::getRenderedCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rendered;
+    }
+    size_t RenderWorker::getDroppedCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+    size_t RenderWorker::getReusedParseCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_reused_parses;
+    }
+    size_t RenderWorker::getPreviewCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_previews;
+    }
+    size_t RenderWorker::getDraftCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_drafts;
+    }
+}
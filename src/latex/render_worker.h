@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "latex.h"
+#include "environment_render.h"
+#include "render_cache.h"
+
+namespace Latex {
+    /**
+     * @brief Parameters of a LatexImage to be rendered in the background
+     */
+    struct RenderRequest {
+        std::string latex;
+        std::string font_family; // math font (see getMathFontFamily), the current one when submitted if empty
+        bool is_inline = false; // if false, the latex is rendered in display mode
+        float font_size = 18.f;
+        float line_space = 7.f;
+        microtex::color text_color = microtex::BLACK;
+        ImVec2 scale = ImVec2(1.f, 1.f);
+        ImVec2 inner_padding = ImVec2(20.f, 20.f);
+        bool coverage = false; // rasterize single color formulas as A8, see PixelBuffer::A8
+        bool incremental = false; // preview multi-row environments from their cached rows, see EnvironmentRenderer
+        bool draft = false; // show a draft of large formulas before their final raster, see Quality::DRAFT
+        bool resize_preview = false; // the size is still changing (e.g. dragged): rescale the last parse, not cached
+    };
+
+    /**
+     * @brief Renders LatexImages on a background thread, with latest-wins semantics
+     *
+     * Only the last submitted request matters: requests that are still waiting are
+     * replaced, a request that is being rendered is cancelled before rasterization
+     * and results that are outdated when they finish are dropped.
+     *
+     * The images handed out by poll() are not uploaded yet, getImage() must be called
+     * on the UI thread.
+     *
+     * Renders go through the RenderCache: cached formulas are neither parsed nor rasterized.
+     * The last parsed formula is kept, so that color, scale or padding changes
+     * only rasterize it again (font size and line space changes are parsed again).
+     * While the size is still changing (resize_preview), the last parse is rasterized
+     * at the new size instead, without caching: the final size must then be requested
+     * without resize_preview to get the exact layout.
+     *
+     * Incremental requests of multi-row environments are first answered with a preview
+     * composed from the cached rows (see EnvironmentRenderer). The whole formula is only
+     * rendered once no other request came for exact_render_delay; until then the worker
+     * stays busy, such that only exact images are copied or saved.
+     *
+     * Draft requests of large formulas (at least draft_min_pixels) are first rasterized
+     * as a draft, handed out as a result; the final raster is skipped if a newer
+     * request came in the meantime.
+     */
+    class RenderWorker {
+    public:
+        static constexpr std::chrono::milliseconds exact_render_delay{ 300 };
+        static constexpr float draft_min_pixels = 1024.f * 1024.f;
+    private:
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+
+        RenderRequest m_pending;
+        RenderKey m_pending_key;
+        bool m_has_pending = false;
+        bool m_stop = false;
+
+        // Incremented on each submit, used to detect outdated jobs
+        std::atomic<uint64_t> m_generation = 0;
+        uint64_t m_finished_generation = 0;
+        LatexImageUPtr m_result = nullptr;
+        double m_result_ms = 0.; // time spent rendering m_result, negative if not a full render
+        std::chrono::steady_clock::time_point m_job_start; // only accessed by the worker thread
+
+        // Last parsed formula, only accessed by the worker thread
+        ParsedLatexPtr m_parsed = nullptr;
+        RenderKey m_parsed_key;
+        EnvironmentRenderer m_environment_renderer;
+
+        // Statistics
+        size_t m_rendered = 0;
+        size_t m_dropped = 0;
+        size_t m_reused_parses = 0;
+        size_t m_previews = 0;
+        size_t m_drafts = 0;
+
+        void loop();
+        /**
+         * @brief Returns true if the last parse can be rasterized for key
+         */
+        bool canReuseParse(const RenderKey& key) const;
+        /**
+         * @brief Returns true if the last parse can be rescaled to the font size of key
+         */
+        bool canRescaleParse(const RenderKey& key) const;
+        /**
+         * @brief Renders the whole formula (from the last parse when possible),
+         * nullptr if cancelled
+         */
+        LatexImageUPtr renderExact(const RenderRequest& request, const RenderKey& key, const std::function<bool()>& is_outdated);
+        /**
+         * @brief Composes a preview of a multi-row environment, nullptr if not possible
+         */
+        LatexImageUPtr renderPreview(const RenderRequest& request, const std::function<bool()>& is_outdated);
+        /**
+         * @brief Rasterizes the last parse scaled to the font size of the request, see canRescaleParse
+         */
+        LatexImageUPtr renderRescaled(const RenderRequest& request);
+    public:
+        RenderWorker();
+        ~RenderWorker();
+
+        RenderWorker(const RenderWorker&) = delete;
+        void operator=(const RenderWorker&) = delete;
+
+        /**
+         * @brief Submits a new request, making any previous request obsolete
+         */
+        void submit(const RenderRequest& request);
+
+        /**
+         * @brief Retrieves the latest finished image (if any)
+         *
+         * @param image replaced by the finished image if there is one
+         * @param render_ms optional, set to the time spent rendering the image (in ms), or to
+         * a negative value for cache hits, drafts and previews, which say nothing of the render time
+         * @return true if a new image has been retrieved
+         */
+        bool poll(LatexImageUPtr& image, double* render_ms = nullptr);
+
+        /**
+         * @brief Returns true if the last submitted request has not been retrieved yet
+         */
+        bool isBusy();
+
+        size_t getRenderedCount();
+        size_t getDroppedCount();
+        /**
+         * @brief Number of renders which only rasterized the previously parsed formula again
+         * (including the resize previews)
+         */
+        size_t getReusedParseCount();
+        /**
+         * @brief Number of previews composed from the cached rows of environments
+         */
+        size_t getPreviewCount();
+        /**
+         * @brief Number of drafts handed out before a final raster
+         */
+        size_t getDraftCount();
+    };
+}
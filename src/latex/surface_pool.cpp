@@ -0,0 +1,182 @@
+#include "surface_pool.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace microtex {
+    static std::atomic<size_t> byte_budget = 32 * 1024 * 1024;
+    static std::atomic<size_t> acquisitions = 0;
+    static std::atomic<size_t> allocations = 0;
+    static std::atomic<size_t> reuses = 0;
+    static std::atomic<size_t> evictions = 0;
+    static std::atomic<size_t> adopted = 0;
+
+    // Maximum number of adopted buffers tracked by a pool, the older ones are left to their owners
+    static constexpr size_t max_lent = 8;
+    static std::atomic<size_t> pooled = 0;
+    static std::atomic<size_t> bytes = 0;
+
+    /**
+     * Rounds up to the next size class: 4 classes per power of two,
+     * which wastes at most 25% per dimension
+     */
+    static int size_class(int size) {
+        if (size <= 64)
+            return 64;
+        int step = 1;
+        while (step * 8 <= size)
+            step *= 2;
+        return (size + step - 1) / step * step;
+    }
+
+    SurfacePool::~SurfacePool() {
+        for (auto& surface : m_free) {
+            destroy(surface);
+        }
+        for (auto& surface : m_lent) {
+            destroy(surface);
+        }
+        pooled -= m_free.size();
+        bytes -= m_bytes;
+        adopted -= m_lent.size();
+    }
+
+    void SurfacePool::destroy(Surface& surface) {
+        cairo_destroy(surface.context);
+        cairo_surface_destroy(surface.surface);
+        // The buffer survives if it has been adopted
+        surface.buffer = nullptr;
+        surface.context = nullptr;
+        surface.surface = nullptr;
+    }
+
+    void SurfacePool::reclaim() {
+        // Buffers only referenced by the pool can not be shared again by anyone else
+        for (size_t i = 0;i < m_lent.size();) {
+            if (m_lent[i].buffer.use_count() == 1) {
+                // Pairs with the release of the last other owner, whose reads must be finished
+                std::atomic_thread_fence(std::memory_order_acquire);
+                Surface surface = m_lent[i];
+                m_lent.erase(m_lent.begin() + i);
+                adopted--;
+                recycle(surface);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    SurfacePool& SurfacePool::getThreadInstance() {
+        static thread_local SurfacePool pool;
+        return pool;
+    }
+
+    SurfacePool::Surface SurfacePool::acquire(int width, int height, cairo_format_t format) {
+        acquisitions++;
+        reclaim();
+
+        // Best fit: the smallest free surface that is large enough
+        auto best = m_free.end();
+        for (auto it = m_free.begin();it != m_free.end();it++) {
+            if (it->format == format && it->width >= width && it->height >= height && (best == m_free.end() || it->bytes < best->bytes))
+                best = it;
+        }
+
+        Surface surface;
+        if (best != m_free.end()) {
+            surface = *best;
+            m_free.erase(best);
+            m_bytes -= surface.bytes;
+            pooled--;
+            bytes -= surface.bytes;
+            reuses++;
+
+            // Clear the part that is handed out, it is the only one that can be drawn on
+            cairo_surface_flush(surface.surface);
+            unsigned char* data = surface.buffer->data();
+            int stride = cairo_image_surface_get_stride(surface.surface);
+            const size_t row_bytes = (size_t)width * (format == CAIRO_FORMAT_A8 ? 1 : 4);
+            for (int y = 0;y < height;y++) {
+                memset(data + (size_t)y * stride, 0, row_bytes);
+            }
+            cairo_surface_mark_dirty(surface.surface);
+        }
+        else {
+            surface.width = size_class(width);
+            surface.height = size_class(height);
+            surface.format = format;
+            int stride = cairo_format_stride_for_width(format, surface.width);
+            surface.bytes = (size_t)stride * surface.height;
+            // Zero initialized, like cairo_image_surface_create
+            surface.buffer = std::make_shared<ARGB_Image>(surface.bytes);
+            surface.surface = cairo_image_surface_create_for_data(surface.buffer->data(), format, surface.width, surface.height, stride);
+            surface.context = cairo_create(surface.surface);
+            allocations++;
+        }
+
+        // The saved state is restored on release, which resets the context
+        cairo_save(surface.context);
+        cairo_rectangle(surface.context, 0, 0, width, height);
+        cairo_clip(surface.context);
+        return surface;
+    }
+
+    void SurfacePool::release(Surface surface) {
+        if (surface.surface == nullptr)
+            return;
+        cairo_restore(surface.context);
+
+        if (surface.buffer.use_count() > 1) {
+            // Adopted, wait for the other owners to drop the buffer
+            if (m_lent.size() >= max_lent) {
+                destroy(m_lent.front());
+                m_lent.erase(m_lent.begin());
+                adopted--;
+            }
+            m_lent.push_back(surface);
+            adopted++;
+            return;
+        }
+        recycle(surface);
+    }
+
+    void SurfacePool::recycle(Surface& surface) {
+        if (surface.bytes > byte_budget) {
+            destroy(surface);
+            evictions++;
+            return;
+        }
+        // Evict the oldest surfaces until the new one fits
+        while (!m_free.empty() && m_bytes + surface.bytes > byte_budget) {
+            Surface& oldest = m_free.front();
+            m_bytes -= oldest.bytes;
+            pooled--;
+            bytes -= oldest.bytes;
+            destroy(oldest);
+            m_free.erase(m_free.begin());
+            evictions++;
+        }
+        m_free.push_back(surface);
+        m_bytes += surface.bytes;
+        pooled++;
+        bytes += surface.bytes;
+    }
+
+    void SurfacePool::setByteBudget(size_t value) {
+        byte_budget = value;
+    }
+
+    SurfacePoolStats SurfacePool::getStats() {
+        SurfacePoolStats stats;
+        stats.acquisitions = acquisitions;
+        stats.allocations = allocations;
+        stats.reuses = reuses;
+        stats.evictions = evictions;
+        stats.adopted = adopted;
+        stats.pooled = pooled;
+        stats.bytes = bytes;
+        stats.byte_budget = byte_budget;
+        return stats;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "cairo.h"
+#include "core/pixel_buffer.h"
+
+namespace microtex {
+    struct SurfacePoolStats {
+        size_t acquisitions = 0;
+        size_t allocations = 0; // surfaces that had to be created
+        size_t reuses = 0;      // allocations avoided
+        size_t evictions = 0;
+        size_t adopted = 0;     // buffers handed out without copy, still in use outside of the pool
+        size_t pooled = 0;      // surfaces currently waiting in the pools
+        size_t bytes = 0;
+        size_t byte_budget = 0; // per thread
+    };
+
+    /**
+     * @brief Pool of ARGB32 / A8 surfaces (with their context) to be reused by the painters
+     *
+     * Surfaces are allocated with their dimensions rounded up to a size class
+     * (four classes per power of two), and handed out for any request that fits,
+     * such that small size changes (typing, dragging the size) reuse the same buffer.
+     * The part of a reused surface that is handed out is cleared and clipped,
+     * and the state of its context is restored as it was after creation.
+     *
+     * The pixels of a surface live in a shared ARGB_Image buffer, which can be
+     * adopted (without copy) by a PixelBuffer / Image. A released surface whose buffer
+     * is still in use elsewhere is only reused once all the other owners dropped it.
+     *
+     * There is one pool per thread, a surface must be released on the thread
+     * that acquired it. Each pool keeps at most byte_budget bytes of free surfaces.
+     */
+    class SurfacePool {
+    public:
+        struct Surface {
+            cairo_surface_t* surface = nullptr;
+            cairo_t* context = nullptr;
+            ARGB_Imageptr buffer = nullptr; // pixels of the surface
+            int width = 0; // allocated dimensions, can be larger than requested
+            int height = 0;
+            cairo_format_t format = CAIRO_FORMAT_ARGB32;
+            size_t bytes = 0;
+        };
+    private:
+        std::vector<Surface> m_free;
+        // Released surfaces whose buffer has been adopted, oldest first
+        std::vector<Surface> m_lent;
+        size_t m_bytes = 0;
+
+        SurfacePool() = default;
+        void destroy(Surface& surface);
+        void recycle(Surface& surface);
+        void reclaim();
+    public:
+        ~SurfacePool();
+
+        SurfacePool(const SurfacePool&) = delete;
+        void operator=(const SurfacePool&) = delete;
+
+        /**
+         * @brief Returns the pool of the calling thread
+         */
+        static SurfacePool& getThreadInstance();
+
+        /**
+         * @brief Returns a surface of at least width x height pixels, whose top left
+         * width x height pixels are transparent and clip all the drawing
+         *
+         * @param format CAIRO_FORMAT_ARGB32 or CAIRO_FORMAT_A8 (coverage only)
+         */
+        Surface acquire(int width, int height, cairo_format_t format = CAIRO_FORMAT_ARGB32);
+
+        /**
+         * @brief Gives back a surface obtained with acquire (may destroy it if over budget)
+         */
+        void release(Surface surface);
+
+        /**
+         * @brief Sets the maximum number of bytes of free surfaces kept by each thread
+         * (0 disables the pooling)
+         */
+        static void setByteBudget(size_t bytes);
+
+        static SurfacePoolStats getStats();
+    };
+}
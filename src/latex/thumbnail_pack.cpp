@@ -0,0 +1,159 @@
+#include "thumbnail_pack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace Latex {
+    static const char pack_magic[8] = { 'Q', 'T', 'X', 'P', 'A', 'C', 'K', '2' };
+    static const uint32_t record_magic = 0x52585451; // "QTXR"
+    static const size_t alignment = 16;
+
+    static size_t align(size_t size) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    uint64_t contentHash(const std::string& str, uint64_t seed) {
+        uint64_t hash = seed;
+        for (unsigned char c : str) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * Returns true if the pixels described by the header fit in its data
+     */
+    static bool valid_pixels(uint32_t format, int32_t width, int32_t height, int32_t stride, uint64_t data_size) {
+        if (format != PixelBuffer::ARGB32_PREMULTIPLIED && format != PixelBuffer::A8)
+            return false;
+        if (width <= 0 || height <= 0)
+            return false;
+        const int64_t bytes_per_pixel = format == PixelBuffer::A8 ? 1 : 4;
+        return stride >= bytes_per_pixel * width && data_size >= (uint64_t)stride * (uint64_t)height;
+    }
+
+    bool ThumbnailPack::index() {
+        m_index.clear();
+        m_valid_size = sizeof(pack_magic);
+        if (!m_file.open(m_path) || m_file.size() < sizeof(pack_magic))
+            return false;
+        if (memcmp(m_file.data(), pack_magic, sizeof(pack_magic)) != 0)
+            return false;
+
+        // Sizes are compared against what is left of the file, such that corrupted ones cannot wrap around
+        const size_t size = m_file.size();
+        size_t offset = align(sizeof(pack_magic));
+        while (offset <= size && sizeof(RecordHeader) <= size - offset) {
+            RecordHeader header;
+            memcpy(&header, m_file.data() + offset, sizeof(RecordHeader));
+            if (header.magic != record_magic || header.key_size > size - offset - sizeof(RecordHeader))
+                break;
+            size_t data_offset = align(offset + sizeof(RecordHeader) + header.key_size);
+            if (data_offset > size || header.data_size > size - data_offset
+                || !valid_pixels(header.format, header.width, header.height, header.stride, header.data_size))
+                break;
+            // Later records replace earlier ones
+            m_index[header.hash] = offset;
+            offset = align(data_offset + header.data_size);
+            m_valid_size = std::min(offset, m_file.size());
+        }
+        return true;
+    }
+
+    bool ThumbnailPack::open(const std::string& path) {
+        m_path = path;
+        m_out.close();
+        if (!index()) {
+            // Missing, empty or of another version
+            m_file.close();
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(pack_magic, sizeof(pack_magic));
+            if (!out.good())
+                return false;
+            out.close();
+            if (!index())
+                return false;
+        }
+        // Discard a partially written record, such that new records stay reachable
+        if (m_valid_size < m_file.size()) {
+            m_file.close();
+            std::error_code err;
+            std::filesystem::resize_file(m_path, m_valid_size, err);
+            if (!index())
+                return false;
+        }
+        m_out.open(m_path, std::ios::binary | std::ios::app);
+        return m_out.is_open();
+    }
+
+    bool ThumbnailPack::get(const std::string& key, PixelView& view) const {
+        auto it = m_index.find(contentHash(key));
+        if (it == m_index.end() || !m_file.isOpen())
+            return false;
+        RecordHeader header;
+        memcpy(&header, m_file.data() + it->second, sizeof(RecordHeader));
+        // Different renders with the same hash
+        const unsigned char* stored_key = m_file.data() + it->second + sizeof(RecordHeader);
+        if (header.key_size != key.size() || memcmp(stored_key, key.data(), key.size()) != 0)
+            return false;
+        view.data = m_file.data() + align(it->second + sizeof(RecordHeader) + header.key_size);
+        view.width = header.width;
+        view.height = header.height;
+        view.stride = header.stride;
+        view.format = (PixelBuffer::Format)header.format;
+        view.ascent = header.ascent;
+        view.descent = header.descent;
+        return true;
+    }
+
+    bool ThumbnailPack::contains(const std::string& key) const {
+        PixelView view;
+        return get(key, view);
+    }
+
+    bool ThumbnailPack::append(const std::string& key, const PixelBuffer& pixels) {
+        if (!m_out.is_open() || pixels.empty())
+            return false;
+
+        RecordHeader header;
+        memset(&header, 0, sizeof(RecordHeader));
+        header.magic = record_magic;
+        header.format = (uint32_t)pixels.format;
+        header.hash = contentHash(key);
+        header.width = pixels.width;
+        header.height = pixels.height;
+        // Rows are stored tightly packed, the padding of pooled surfaces is not written
+        header.stride = pixels.bytesPerPixel() * pixels.width;
+        header.ascent = pixels.ascent;
+        header.descent = pixels.descent;
+        header.key_size = (uint32_t)key.size();
+        header.data_size = (uint64_t)header.stride * pixels.height;
+
+        // Records start and end aligned (the file magic is not)
+        const char zeros[alignment] = { 0 };
+        size_t offset = align(m_valid_size);
+        size_t data_offset = align(offset + sizeof(RecordHeader) + key.size());
+        size_t end = align(data_offset + header.data_size);
+        m_out.write(zeros, offset - m_valid_size);
+        m_out.write((const char*)&header, sizeof(RecordHeader));
+        m_out.write(key.data(), key.size());
+        m_out.write(zeros, data_offset - offset - sizeof(RecordHeader) - key.size());
+        for (int y = 0;y < pixels.height;y++) {
+            m_out.write((const char*)pixels.pixels() + (size_t)y * pixels.stride, header.stride);
+        }
+        m_out.write(zeros, end - data_offset - header.data_size);
+        m_out.flush();
+        if (!m_out.good()) {
+            // A partial record is discarded by the next open
+            m_out.close();
+            return false;
+        }
+        m_index[header.hash] = offset;
+        m_valid_size = end;
+        // Only maps the file again to reach the new record, the index is kept
+        return m_file.open(m_path);
+    }
+}
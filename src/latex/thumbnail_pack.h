@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#include "core/mapped_file.h"
+#include "core/pixel_buffer.h"
+
+namespace Latex {
+    /**
+     * @brief Non owning view on pixels stored in a ThumbnailPack
+     *
+     * Only valid until the next append / open of the pack
+     */
+    struct PixelView {
+        const unsigned char* data = nullptr;
+        int width = 0;
+        int height = 0;
+        int stride = 0;
+        PixelBuffer::Format format = PixelBuffer::ARGB32_PREMULTIPLIED;
+        float ascent = 0.f;
+        float descent = 0.f;
+    };
+
+    /**
+     * @brief FNV-1a hash, used to key the thumbnails by content
+     */
+    uint64_t contentHash(const std::string& str, uint64_t seed = 14695981039346656037ull);
+
+    /**
+     * @brief Append-only pack file of rendered thumbnails, keyed by their render inputs
+     *
+     * The file is memory mapped: thumbnails found in the pack are read in place (zero-copy).
+     * New thumbnails are appended at the end of the file, a truncated or corrupted record
+     * (e.g. after a crash) is discarded when opening, with every record after it.
+     *
+     * The key is the whole description of the render (latex source and every option
+     * changing the pixels). It is stored with the record, so that a lookup by hash is
+     * verified against it.
+     *
+     * File layout: "QTXPACK2" followed by records (RecordHeader + key + pixels, 16 bytes aligned).
+     * Packs of another version are recreated.
+     */
+    class ThumbnailPack {
+    private:
+        struct RecordHeader {
+            uint32_t magic;
+            uint32_t format;
+            uint64_t hash;
+            int32_t width;
+            int32_t height;
+            int32_t stride;
+            float ascent;
+            float descent;
+            uint32_t key_size;
+            uint64_t data_size;
+        };
+
+        std::string m_path;
+        MappedFile m_file;
+        // Kept open to append records, without re-reading the pack
+        std::ofstream m_out;
+        // hash of the key -> offset of the record header in the file
+        std::unordered_map<uint64_t, size_t> m_index;
+        size_t m_valid_size = 0;
+
+        bool index();
+    public:
+        /**
+         * @brief Opens (or creates) the pack and indexes its records
+         *
+         * @return true if the pack can be used
+         */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Looks up a thumbnail
+         *
+         * @param key render inputs, as given to append
+         * @param view points directly into the mapped file on success
+         * @return true if found
+         */
+        bool get(const std::string& key, PixelView& view) const;
+
+        /**
+         * @brief Appends a thumbnail at the end of the pack
+         *
+         * Invalidates all the PixelViews previously returned
+         *
+         * @return true if successfully written
+         */
+        bool append(const std::string& key, const PixelBuffer& pixels);
+
+        bool contains(const std::string& key) const;
+        size_t count() const { return m_index.size(); }
+    };
+}
@@ -0,0 +1,144 @@
+#include "tiled_raster.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "core/pixel_convert.h"
+#include "core/thread_pool.h"
+
+namespace Latex {
+    TiledRaster::TiledRaster(ParsedLatexPtr parsed, ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format)
+        : m_parsed(parsed), m_scale(scale), m_inner_padding(inner_padding), m_text_color(text_color), m_format(format) {
+        if (m_parsed == nullptr || !m_parsed->getLatexErrorMsg().empty())
+            return;
+        if (!m_parsed->isMonochrome())
+            m_format = PixelBuffer::ARGB32_PREMULTIPLIED;
+        ImVec2 size = m_parsed->getRasterSize(scale, inner_padding);
+        m_width = (int)size.x;
+        m_height = (int)size.y;
+        m_columns = (m_width + tile_size - 1) / tile_size;
+        m_rows = (m_height + tile_size - 1) / tile_size;
+        m_tiles.resize((size_t)m_columns * m_rows);
+    }
+
+    void TiledRaster::getTileRect(int column, int row, int& x, int& y, int& width, int& height) const {
+        x = column * tile_size;
+        y = row * tile_size;
+        width = std::min(tile_size, m_width - x);
+        height = std::min(tile_size, m_height - y);
+    }
+
+    PixelBuffer TiledRaster::rasterizeTile(int column, int row) const {
+        if (column < 0 || row < 0 || column >= m_columns || row >= m_rows)
+            return PixelBuffer();
+        int x, y, width, height;
+        getTileRect(column, row, x, y, width, height);
+        return m_parsed->rasterizeRegion(m_scale, m_inner_padding, m_text_color, x, y, width, height, m_format);
+    }
+
+    void TiledRaster::rasterizeTiles(int first_column, int first_row, int last_column, int last_row) {
+        std::vector<std::pair<int, int>> missing;
+        for (int row = std::max(0, first_row);row <= std::min(last_row, m_rows - 1);row++) {
+            for (int column = std::max(0, first_column);column <= std::min(last_column, m_columns - 1);column++) {
+                if (getTile(column, row).pixels.empty())
+                    missing.emplace_back(column, row);
+            }
+        }
+        std::vector<PixelBuffer> rasterized(missing.size());
+        int threads = getRasterThreads();
+        ThreadPool::getInstance().parallelFor(missing.size(), [&](size_t i) {
+            rasterized[i] = rasterizeTile(missing[i].first, missing[i].second);
+            }, threads == 0 ? ThreadPool::getInstance().getThreadCount() : threads);
+        for (size_t i = 0;i < missing.size();i++) {
+            Tile& tile = getTile(missing[i].first, missing[i].second);
+            tile.pixels = std::move(rasterized[i]);
+            tile.uploaded = false;
+            if (!tile.pixels.empty())
+                m_resident++;
+        }
+    }
+
+    std::shared_ptr<Image> TiledRaster::getTileImage(int column, int row) {
+        if (column < 0 || row < 0 || column >= m_columns || row >= m_rows)
+            return nullptr;
+        Tile& tile = getTile(column, row);
+        if (tile.pixels.empty()) {
+            tile.pixels = rasterizeTile(column, row);
+            tile.uploaded = false;
+            // An empty tile (e.g. failed allocation) is not resident, see release
+            if (!tile.pixels.empty())
+                m_resident++;
+        }
+        if (tile.image == nullptr)
+            tile.image = std::make_shared<Image>();
+        if (!tile.uploaded) {
+            tile.uploaded = true;
+            tile.image->setImage(tile.pixels, Image::FILTER_BILINEAR);
+        }
+        return tile.image;
+    }
+
+    void TiledRaster::release(Tile& tile) {
+        if (!tile.pixels.empty())
+            m_resident--;
+        tile.pixels = PixelBuffer();
+        tile.image = nullptr;
+        tile.uploaded = false;
+    }
+
+    void TiledRaster::keepOnly(int first_column, int first_row, int last_column, int last_row) {
+        for (int row = 0;row < m_rows;row++) {
+            for (int column = 0;column < m_columns;column++) {
+                if (column < first_column || column > last_column || row < first_row || row > last_row)
+                    release(getTile(column, row));
+            }
+        }
+    }
+
+    void TiledRaster::releaseAll() {
+        for (auto& tile : m_tiles)
+            release(tile);
+    }
+
+    void TiledRaster::setTint(microtex::color text_color) {
+        if (m_format != PixelBuffer::A8)
+            return;
+        m_text_color = text_color;
+        for (auto& tile : m_tiles) {
+            tile.pixels.tint = text_color;
+            if (tile.image != nullptr)
+                tile.image->setTint(text_color);
+        }
+    }
+
+    bool TiledRaster::streamRGBA(const std::function<bool(const unsigned char* rgba, int y, int rows)>& write) const {
+        const size_t row_bytes = (size_t)4 * m_width;
+        std::vector<unsigned char> band;
+        std::vector<unsigned char> converted;
+        std::vector<PixelBuffer> row_tiles(m_columns);
+        const int threads = getRasterThreads();
+        for (int row = 0;row < m_rows;row++) {
+            int band_height = std::min(tile_size, m_height - row * tile_size);
+            band.resize(row_bytes * band_height);
+            ThreadPool::getInstance().parallelFor((size_t)m_columns, [&](size_t column) {
+                const Tile& tile = m_tiles[(size_t)row * m_columns + column];
+                row_tiles[column] = tile.pixels.empty() ? rasterizeTile((int)column, row) : tile.pixels;
+                }, threads == 0 ? ThreadPool::getInstance().getThreadCount() : threads);
+            for (int column = 0;column < m_columns;column++) {
+                PixelBuffer& pixels = row_tiles[column];
+                if (pixels.empty())
+                    return false;
+                pixels.tint = m_text_color;
+                converted = PixelConvert::toRGBA(pixels);
+                // Tiles are converted tightly packed, then copied into their columns of the band
+                const size_t tile_bytes = (size_t)4 * pixels.width;
+                for (int y = 0;y < pixels.height;y++) {
+                    memcpy(band.data() + y * row_bytes + (size_t)4 * column * tile_size, converted.data() + y * tile_bytes, tile_bytes);
+                }
+            }
+            if (!write(band.data(), row * tile_size, band_height))
+                return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "latex.h"
+
+namespace Latex {
+    /**
+     * @brief Raster of a formula too large for a single surface / texture, in fixed size tiles
+     *
+     * Tiles are only rasterized when requested and can be released again, such that
+     * only the visible part of the formula is held in memory and on the GPU.
+     * The tiles cover the untrimmed raster of the formula (see ParsedLatex::rasterizeRegion).
+     *
+     * rasterizeTile and streamRGBA can be called from any thread, the resident tiles
+     * (getTileImage, keepOnly...) must only be managed by the thread owning the GL context.
+     */
+    class TiledRaster {
+    public:
+        static constexpr int tile_size = 1024;
+
+    private:
+        struct Tile {
+            PixelBuffer pixels;
+            std::shared_ptr<Image> image = nullptr;
+            bool uploaded = false;
+        };
+
+        ParsedLatexPtr m_parsed;
+        ImVec2 m_scale;
+        ImVec2 m_inner_padding;
+        microtex::color m_text_color;
+        PixelBuffer::Format m_format;
+
+        int m_width = 0;
+        int m_height = 0;
+        int m_columns = 0;
+        int m_rows = 0;
+        std::vector<Tile> m_tiles;
+        size_t m_resident = 0;
+
+        Tile& getTile(int column, int row) { return m_tiles[(size_t)row * m_columns + column]; }
+        void release(Tile& tile);
+    public:
+        /**
+         * @param format A8 to only keep the coverage, ignored if the formula is not monochrome
+         * (same as ParsedLatex::rasterize)
+         */
+        TiledRaster(ParsedLatexPtr parsed, ImVec2 scale, ImVec2 inner_padding, microtex::color text_color, PixelBuffer::Format format);
+
+        int getWidth() const { return m_width; }
+        int getHeight() const { return m_height; }
+        int getColumns() const { return m_columns; }
+        int getRows() const { return m_rows; }
+        /**
+         * @brief Format of the tiles (ARGB if A8 was requested for a multicolored formula)
+         */
+        PixelBuffer::Format getFormat() const { return m_format; }
+
+        /**
+         * @brief Position and size (in pixels) of a tile, the last column / row can be smaller
+         */
+        void getTileRect(int column, int row, int& x, int& y, int& width, int& height) const;
+
+        /**
+         * @brief Rasterizes a tile, without making it resident
+         */
+        PixelBuffer rasterizeTile(int column, int row) const;
+
+        /**
+         * @brief Makes the tiles of the given range (inclusive) resident, the missing ones are
+         * rasterized in parallel (see setRasterThreads)
+         */
+        void rasterizeTiles(int first_column, int first_row, int last_column, int last_row);
+
+        /**
+         * @brief Returns the texture of a tile, rasterized and uploaded on first call
+         * The tile stays resident until released by keepOnly
+         */
+        std::shared_ptr<Image> getTileImage(int column, int row);
+
+        /**
+         * @brief Releases the pixels and textures of the tiles outside the given range (inclusive)
+         */
+        void keepOnly(int first_column, int first_row, int last_column, int last_row);
+
+        void releaseAll();
+
+        /**
+         * @brief Returns the number of tiles currently held in memory
+         */
+        size_t getResidentCount() const { return m_resident; }
+
+        /**
+         * @brief Changes the tint of the tiles (A8 only), without rasterizing them again
+         */
+        void setTint(microtex::color text_color);
+
+        /**
+         * @brief Stitches the tiles into straight alpha RGBA rows, one row of tiles at a time
+         *
+         * At most one row of tiles is held in memory (resident tiles are reused),
+         * the tiles of a row are rasterized in parallel.
+         *
+         * @param write called with consecutive bands of rows: rgba (4 * getWidth() bytes per row),
+         * first row of the band, number of rows. Returns false to stop.
+         * @return false if write stopped the stream
+         */
+        bool streamRGBA(const std::function<bool(const unsigned char* rgba, int y, int rows)>& write) const;
+    };
+}
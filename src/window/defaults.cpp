@@ -12,6 +12,14 @@ DefaultParams loadDefaults() {
         params.text_color = ImVec4(vec[0], vec[1], vec[2], vec[3]);
         vec = toml::find_or<std::vector<float>>(data, "background_color", { 1.f, 1.f, 1.f, 1.f });
         params.background_color = ImVec4(vec[0], vec[1], vec[2], vec[3]);
+        params.render_cache_mb = toml::find_or<int>(data, "render_cache_mb", 64);
+        params.render_glyphs = toml::find_or<bool>(data, "render_glyphs", false);
+        params.export_hidpi = toml::find_or<bool>(data, "export_hidpi", false);
+        params.png_compression = toml::find_or<int>(data, "png_compression", 6);
+        params.render_coverage = toml::find_or<bool>(data, "render_coverage", true);
+        params.parallel_raster = toml::find_or<bool>(data, "parallel_raster", true);
+        params.incremental_render = toml::find_or<bool>(data, "incremental_render", true);
+        params.draft_preview = toml::find_or<bool>(data, "draft_preview", true);
     }
     catch (const std::exception& e) {
         std::cerr << "Error while loading defaults.toml: " << e.what() << std::endl;
@@ -27,6 +35,14 @@ void saveDefaults(const DefaultParams& params) {
     data["font_family_idx"] = params.font_family_idx;
     data["text_color"] = std::vector<float>{ params.text_color.x, params.text_color.y, params.text_color.z, params.text_color.w };
     data["background_color"] = std::vector<float>{ params.background_color.x, params.background_color.y, params.background_color.z, params.background_color.w };
+    data["render_cache_mb"] = params.render_cache_mb;
+    data["render_glyphs"] = params.render_glyphs;
+    data["export_hidpi"] = params.export_hidpi;
+    data["png_compression"] = params.png_compression;
+    data["render_coverage"] = params.render_coverage;
+    data["parallel_raster"] = params.parallel_raster;
+    data["incremental_render"] = params.incremental_render;
+    data["draft_preview"] = params.draft_preview;
     std::ofstream file("data/defaults.toml");
     file << data;
     file.close();
@@ -11,6 +11,14 @@ struct DefaultParams {
     size_t font_family_idx = 0;
     ImVec4 text_color = ImGui::ColorConvertU32ToFloat4(Colors::black);
     ImVec4 background_color = ImGui::ColorConvertU32ToFloat4(Colors::white);
+    int render_cache_mb = 64;
+    bool render_glyphs = false; // draw glyphs with the font engine instead of outlines
+    bool export_hidpi = false; // also save @2x and @3x versions when saving to file
+    int png_compression = 6; // zlib level of the saved PNGs (0 - 9)
+    bool render_coverage = true; // rasterize single color formulas as A8, colored when displayed
+    bool parallel_raster = true; // rasterize large formulas on all the cores
+    bool incremental_render = true; // preview edits of large align / matrix environments from their cached rows
+    bool draft_preview = true; // show a quick draft of large formulas before the final image
 };
 
 DefaultParams loadDefaults();
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <fstream>
 #include <chrono>
+#include <filesystem>
 
 #include "main_window.h"
 #include "style.h"
@@ -10,6 +14,9 @@
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
+#include "core/pixel_convert.h"
+#include "core/png_writer.h"
+#include "latex/tiled_raster.h"
 
 // #include "microtex/lib/core/parser.h"
 // #include "microtex/lib/core/formula.h"
@@ -79,9 +86,19 @@ void MainApp::InitializationBeforeLoop() {
 
     m_defaults = loadDefaults();
     m_prev_defaults = m_defaults;
+    Latex::RenderCache::getInstance().setByteBudget((size_t)m_defaults.render_cache_mb * 1024 * 1024);
+    Latex::setRenderGlyphs(m_defaults.render_glyphs);
+    Latex::setRasterThreads(m_defaults.parallel_raster ? 0 : 1);
+    // A8 textures need swizzling, see Image::detectCapabilities
+    Image::detectCapabilities();
+    // Formulas larger than a texture are displayed in tiles
+    GLint max_texture_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    if (max_texture_size > 0)
+        Latex::setMaxUntiledSize(std::min(Latex::getMaxUntiledSize(), (int)max_texture_size));
     auto families = Latex::getFontFamilies();
     if (m_defaults.font_family != "Latin Modern") {
-        Latex::setDefaultFontFamily(families[m_defaults.font_family_idx]);
+        m_font_error = Latex::setDefaultFontFamily(families[m_defaults.font_family_idx]);
         m_prev_defaults.font_family = "";
         m_prev_defaults.font_family_idx = 0;
     }
@@ -106,31 +123,34 @@ float MainApp::check_time() {
     return (float)t1 / time_until_clipboard;
 }
 bool MainApp::is_valid() {
-    return m_err.empty() && m_latex_image != nullptr && m_latex_image->getImage() != nullptr && m_latex_image->getImage()->width() > 0 && m_latex_image->getImage()->height() > 0;
+    // While a render is pending, the displayed image does not correspond to the text anymore
+    return m_err.empty() && !m_render_scheduler.hasPending() && !m_render_worker.isBusy() && m_latex_image != nullptr && m_latex_image->getLatexErrorMsg().empty() && m_latex_image->getDimensions().x > 0 && m_latex_image->getDimensions().y > 0;
 }
 
 void MainApp::set_clipboard() {
     if (!is_valid())
         return;
     m_has_pasted = true;
-    auto image = m_latex_image->getImage();
+    ImVec2 dimensions = m_latex_image->getDimensions();
+    // Straight alpha RGBA, as expected by clip (stitched from the tiles of large formulas)
+    auto pixels = m_latex_image->getRGBA();
     clip::image_spec spec;
-    spec.width = image->width();
-    spec.height = image->height();
+    spec.width = (unsigned long)dimensions.x;
+    spec.height = (unsigned long)dimensions.y;
     spec.bits_per_pixel = 32;
     spec.bytes_per_row = spec.width * 4;
-    spec.red_mask = 0x00ff0000;
+    spec.red_mask = 0xff;
     spec.green_mask = 0xff00;
-    spec.blue_mask = 0xff;
+    spec.blue_mask = 0xff0000;
     spec.alpha_mask = 0xff000000;
-    spec.red_shift = 16;
+    spec.red_shift = 0;
     spec.green_shift = 8;
-    spec.blue_shift = 0;
+    spec.blue_shift = 16;
     spec.alpha_shift = 24;
-    clip::image img(image->getData()->data(), spec);
+    clip::image img(pixels.data(), spec);
     clip::set_image(img);
 
-    m_history.saveToHistory({ m_txt, (float)image->width() / (float)image->height(), "" });
+    m_history.saveToHistory({ m_txt, dimensions.x / dimensions.y, "" });
 }
 void MainApp::save_to_file() {
     if (m_save_to_file) {
@@ -141,23 +161,73 @@ void MainApp::save_to_file() {
         NFD_Init();
         std::string filename;
         nfdchar_t* outPath;
-        nfdfilteritem_t filterItem[1] = { { "PNG Image", "png" } };
-        nfdresult_t result = NFD_SaveDialogU8(&outPath, filterItem, 1, NULL, NULL);
+        nfdfilteritem_t filterItem[3] = { { "PNG Image", "png" }, { "SVG Image", "svg" }, { "PDF Document", "pdf" } };
+        nfdresult_t result = NFD_SaveDialogU8(&outPath, filterItem, 3, NULL, NULL);
         if (result == NFD_OKAY) {
             filename = outPath;
             NFD_FreePathU8(outPath);
         }
         NFD_Quit();
+        if (filename.empty())
+            return;
+        m_save_error.clear();
+
+        ImVec2 dimensions = m_latex_image->getDimensions();
+        std::string extension = std::filesystem::path(filename).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (extension == ".svg" || extension == ".pdf") {
+            // Written from the parse of the displayed image, nothing is rasterized
+            auto format = extension == ".pdf" ? microtex::Cairo_Vector_Painter::PDF : microtex::Cairo_Vector_Painter::SVG;
+            std::string document = m_latex_image->toVector(format, 1.f);
+            if (document.empty()) {
+                m_save_error = "the formula could not be written as " + extension.substr(1);
+                return;
+            }
+            std::ofstream file(filename, std::ios::binary);
+            if (!file.write(document.data(), document.size())) {
+                m_save_error = "could not write " + filename;
+                return;
+            }
+            m_just_saved_to_file = true;
+            m_history.saveToHistory({ m_txt, dimensions.x / dimensions.y, "" });
+            return;
+        }
 
-        auto image = m_latex_image->getImage();
-        stbi_write_png(filename.c_str(), image->width(), image->height(), 4, image->getData()->data(), image->width() * 4);
+        // Reduced to a palette / grey + alpha when possible, deflated on all the cores
+        PngWriter::Options png_options;
+        png_options.level = m_defaults.png_compression;
+        png_options.threads = 0;
+        // Tiled formulas are streamed to the file, one row of tiles at a time
+        if (!m_latex_image->savePNG(filename, png_options)) {
+            m_save_error = "could not write " + filename;
+            return;
+        }
+        // Tiled formulas are already too large for a single image at 2x / 3x
+        if (m_defaults.export_hidpi && !m_latex_image->isTiled()) {
+            // Only rasterized again, the formula is not parsed
+            auto path = std::filesystem::path(filename);
+            std::vector<float> scales = { 2.f, 3.f };
+            auto outputs = m_latex_image->rasterize(scales, ImVec2(0.f, 0.f));
+            for (size_t i = 0;i < scales.size();i++) {
+                auto hidpi_path = path.parent_path() / (path.stem().string() + "@" + std::to_string((int)scales[i]) + "x" + path.extension().string());
+                if (i >= outputs.size() || outputs[i].empty()) {
+                    m_save_error = "could not render " + hidpi_path.filename().string();
+                    continue;
+                }
+                const PixelBuffer& pixels = outputs[i];
+                auto hidpi_rgba = PixelConvert::toRGBA(pixels);
+                if (!PngWriter::write(hidpi_path.string(), hidpi_rgba.data(), pixels.width, pixels.height, pixels.width * 4, png_options))
+                    m_save_error = "could not write " + hidpi_path.string();
+            }
+        }
         m_just_saved_to_file = true;
-        m_history.saveToHistory({ m_txt, (float)image->width() / (float)image->height(), "" });
+        m_history.saveToHistory({ m_txt, dimensions.x / dimensions.y, "" });
     }
 }
 void MainApp::options() {
     ImGui::SetNextItemWidth(200);
     ImGui::DragInt("Size", &m_defaults.font_size, 1.f, 4, 250);
+    m_size_dragging = ImGui::IsItemActive();
     ImGui::SameLine();
     ImGui::Checkbox("Inline", &m_defaults.is_inline);
     ImGui::SameLine();
@@ -174,7 +244,7 @@ void MainApp::options() {
         ImGui::EndCombo();
 
         if (m_defaults.font_family_idx != m_prev_defaults.font_family_idx) {
-            Latex::setDefaultFontFamily(families[m_defaults.font_family_idx]);
+            m_font_error = Latex::setDefaultFontFamily(families[m_defaults.font_family_idx]);
             m_prev_defaults.font_family_idx = m_defaults.font_family_idx;
             m_prev_text = "";
             saveDefaults(m_defaults);
@@ -184,6 +254,51 @@ void MainApp::options() {
         // ImGui::Checkbox("Auto copy to clipboard", &m_autocopy_to_clipboard);
         ImGui::ColorEdit4("Text color", (float*)&m_defaults.text_color);
         ImGui::ColorEdit3("Background color (for visualization)", (float*)&m_defaults.background_color);
+        if (ImGui::Checkbox("Also save @2x and @3x images", &m_defaults.export_hidpi))
+            saveDefaults(m_defaults);
+        ImGui::SetNextItemWidth(200);
+        if (ImGui::SliderInt("PNG compression", &m_defaults.png_compression, 0, 9))
+            saveDefaults(m_defaults);
+        if (ImGui::Checkbox("Draw glyphs with the font engine", &m_defaults.render_glyphs)) {
+            Latex::setRenderGlyphs(m_defaults.render_glyphs);
+            m_prev_text = "";
+            saveDefaults(m_defaults);
+        }
+        if (ImGui::Checkbox("Render single color formulas as coverage (A8)", &m_defaults.render_coverage)) {
+            m_prev_text = "";
+            saveDefaults(m_defaults);
+        }
+        if (ImGui::Checkbox("Rasterize large formulas on all cores", &m_defaults.parallel_raster)) {
+            Latex::setRasterThreads(m_defaults.parallel_raster ? 0 : 1);
+            saveDefaults(m_defaults);
+        }
+        if (ImGui::Checkbox("Preview edits of large align / matrix environments row by row", &m_defaults.incremental_render))
+            saveDefaults(m_defaults);
+        if (ImGui::Checkbox("Show a draft of large formulas first", &m_defaults.draft_preview))
+            saveDefaults(m_defaults);
+
+        auto& cache = Latex::RenderCache::getInstance();
+        ImGui::SetNextItemWidth(200);
+        if (ImGui::DragInt("Render cache (MB)", &m_defaults.render_cache_mb, 1.f, 0, 4096)) {
+            cache.setByteBudget((size_t)m_defaults.render_cache_mb * 1024 * 1024);
+            saveDefaults(m_defaults);
+        }
+        auto stats = cache.getStats();
+        ImGui::SameLine();
+        ImGui::Text("%zu hits / %zu misses, %zu entries (%.1f MB)", stats.hits, stats.misses, stats.entries, stats.bytes / (1024.f * 1024.f));
+        auto glyph_stats = microtex::GlyphCache::getStats();
+        size_t glyph_lookups = glyph_stats.hits + glyph_stats.misses;
+        ImGui::Text("Glyph cache: %.1f%% hits, %zu masks (%.1f KB)", glyph_lookups > 0 ? 100.f * glyph_stats.hits / glyph_lookups : 0.f, glyph_stats.entries, glyph_stats.bytes / 1024.f);
+        auto pool_stats = microtex::SurfacePool::getStats();
+        ImGui::Text("Surface pool: %zu allocations avoided / %zu (%.1f MB pooled)", pool_stats.reuses, pool_stats.acquisitions, pool_stats.bytes / (1024.f * 1024.f));
+        // Coalesced by the scheduler, or outdated before the worker finished them
+        ImGui::Text("Renders: %zu requested, %zu avoided, %zu dropped (%.1f ms on average, debounce %.0f ms)",
+            m_render_scheduler.getRequestCount(), m_render_scheduler.getAvoidedCount(), m_render_worker.getDroppedCount(),
+            m_render_scheduler.getAverageRenderMs(), std::chrono::duration<double, std::milli>(m_render_scheduler.getDebounce()).count());
+        ImGui::Text("Previews: %zu drafts, %zu composed from environment rows", m_render_worker.getDraftCount(), m_render_worker.getPreviewCount());
+        bool show_timings = m_latex_editor.is_debug();
+        if (ImGui::Checkbox("Show render stage timings (debug window)", &show_timings))
+            m_latex_editor.set_debug(show_timings);
         ImGui::Separator();
     }
 }
@@ -204,7 +319,10 @@ void MainApp::input_field(float width, float height) {
     }
 
     // Progress bar or shortcut display
-    if (m_latex_image != nullptr && m_has_pasted) {
+    if (!m_save_error.empty()) {
+        ImGui::Text("Could not save: %s", m_save_error.c_str());
+    }
+    else if (m_latex_image != nullptr && m_has_pasted) {
         if (m_just_saved_to_file)
             ImGui::Text("Saved to file");
         else
@@ -221,8 +339,20 @@ void MainApp::generate_image() {
     // Generating tex image
     if (!m_err.empty())
         return;
+    // Coverage images only change their tint: no new render
+    if (m_defaults.text_color != m_prev_defaults.text_color && m_txt == m_prev_text && m_latex_image != nullptr
+        && m_defaults.font_size == m_prev_defaults.font_size && m_defaults.is_inline == m_prev_defaults.is_inline
+        && m_defaults.font_family == m_prev_defaults.font_family && !m_render_scheduler.hasPending() && !m_render_worker.isBusy()
+        && m_latex_image->recolor(Latex::toMicroTeXColor(m_defaults.text_color))) {
+        m_prev_defaults.text_color = m_defaults.text_color;
+        saveDefaults(m_defaults);
+        return;
+    }
     if (m_txt != m_prev_text || m_defaults.text_color != m_prev_defaults.text_color || m_defaults.font_size != m_prev_defaults.font_size || m_defaults.is_inline != m_prev_defaults.is_inline
-        || m_defaults.font_family != m_prev_defaults.font_family) {
+        || m_defaults.font_family != m_prev_defaults.font_family || (m_size_previewed && !m_size_dragging)) {
+        // While the size is dragged, the formula is not parsed again: the exact render comes once released
+        const bool resize_preview = m_size_dragging && m_txt == m_prev_text;
+        m_size_previewed = resize_preview;
         if (m_txt == m_prev_text)
             saveDefaults(m_defaults);
 
@@ -230,20 +360,41 @@ void MainApp::generate_image() {
         m_prev_defaults.font_size = m_defaults.font_size;
         m_prev_defaults.is_inline = m_defaults.is_inline;
         m_prev_defaults.text_color = m_defaults.text_color;
-        std::string latex = m_txt;
-        if (!m_defaults.is_inline) {
-            latex = "\\[" + m_txt + "\\]";
-        }
-        m_latex_image = std::make_unique<Latex::LatexImage>(
-            latex, (float)m_defaults.font_size * Tempo::GetScaling(),
-            7.f,
-            ImGui::ColorConvertFloat4ToU32(m_defaults.text_color),
-            ImVec2(1.f, 1.f), ImVec2(0.f, 0.f));
+        // Rendered in the background once the scheduler lets it through,
+        // the previous image stays displayed until retrieve_image
+        Latex::RenderRequest request;
+        request.latex = m_txt;
+        request.is_inline = m_defaults.is_inline;
+        request.font_size = (float)m_defaults.font_size * Tempo::GetScaling();
+        request.line_space = 7.f;
+        request.text_color = Latex::toMicroTeXColor(m_defaults.text_color);
+        request.scale = ImVec2(1.f, 1.f);
+        request.inner_padding = ImVec2(0.f, 0.f);
+        request.coverage = m_defaults.render_coverage;
+        request.incremental = m_defaults.incremental_render;
+        request.draft = m_defaults.draft_preview;
+        request.resize_preview = resize_preview;
+        m_render_scheduler.request(request);
 
         // Copy to clipboard timer
         m_last_checkpoint = std::chrono::high_resolution_clock::now();
         m_has_pasted = false;
         m_just_saved_to_file = false;
+        m_save_error.clear();
+    }
+    Latex::RenderRequest request;
+    if (m_render_scheduler.poll(request))
+        m_render_worker.submit(request);
+}
+void MainApp::retrieve_image() {
+    std::unique_ptr<Latex::LatexImage> image;
+    double render_ms = -1.;
+    if (m_render_worker.poll(image, &render_ms)) {
+        // Cache hits, drafts and previews would make the debounce collapse
+        if (render_ms >= 0.)
+            m_render_scheduler.addRenderTime(render_ms);
+        // The old image (and its texture) is released on the UI thread
+        m_latex_image = std::move(image);
     }
 }
 void MainApp::result_window(float width) {
@@ -254,9 +405,12 @@ void MainApp::result_window(float width) {
         avail.y = 100;
     if (m_latex_image != nullptr && m_latex_image->getDimensions().y > avail.y)
         avail.y = m_latex_image->getDimensions().y;
-    ImGui::BeginChild("##output", ImVec2(width - 10, avail.y));
+    ImGui::BeginChild("##output", ImVec2(width - 10, avail.y), false, ImGuiWindowFlags_HorizontalScrollbar);
     if (m_latex_image != nullptr) {
-        if (m_latex_image->getLatexErrorMsg().empty() && m_err.empty()) {
+        if (m_latex_image->getLatexErrorMsg().empty() && m_err.empty() && m_latex_image->isTiled()) {
+            draw_tiles(*m_latex_image->getTiles());
+        }
+        else if (m_latex_image->getLatexErrorMsg().empty() && m_err.empty()) {
             auto texture = m_latex_image->getImage()->texture();
             auto cursor_pos = ImGui::GetCursorScreenPos();
             cursor_pos.x += 5;
@@ -265,7 +419,10 @@ void MainApp::result_window(float width) {
             draw_list->AddImage(
                 m_latex_image->getImage()->texture(),
                 cursor_pos,
-                cursor_pos + m_latex_image->getDimensions()
+                cursor_pos + m_latex_image->getDimensions(),
+                ImVec2(0.f, 0.f),
+                ImVec2(1.f, 1.f),
+                m_latex_image->getImage()->getDrawColor()
             );
         }
         else {
@@ -280,10 +437,53 @@ void MainApp::result_window(float width) {
         ImGui::Text("%s", m_err.c_str());
         ImGui::PopStyleColor();
     }
+    else if (!m_font_error.empty()) {
+        ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.f, 0.f, 0.f, 1.f));
+        ImGui::Text("Could not load the font family: %s", m_font_error.c_str());
+        ImGui::PopStyleColor();
+    }
     ImGui::EndChild();
     ImGui::PopStyleColor();
 }
 
+void MainApp::draw_tiles(Latex::TiledRaster& tiles) {
+    const int tile_size = Latex::TiledRaster::tile_size;
+    auto origin = ImGui::GetCursorScreenPos();
+    origin.x += 5;
+    origin.y += 5;
+    auto draw_list = ImGui::GetWindowDrawList();
+
+    // Only the tiles intersecting the clip rect are rasterized / uploaded, the others are released
+    ImVec2 clip_min = draw_list->GetClipRectMin() - origin;
+    ImVec2 clip_max = draw_list->GetClipRectMax() - origin;
+    int first_column = std::max(0, (int)std::floor(clip_min.x / tile_size));
+    int first_row = std::max(0, (int)std::floor(clip_min.y / tile_size));
+    int last_column = std::min(tiles.getColumns() - 1, (int)std::floor(clip_max.x / tile_size));
+    int last_row = std::min(tiles.getRows() - 1, (int)std::floor(clip_max.y / tile_size));
+    tiles.keepOnly(first_column, first_row, last_column, last_row);
+    // Tiles scrolled into view are rasterized together, in parallel
+    tiles.rasterizeTiles(first_column, first_row, last_column, last_row);
+
+    for (int row = first_row;row <= last_row;row++) {
+        for (int column = first_column;column <= last_column;column++) {
+            auto image = tiles.getTileImage(column, row);
+            if (image == nullptr || image->width() <= 0)
+                continue;
+            ImVec2 tile_pos(origin.x + column * tile_size, origin.y + row * tile_size);
+            draw_list->AddImage(
+                image->texture(),
+                tile_pos,
+                tile_pos + ImVec2((float)image->width(), (float)image->height()),
+                ImVec2(0.f, 0.f),
+                ImVec2(1.f, 1.f),
+                image->getDrawColor()
+            );
+        }
+    }
+    // Makes the child scrollable over the whole formula
+    ImGui::Dummy(ImVec2((float)tiles.getWidth() + 5, (float)tiles.getHeight() + 5));
+}
+
 void MainApp::FrameUpdate() {
     /* ImGui configs */
     auto& io = ImGui::GetIO();
@@ -312,8 +512,15 @@ void MainApp::FrameUpdate() {
         m_txt = hist.latex;
         m_prev_text = "";
     }
+
+    // The other font families are loaded once the window is shown
+    if (!m_fonts_preloaded) {
+        Latex::preloadFontFamilies();
+        m_fonts_preloaded = true;
+    }
 }
 
 void MainApp::BeforeFrameUpdate() {
     generate_image();
+    retrieve_image();
 }
\ No newline at end of file
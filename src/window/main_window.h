@@ -5,6 +5,8 @@
 
 #include "misc/cpp/imgui_stdlib.h"
 #include "latex/latex.h"
+#include "latex/render_worker.h"
+#include "latex/render_scheduler.h"
 #define IMGUI_DEFINE_MATH_OPERATORS
 #include "imgui_internal.h"
 
@@ -31,13 +33,20 @@ private:
     bool m_has_pasted = true;
     bool m_save_to_file = false;
     bool m_just_saved_to_file = false;
+    std::string m_save_error; // of the last save to file, shown until the next edit
+    bool m_fonts_preloaded = false;
+    bool m_size_dragging = false; // the size is being dragged, only the last parse is rescaled
+    bool m_size_previewed = false; // the displayed image is a resize preview, to be rendered exactly
 
     History m_history;
 
     LatexEditor m_latex_editor;
 
     std::string m_err;
+    std::string m_font_error; // of the last font family selected, shown below the image
     std::unique_ptr<Latex::LatexImage> m_latex_image = nullptr;
+    Latex::RenderWorker m_render_worker;
+    Latex::RenderScheduler m_render_scheduler;
 
     float check_time();
 
@@ -46,7 +55,9 @@ private:
     void options();
     void input_field(float width, float height);
     void generate_image();
+    void retrieve_image();
     void result_window(float width);
+    void draw_tiles(Latex::TiledRaster& tiles);
     void set_clipboard();
     void save_to_file();
 public:
@@ -0,0 +1,61 @@
+#include "test.h"
+
+#include <thread>
+
+#include "core/pixel_convert.h"
+#include "latex/render_worker.h"
+
+/**
+ * Renders a solid square through the RenderWorker, as the GUI does
+ */
+static std::vector<unsigned char> render_square(const ImVec4& color, bool coverage) {
+    Latex::RenderRequest request;
+    request.latex = "\\rule{20pt}{20pt}";
+    request.font_size = 30.f;
+    request.text_color = Latex::toMicroTeXColor(color);
+    request.inner_padding = ImVec2(0.f, 0.f);
+    request.coverage = coverage;
+
+    Latex::RenderWorker worker;
+    worker.submit(request);
+    Latex::LatexImageUPtr image;
+    for (int i = 0;i < 1000 && !worker.poll(image);i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (image == nullptr || !image->getLatexErrorMsg().empty())
+        return {};
+    return PixelConvert::toRGBA(image->getPixels());
+}
+
+/**
+ * Returns the first fully opaque pixel (RGBA), or zeros
+ */
+static std::vector<unsigned char> opaque_pixel(const std::vector<unsigned char>& rgba) {
+    for (size_t i = 0;i + 3 < rgba.size();i += 4) {
+        if (rgba[i + 3] == 255)
+            return { rgba[i], rgba[i + 1], rgba[i + 2], rgba[i + 3] };
+    }
+    return { 0, 0, 0, 0 };
+}
+
+TEST_CASE(gui_color_is_argb) {
+    CHECK(Latex::toMicroTeXColor(ImVec4(1.f, 0.f, 0.f, 1.f)) == 0xffff0000);
+    CHECK(Latex::toMicroTeXColor(ImVec4(0.f, 0.f, 1.f, 0.5f)) == 0x800000ff);
+}
+
+TEST_CASE(red_request_renders_red) {
+    auto pixel = opaque_pixel(render_square(ImVec4(1.f, 0.f, 0.f, 1.f), false));
+    CHECK(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0 && pixel[3] == 255);
+}
+
+TEST_CASE(red_coverage_request_renders_red) {
+    // A8: colored with the tint when converted
+    auto pixel = opaque_pixel(render_square(ImVec4(1.f, 0.f, 0.f, 1.f), true));
+    CHECK(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0 && pixel[3] == 255);
+}
+
+TEST_CASE(recolored_coverage_is_red) {
+    Latex::LatexImage image("\\rule{20pt}{20pt}", 30.f, 7.f, microtex::BLACK, ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), nullptr, PixelBuffer::A8);
+    CHECK(image.recolor(Latex::toMicroTeXColor(ImVec4(1.f, 0.f, 0.f, 1.f))));
+    auto pixel = opaque_pixel(image.getRGBA());
+    CHECK(pixel[0] == 255 && pixel[1] == 0 && pixel[2] == 0 && pixel[3] == 255);
+}
@@ -0,0 +1,37 @@
+#include "test.h"
+
+#include "latex/render_cache.h"
+
+TEST_CASE(canonicalize_whitespaces) {
+    CHECK(Latex::canonicalizeLatex("  a \t+\n b  ") == "a + b");
+}
+
+TEST_CASE(canonicalize_blank_lines) {
+    // A blank line is a paragraph break, e.g. in \text{}: it must not become a space
+    CHECK(Latex::canonicalizeLatex("  a \t+\n \n\n b  ") == "a +\n\nb");
+    CHECK(Latex::canonicalizeLatex("\\text{a\n\nb}") != Latex::canonicalizeLatex("\\text{a b}"));
+    CHECK(Latex::canonicalizeLatex("\\text{a\r\n\r\nb}") == Latex::canonicalizeLatex("\\text{a\n  \nb}"));
+    // The line break ending a comment counts
+    CHECK(Latex::canonicalizeLatex("a % c\n\n b") == "a % c\n\nb");
+}
+
+TEST_CASE(canonicalize_escaped_percent) {
+    // \% is a percent sign: the rest of the line is not a comment
+    CHECK(Latex::canonicalizeLatex("a \\% c\n b") == "a \\% c b");
+    CHECK(Latex::canonicalizeLatex("a \\% c\n b") == Latex::canonicalizeLatex("a \\% c b"));
+}
+
+TEST_CASE(canonicalize_line_break_before_comment) {
+    // \\% is a line break followed by a comment, ended by the line break
+    CHECK(Latex::canonicalizeLatex("a \\\\% c\n b") == "a \\\\% c\nb");
+    CHECK(Latex::canonicalizeLatex("a \\\\% c\n b") != Latex::canonicalizeLatex("a \\\\% c b"));
+}
+
+TEST_CASE(canonicalize_line_break_before_escaped_percent) {
+    // \\\% is a line break followed by a percent sign
+    CHECK(Latex::canonicalizeLatex("a \\\\\\% c\n b") == "a \\\\\\% c b");
+}
+
+TEST_CASE(canonicalize_comment_at_start) {
+    CHECK(Latex::canonicalizeLatex("% c\n b") == "% c\nb");
+}
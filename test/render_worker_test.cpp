@@ -0,0 +1,72 @@
+#include "test.h"
+
+#include <thread>
+
+#include "latex/render_worker.h"
+
+/**
+ * Waits for the next image handed out by the worker
+ */
+static Latex::LatexImageUPtr wait_image(Latex::RenderWorker& worker) {
+    Latex::LatexImageUPtr image;
+    for (int i = 0;i < 1000 && !worker.poll(image);i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return image;
+}
+
+TEST_CASE(resize_preview_reuses_parse) {
+    // Not rendered by other cases: a cache hit would not parse
+    Latex::RenderRequest request;
+    request.latex = "\\frac{a}{b} + \\sqrt{resized}";
+    request.font_size = 20.f;
+    request.inner_padding = ImVec2(0.f, 0.f);
+
+    Latex::RenderWorker worker;
+    worker.submit(request);
+    auto image = wait_image(worker);
+    CHECK(image != nullptr && image->getLatexErrorMsg().empty());
+    CHECK(worker.getReusedParseCount() == 0);
+    const float width = image != nullptr ? image->getDimensions().x : 0.f;
+
+    // Dragged: the last parse is rescaled
+    request.font_size = 40.f;
+    request.resize_preview = true;
+    worker.submit(request);
+    image = wait_image(worker);
+    CHECK(image != nullptr && image->getLatexErrorMsg().empty());
+    CHECK(worker.getReusedParseCount() == 1);
+    CHECK(image != nullptr && image->getDimensions().x > 1.8f * width);
+
+    // Released: parsed again at the final size
+    request.resize_preview = false;
+    worker.submit(request);
+    image = wait_image(worker);
+    CHECK(image != nullptr && image->getLatexErrorMsg().empty());
+    CHECK(worker.getReusedParseCount() == 1);
+}
+
+TEST_CASE(invalid_formula_through_worker) {
+    Latex::RenderRequest request;
+    request.latex = "\\frac{a}{\\invalidcommand";
+    Latex::RenderWorker worker;
+    // Parsed, then the same parse in another color, then from the cache
+    for (auto color : { microtex::BLACK, (microtex::color)0xffff0000, microtex::BLACK }) {
+        request.text_color = color;
+        worker.submit(request);
+        auto image = wait_image(worker);
+        CHECK(image != nullptr);
+        if (image == nullptr)
+            continue;
+        CHECK(!image->getLatexErrorMsg().empty());
+        CHECK(image->getDimensions().x == 0.f);
+        CHECK(!image->recolor(0xff0000ff));
+        image->forgetImage();
+        image->redraw(ImVec2(2.f, 2.f), ImVec2(0.f, 0.f));
+    }
+}
+
+TEST_CASE(latex_image_without_parse) {
+    Latex::LatexImage image(Latex::ParsedLatexPtr(nullptr), ImVec2(1.f, 1.f), ImVec2(0.f, 0.f), microtex::BLACK);
+    CHECK(!image.getLatexErrorMsg().empty());
+    image.forgetImage();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Test {
+    struct Case {
+        std::string name;
+        std::function<void()> run;
+    };
+
+    /**
+     * @brief Returns all the registered test cases, in registration order
+     */
+    std::vector<Case>& getCases();
+
+    /**
+     * @brief Reports a failed check of the running case
+     */
+    void fail(const char* file, int line, const char* expression);
+
+    struct Registrar {
+        Registrar(const char* name, const std::function<void()>& run) {
+            getCases().push_back(Case{ name, run });
+        }
+    };
+}
+
+/**
+ * Defines and registers a test case, e.g. TEST_CASE(cache_key) { CHECK(...); }
+ */
+#define TEST_CASE(name) \
+    static void name(); \
+    static Test::Registrar name##_registrar(#name, name); \
+    static void name()
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) \
+            Test::fail(__FILE__, __LINE__, #expression); \
+    } while (0)
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include "test.h"
+#include "latex/latex.h"
+#include "system/sys_util.h"
+
+namespace Test {
+    static size_t failures = 0;
+
+    std::vector<Case>& getCases() {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    void fail(const char* file, int line, const char* expression) {
+        printf("  %s:%d: CHECK(%s) failed\n", file, line, expression);
+        failures++;
+    }
+}
+
+int main(int argc, char** argv) {
+    // Runs only the cases given on the command line, if any
+    std::vector<std::string> selected(argv + 1, argv + argc);
+
+    // The fonts are relative to the executable
+    std::filesystem::current_path(getExecutablePath());
+    std::string err = Latex::init();
+    if (!err.empty()) {
+        std::cerr << "Could not initialize latex: " << err << std::endl;
+        return 1;
+    }
+
+    size_t failed_cases = 0;
+    for (auto& test_case : Test::getCases()) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), test_case.name) == selected.end())
+            continue;
+        size_t failures = Test::failures;
+        test_case.run();
+        bool passed = Test::failures == failures;
+        printf("%s %s\n", passed ? "[ OK ]" : "[FAIL]", test_case.name.c_str());
+        failed_cases += passed ? 0 : 1;
+    }
+    Latex::release();
+    printf("%zu case(s) failed\n", failed_cases);
+    return failed_cases == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "test.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "latex/thumbnail_pack.h"
+
+static PixelBuffer make_pixels(int width, int height, unsigned char value) {
+    PixelBuffer pixels;
+    pixels.width = width;
+    pixels.height = height;
+    pixels.stride = 4 * width;
+    pixels.data = std::make_shared<ARGB_Image>((size_t)pixels.stride * height, value);
+    return pixels;
+}
+
+TEST_CASE(thumbnail_pack_append_and_reopen) {
+    auto path = (std::filesystem::temp_directory_path() / "quicktex_test.pack").string();
+    std::filesystem::remove(path);
+    {
+        Latex::ThumbnailPack pack;
+        CHECK(pack.open(path));
+        for (int i = 0;i < 20;i++)
+            CHECK(pack.append("x^" + std::to_string(i), make_pixels(3 + i, 2, (unsigned char)i)));
+        CHECK(pack.count() == 20);
+
+        Latex::PixelView view;
+        CHECK(pack.get("x^7", view));
+        CHECK(view.width == 10 && view.height == 2 && view.data[0] == 7);
+        CHECK(!pack.get("x^20", view));
+    }
+    Latex::ThumbnailPack pack;
+    CHECK(pack.open(path));
+    CHECK(pack.count() == 20);
+    Latex::PixelView view;
+    CHECK(pack.get("x^19", view));
+    CHECK(view.width == 22 && view.data[4 * 22 * 2 - 1] == 19);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE(thumbnail_pack_corrupted_size) {
+    auto path = (std::filesystem::temp_directory_path() / "quicktex_test_corrupted.pack").string();
+    std::filesystem::remove(path);
+    {
+        Latex::ThumbnailPack pack;
+        CHECK(pack.open(path));
+        CHECK(pack.append("a", make_pixels(4, 4, 1)));
+        CHECK(pack.append("b", make_pixels(4, 4, 2)));
+    }
+    // The last 8 bytes of the second record header: data_size, made to wrap around the file size
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        const size_t header_size = 48; // sizeof(RecordHeader)
+        const size_t first_record = 16 + header_size + 16 + 4 * 4 * 4;
+        file.seekp(first_record + header_size - 8);
+        const uint64_t data_size = ~(uint64_t)0 - 8;
+        file.write((const char*)&data_size, sizeof(data_size));
+    }
+    Latex::ThumbnailPack pack;
+    CHECK(pack.open(path));
+    CHECK(pack.count() == 1);
+    Latex::PixelView view;
+    CHECK(pack.get("a", view) && view.data[0] == 1);
+    CHECK(!pack.get("b", view));
+    // The corrupted record is discarded, new records stay reachable
+    CHECK(pack.append("c", make_pixels(4, 4, 3)));
+    CHECK(pack.get("c", view) && view.data[0] == 3);
+    std::filesystem::remove(path);
+}